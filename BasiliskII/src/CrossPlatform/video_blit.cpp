@@ -25,6 +25,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 // Format of the target visual
 static VisualFormat visualFormat;
 
@@ -34,6 +38,40 @@ uint32 ExpandMap[256];
 // Mark video_blit.h for specialization
 #define DEFINE_VIDEO_BLITTERS 1
 
+// Use SSE2/AVX2 blitters on x86 hosts, they are selected at run-time
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#if defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define USE_SIMD_BLITTERS 1
+#endif
+#endif
+
+#ifdef USE_SIMD_BLITTERS
+#include <immintrin.h>
+
+typedef uint16 blit_v8hu __attribute__((vector_size(16)));
+typedef uint16 blit_v16hu __attribute__((vector_size(32)));
+typedef uint32 blit_v4su __attribute__((vector_size(16)));
+typedef uint32 blit_v8su __attribute__((vector_size(32)));
+
+// Define NAME_ISA() that runs FB_BLIT_V() on vectors of type VEC_T, the
+// remaining bytes are handled by the scalar NAME() function
+#define DEFINE_SIMD_BLITTER(name, isa, isa_name, vec_t) \
+		DEFINE_SIMD_BLITTER_1(name, isa, isa_name, vec_t)
+#define DEFINE_SIMD_BLITTER_1(name, isa, isa_name, vec_t) \
+static __attribute__((target(isa_name))) void name##_##isa(uint8 * dest, const uint8 * source, uint32 length) \
+{ \
+	const uint32 n = length & ~uint32(sizeof(vec_t) - 1); \
+	for (uint32 i = 0; i < n; i += sizeof(vec_t)) { \
+		vec_t s, d; \
+		memcpy(&s, source + i, sizeof(vec_t)); \
+		FB_BLIT_V(d, s); \
+		memcpy(dest + i, &d, sizeof(vec_t)); \
+	} \
+	if (n < length) \
+		name(dest + n, source + n, length - n); \
+}
+#endif
+
 /* -------------------------------------------------------------------------- */
 /* --- Raw Copy / No conversion required                                  --- */
 /* -------------------------------------------------------------------------- */
@@ -462,6 +500,339 @@ static void Blit_Expand_8_To_32(uint8 * dest, const uint8 * p, uint32 length)
 		*q++ = ExpandMap[*p++];
 }
 
+#ifdef USE_SIMD_BLITTERS
+
+/* -------------------------------------------------------------------------- */
+/* --- SSE2 indexed mode conversion                                       --- */
+/* -------------------------------------------------------------------------- */
+
+// Expand the 16 bytes of V into 8 masks where each bit becomes 0x00 or 0xff
+// (MSB first), M[i] holds the bits of source bytes 2*i and 2*i+1
+static inline __attribute__((target("sse2"))) void expand_bits_sse2(__m128i m[8], __m128i v)
+{
+	const __m128i bits = _mm_set_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+	const __m128i b0 = _mm_unpacklo_epi8(v, v);
+	const __m128i b1 = _mm_unpackhi_epi8(v, v);
+	const __m128i w[4] = {
+		_mm_unpacklo_epi16(b0, b0), _mm_unpackhi_epi16(b0, b0),
+		_mm_unpacklo_epi16(b1, b1), _mm_unpackhi_epi16(b1, b1)
+	};
+	for (int i = 0; i < 4; i++) {
+		m[2 * i + 0] = _mm_cmpeq_epi8(_mm_and_si128(_mm_unpacklo_epi32(w[i], w[i]), bits), bits);
+		m[2 * i + 1] = _mm_cmpeq_epi8(_mm_and_si128(_mm_unpackhi_epi32(w[i], w[i]), bits), bits);
+	}
+}
+
+static __attribute__((target("sse2"))) void Blit_Expand_1_To_8_Color_SSE2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m128i ones = _mm_set1_epi8(-1);
+	const uint32 n = length & ~15;
+	for (uint32 i = 0; i < n; i += 16) {
+		__m128i m[8];
+		expand_bits_sse2(m, _mm_loadu_si128((const __m128i *)(p + i)));
+		for (int j = 0; j < 8; j++)
+			_mm_storeu_si128((__m128i *)(dest + 8 * i + 16 * j), _mm_xor_si128(m[j], ones));
+	}
+	Blit_Expand_1_To_8_Color(dest + 8 * n, p + n, length - n);
+}
+
+static __attribute__((target("sse2"))) void Blit_Expand_1_To_8_SSE2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m128i one = _mm_set1_epi8(1);
+	const uint32 n = length & ~15;
+	for (uint32 i = 0; i < n; i += 16) {
+		__m128i m[8];
+		expand_bits_sse2(m, _mm_loadu_si128((const __m128i *)(p + i)));
+		for (int j = 0; j < 8; j++)
+			_mm_storeu_si128((__m128i *)(dest + 8 * i + 16 * j), _mm_and_si128(m[j], one));
+	}
+	Blit_Expand_1_To_8(dest + 8 * n, p + n, length - n);
+}
+
+static __attribute__((target("sse2"))) void Blit_Expand_2_To_8_SSE2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m128i mask = _mm_set1_epi8(3);
+	const uint32 n = length & ~15;
+	for (uint32 i = 0; i < n; i += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+		const __m128i a = _mm_and_si128(_mm_srli_epi16(v, 6), mask);
+		const __m128i b = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+		const __m128i c = _mm_and_si128(_mm_srli_epi16(v, 2), mask);
+		const __m128i d = _mm_and_si128(v, mask);
+		const __m128i ab_lo = _mm_unpacklo_epi8(a, b), ab_hi = _mm_unpackhi_epi8(a, b);
+		const __m128i cd_lo = _mm_unpacklo_epi8(c, d), cd_hi = _mm_unpackhi_epi8(c, d);
+		__m128i *q = (__m128i *)(dest + 4 * i);
+		_mm_storeu_si128(q + 0, _mm_unpacklo_epi16(ab_lo, cd_lo));
+		_mm_storeu_si128(q + 1, _mm_unpackhi_epi16(ab_lo, cd_lo));
+		_mm_storeu_si128(q + 2, _mm_unpacklo_epi16(ab_hi, cd_hi));
+		_mm_storeu_si128(q + 3, _mm_unpackhi_epi16(ab_hi, cd_hi));
+	}
+	Blit_Expand_2_To_8(dest + 4 * n, p + n, length - n);
+}
+
+static __attribute__((target("sse2"))) void Blit_Expand_4_To_8_SSE2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	const uint32 n = length & ~15;
+	for (uint32 i = 0; i < n; i += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+		const __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+		const __m128i lo = _mm_and_si128(v, mask);
+		__m128i *q = (__m128i *)(dest + 2 * i);
+		_mm_storeu_si128(q + 0, _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128(q + 1, _mm_unpackhi_epi8(hi, lo));
+	}
+	Blit_Expand_4_To_8(dest + 2 * n, p + n, length - n);
+}
+
+static __attribute__((target("sse2"))) void Blit_Expand_1_To_16_SSE2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const uint32 n = length & ~15;
+	for (uint32 i = 0; i < n; i += 16) {
+		__m128i m[8];
+		expand_bits_sse2(m, _mm_loadu_si128((const __m128i *)(p + i)));
+		__m128i *q = (__m128i *)(dest + 16 * i);
+		for (int j = 0; j < 8; j++) {
+			_mm_storeu_si128(q + 2 * j + 0, _mm_unpacklo_epi8(m[j], m[j]));
+			_mm_storeu_si128(q + 2 * j + 1, _mm_unpackhi_epi8(m[j], m[j]));
+		}
+	}
+	Blit_Expand_1_To_16(dest + 16 * n, p + n, length - n);
+}
+
+static __attribute__((target("sse2"))) void Blit_Expand_1_To_32_SSE2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const uint32 n = length & ~15;
+	for (uint32 i = 0; i < n; i += 16) {
+		__m128i m[8];
+		expand_bits_sse2(m, _mm_loadu_si128((const __m128i *)(p + i)));
+		__m128i *q = (__m128i *)(dest + 32 * i);
+		for (int j = 0; j < 8; j++) {
+			const __m128i lo = _mm_unpacklo_epi8(m[j], m[j]);
+			const __m128i hi = _mm_unpackhi_epi8(m[j], m[j]);
+			_mm_storeu_si128(q + 4 * j + 0, _mm_unpacklo_epi16(lo, lo));
+			_mm_storeu_si128(q + 4 * j + 1, _mm_unpackhi_epi16(lo, lo));
+			_mm_storeu_si128(q + 4 * j + 2, _mm_unpacklo_epi16(hi, hi));
+			_mm_storeu_si128(q + 4 * j + 3, _mm_unpackhi_epi16(hi, hi));
+		}
+	}
+	Blit_Expand_1_To_32(dest + 32 * n, p + n, length - n);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- AVX2 indexed mode conversion                                       --- */
+/* -------------------------------------------------------------------------- */
+
+// Turn each bit selected by BITS in the bytes of V picked by IDX into 0x00 or 0xff
+static inline __attribute__((target("avx2"))) __m256i expand_bits_avx2(__m256i v, __m256i idx, __m256i bits)
+{
+	return _mm256_cmpeq_epi8(_mm256_and_si256(_mm256_shuffle_epi8(v, idx), bits), bits);
+}
+
+static inline __attribute__((target("avx2"))) __m256i load_4_bytes_avx2(const uint8 * p)
+{
+	uint32 v;
+	memcpy(&v, p, 4);
+	return _mm256_set1_epi32(v);
+}
+
+static __attribute__((target("avx2"))) void Blit_Expand_1_To_8_Color_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m256i idx = _mm256_setr_epi64x(0, 0x0101010101010101LL, 0x0202020202020202LL, 0x0303030303030303LL);
+	const __m256i bits = _mm256_set1_epi64x(0x0102040810204080LL);
+	const __m256i ones = _mm256_set1_epi8(-1);
+	const uint32 n = length & ~3;
+	for (uint32 i = 0; i < n; i += 4)
+		_mm256_storeu_si256((__m256i *)(dest + 8 * i), _mm256_xor_si256(expand_bits_avx2(load_4_bytes_avx2(p + i), idx, bits), ones));
+	Blit_Expand_1_To_8_Color(dest + 8 * n, p + n, length - n);
+}
+
+static __attribute__((target("avx2"))) void Blit_Expand_1_To_8_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m256i idx = _mm256_setr_epi64x(0, 0x0101010101010101LL, 0x0202020202020202LL, 0x0303030303030303LL);
+	const __m256i bits = _mm256_set1_epi64x(0x0102040810204080LL);
+	const __m256i one = _mm256_set1_epi8(1);
+	const uint32 n = length & ~3;
+	for (uint32 i = 0; i < n; i += 4)
+		_mm256_storeu_si256((__m256i *)(dest + 8 * i), _mm256_and_si256(expand_bits_avx2(load_4_bytes_avx2(p + i), idx, bits), one));
+	Blit_Expand_1_To_8(dest + 8 * n, p + n, length - n);
+}
+
+static __attribute__((target("avx2"))) void Blit_Expand_2_To_8_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m256i mask = _mm256_set1_epi8(3);
+	const uint32 n = length & ~31;
+	for (uint32 i = 0; i < n; i += 32) {
+		const __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+		const __m256i a = _mm256_and_si256(_mm256_srli_epi16(v, 6), mask);
+		const __m256i b = _mm256_and_si256(_mm256_srli_epi16(v, 4), mask);
+		const __m256i c = _mm256_and_si256(_mm256_srli_epi16(v, 2), mask);
+		const __m256i d = _mm256_and_si256(v, mask);
+		const __m256i ab_lo = _mm256_unpacklo_epi8(a, b), ab_hi = _mm256_unpackhi_epi8(a, b);
+		const __m256i cd_lo = _mm256_unpacklo_epi8(c, d), cd_hi = _mm256_unpackhi_epi8(c, d);
+		const __m256i x0 = _mm256_unpacklo_epi16(ab_lo, cd_lo), x1 = _mm256_unpackhi_epi16(ab_lo, cd_lo);
+		const __m256i x2 = _mm256_unpacklo_epi16(ab_hi, cd_hi), x3 = _mm256_unpackhi_epi16(ab_hi, cd_hi);
+		__m256i *q = (__m256i *)(dest + 4 * i);
+		_mm256_storeu_si256(q + 0, _mm256_permute2x128_si256(x0, x1, 0x20));
+		_mm256_storeu_si256(q + 1, _mm256_permute2x128_si256(x2, x3, 0x20));
+		_mm256_storeu_si256(q + 2, _mm256_permute2x128_si256(x0, x1, 0x31));
+		_mm256_storeu_si256(q + 3, _mm256_permute2x128_si256(x2, x3, 0x31));
+	}
+	Blit_Expand_2_To_8(dest + 4 * n, p + n, length - n);
+}
+
+static __attribute__((target("avx2"))) void Blit_Expand_4_To_8_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m256i mask = _mm256_set1_epi8(0x0f);
+	const uint32 n = length & ~31;
+	for (uint32 i = 0; i < n; i += 32) {
+		const __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+		const __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), mask);
+		const __m256i lo = _mm256_and_si256(v, mask);
+		const __m256i x0 = _mm256_unpacklo_epi8(hi, lo), x1 = _mm256_unpackhi_epi8(hi, lo);
+		__m256i *q = (__m256i *)(dest + 2 * i);
+		_mm256_storeu_si256(q + 0, _mm256_permute2x128_si256(x0, x1, 0x20));
+		_mm256_storeu_si256(q + 1, _mm256_permute2x128_si256(x0, x1, 0x31));
+	}
+	Blit_Expand_4_To_8(dest + 2 * n, p + n, length - n);
+}
+
+static __attribute__((target("avx2"))) void Blit_Expand_1_To_16_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m256i idx = _mm256_setr_epi64x(0, 0, 0x0101010101010101LL, 0x0101010101010101LL);
+	const __m256i bits = _mm256_setr_epi64x(0x1010202040408080LL, 0x0101020204040808LL, 0x1010202040408080LL, 0x0101020204040808LL);
+	const uint32 n = length & ~1;
+	for (uint32 i = 0; i < n; i += 2) {
+		uint16 c;
+		memcpy(&c, p + i, 2);
+		_mm256_storeu_si256((__m256i *)(dest + 16 * i), expand_bits_avx2(_mm256_set1_epi16(c), idx, bits));
+	}
+	Blit_Expand_1_To_16(dest + 16 * n, p + n, length - n);
+}
+
+static __attribute__((target("avx2"))) void Blit_Expand_1_To_32_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const __m256i bits = _mm256_setr_epi32(int(0x80808080), 0x40404040, 0x20202020, 0x10101010, 0x08080808, 0x04040404, 0x02020202, 0x01010101);
+	for (uint32 i = 0; i < length; i++) {
+		const __m256i v = _mm256_and_si256(_mm256_set1_epi8(p[i]), bits);
+		_mm256_storeu_si256((__m256i *)(dest + 32 * i), _mm256_cmpeq_epi8(v, bits));
+	}
+}
+
+// Look up ExpandMap[] for the 8 indices in IDX
+static inline __attribute__((target("avx2"))) __m256i expand_map_avx2(__m256i idx)
+{
+	return _mm256_i32gather_epi32((const int *)ExpandMap, idx, 4);
+}
+
+// Truncate the 32-bit values of A and B to 16 bits, preserving their order
+static inline __attribute__((target("avx2"))) __m256i pack_16_avx2(__m256i a, __m256i b)
+{
+	const __m256i mask = _mm256_set1_epi32(0xffff);
+	const __m256i x = _mm256_packus_epi32(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+	return _mm256_permute4x64_epi64(x, _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+// Compute ExpandMap[] indices for the 2-bit pixels of the 8 bytes at P, in order
+static inline __attribute__((target("avx2"))) void expand_2_index_avx2(__m256i idx[4], const uint8 * p)
+{
+	const __m256i d = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p));
+	const __m256i a = _mm256_srli_epi32(d, 6);
+	const __m256i b = _mm256_srli_epi32(d, 4);
+	const __m256i c = _mm256_srli_epi32(d, 2);
+	const __m256i ab_lo = _mm256_unpacklo_epi32(a, b), ab_hi = _mm256_unpackhi_epi32(a, b);
+	const __m256i cd_lo = _mm256_unpacklo_epi32(c, d), cd_hi = _mm256_unpackhi_epi32(c, d);
+	const __m256i x0 = _mm256_unpacklo_epi64(ab_lo, cd_lo), x1 = _mm256_unpackhi_epi64(ab_lo, cd_lo);
+	const __m256i x2 = _mm256_unpacklo_epi64(ab_hi, cd_hi), x3 = _mm256_unpackhi_epi64(ab_hi, cd_hi);
+	idx[0] = _mm256_permute2x128_si256(x0, x1, 0x20);
+	idx[1] = _mm256_permute2x128_si256(x2, x3, 0x20);
+	idx[2] = _mm256_permute2x128_si256(x0, x1, 0x31);
+	idx[3] = _mm256_permute2x128_si256(x2, x3, 0x31);
+}
+
+// Compute ExpandMap[] indices for the 4-bit pixels of the 8 bytes at P, in order
+static inline __attribute__((target("avx2"))) void expand_4_index_avx2(__m256i idx[2], const uint8 * p)
+{
+	const __m256i lo = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p));
+	const __m256i hi = _mm256_srli_epi32(lo, 4);
+	const __m256i x0 = _mm256_unpacklo_epi32(hi, lo), x1 = _mm256_unpackhi_epi32(hi, lo);
+	idx[0] = _mm256_permute2x128_si256(x0, x1, 0x20);
+	idx[1] = _mm256_permute2x128_si256(x0, x1, 0x31);
+}
+
+static __attribute__((target("avx2"))) void Blit_Expand_2_To_16_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const uint32 n = length & ~7;
+	for (uint32 i = 0; i < n; i += 8) {
+		__m256i idx[4];
+		expand_2_index_avx2(idx, p + i);
+		__m256i *q = (__m256i *)(dest + 8 * i);
+		_mm256_storeu_si256(q + 0, pack_16_avx2(expand_map_avx2(idx[0]), expand_map_avx2(idx[1])));
+		_mm256_storeu_si256(q + 1, pack_16_avx2(expand_map_avx2(idx[2]), expand_map_avx2(idx[3])));
+	}
+	Blit_Expand_2_To_16(dest + 8 * n, p + n, length - n);
+}
+
+static __attribute__((target("avx2"))) void Blit_Expand_4_To_16_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const uint32 n = length & ~7;
+	for (uint32 i = 0; i < n; i += 8) {
+		__m256i idx[2];
+		expand_4_index_avx2(idx, p + i);
+		_mm256_storeu_si256((__m256i *)(dest + 4 * i), pack_16_avx2(expand_map_avx2(idx[0]), expand_map_avx2(idx[1])));
+	}
+	Blit_Expand_4_To_16(dest + 4 * n, p + n, length - n);
+}
+
+static __attribute__((target("avx2"))) void Blit_Expand_8_To_16_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const uint32 n = length & ~15;
+	for (uint32 i = 0; i < n; i += 16) {
+		const __m256i idx0 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(p + i)));
+		const __m256i idx1 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(p + i + 8)));
+		_mm256_storeu_si256((__m256i *)(dest + 2 * i), pack_16_avx2(expand_map_avx2(idx0), expand_map_avx2(idx1)));
+	}
+	Blit_Expand_8_To_16(dest + 2 * n, p + n, length - n);
+}
+
+static __attribute__((target("avx2"))) void Blit_Expand_2_To_32_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const uint32 n = length & ~7;
+	for (uint32 i = 0; i < n; i += 8) {
+		__m256i idx[4];
+		expand_2_index_avx2(idx, p + i);
+		__m256i *q = (__m256i *)(dest + 16 * i);
+		for (int j = 0; j < 4; j++)
+			_mm256_storeu_si256(q + j, expand_map_avx2(idx[j]));
+	}
+	Blit_Expand_2_To_32(dest + 16 * n, p + n, length - n);
+}
+
+static __attribute__((target("avx2"))) void Blit_Expand_4_To_32_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const uint32 n = length & ~7;
+	for (uint32 i = 0; i < n; i += 8) {
+		__m256i idx[2];
+		expand_4_index_avx2(idx, p + i);
+		__m256i *q = (__m256i *)(dest + 8 * i);
+		_mm256_storeu_si256(q + 0, expand_map_avx2(idx[0]));
+		_mm256_storeu_si256(q + 1, expand_map_avx2(idx[1]));
+	}
+	Blit_Expand_4_To_32(dest + 8 * n, p + n, length - n);
+}
+
+static __attribute__((target("avx2"))) void Blit_Expand_8_To_32_AVX2(uint8 * dest, const uint8 * p, uint32 length)
+{
+	const uint32 n = length & ~7;
+	for (uint32 i = 0; i < n; i += 8) {
+		const __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(p + i)));
+		_mm256_storeu_si256((__m256i *)(dest + 4 * i), expand_map_avx2(idx));
+	}
+	Blit_Expand_8_To_32(dest + 4 * n, p + n, length - n);
+}
+
+#endif
+
 /* -------------------------------------------------------------------------- */
 /* --- Blitters to the host frame buffer, or XImage buffer                --- */
 /* -------------------------------------------------------------------------- */
@@ -509,6 +880,65 @@ static Screen_blit_func_info Screen_blitters[] = {
 	{ 32, 0xff00, 0xff0000, 0xff000000, Blit_Copy_Raw   , Blit_Copy_Raw     }   // OK
 };
 
+#ifdef USE_SIMD_BLITTERS
+// Structure used to match the vectorized variants of an update function
+struct Screen_blit_simd_info {
+	const char *		name;			// Update function name
+	Screen_blit_func	handler;		// Update function (reference)
+	Screen_blit_func	handler_sse2;	// Update function (SSE2)
+	Screen_blit_func	handler_avx2;	// Update function (AVX2)
+};
+
+#define SIMD_BLITTER(name)			{ #name, name, name##_SSE2, name##_AVX2 }
+#define SIMD_BLITTER_AVX2(name)		{ #name, name, NULL, name##_AVX2 }
+
+// Table of update functions with vectorized variants
+static const Screen_blit_simd_info Screen_blitters_simd[] = {
+	SIMD_BLITTER(Blit_RGB555_NBO),
+	SIMD_BLITTER(Blit_BGR555_NBO),
+	SIMD_BLITTER(Blit_BGR555_OBO),
+	SIMD_BLITTER(Blit_RGB565_NBO),
+	SIMD_BLITTER(Blit_RGB565_OBO),
+	SIMD_BLITTER(Blit_RGB888_NBO),
+	SIMD_BLITTER(Blit_BGR888_NBO),
+	SIMD_BLITTER(Blit_BGR888_OBO),
+	SIMD_BLITTER(Blit_Expand_1_To_8_Color),
+	SIMD_BLITTER(Blit_Expand_1_To_8),
+	SIMD_BLITTER(Blit_Expand_2_To_8),
+	SIMD_BLITTER(Blit_Expand_4_To_8),
+	SIMD_BLITTER(Blit_Expand_1_To_16),
+	SIMD_BLITTER_AVX2(Blit_Expand_2_To_16),
+	SIMD_BLITTER_AVX2(Blit_Expand_4_To_16),
+	SIMD_BLITTER_AVX2(Blit_Expand_8_To_16),
+	SIMD_BLITTER(Blit_Expand_1_To_32),
+	SIMD_BLITTER_AVX2(Blit_Expand_2_To_32),
+	SIMD_BLITTER_AVX2(Blit_Expand_4_To_32),
+	SIMD_BLITTER_AVX2(Blit_Expand_8_To_32)
+};
+
+#undef SIMD_BLITTER_AVX2
+#undef SIMD_BLITTER
+
+// Return the fastest variant of HANDLER the host CPU supports
+static Screen_blit_func Screen_blit_simd(Screen_blit_func handler)
+{
+	__builtin_cpu_init();
+	const bool have_sse2 = __builtin_cpu_supports("sse2");
+	const bool have_avx2 = __builtin_cpu_supports("avx2");
+	const int blitters_count = sizeof(Screen_blitters_simd)/sizeof(Screen_blitters_simd[0]);
+	for (int i = 0; i < blitters_count; i++) {
+		if (Screen_blitters_simd[i].handler == handler) {
+			if (have_avx2 && Screen_blitters_simd[i].handler_avx2)
+				return Screen_blitters_simd[i].handler_avx2;
+			if (have_sse2 && Screen_blitters_simd[i].handler_sse2)
+				return Screen_blitters_simd[i].handler_sse2;
+			break;
+		}
+	}
+	return handler;
+}
+#endif
+
 // Initialize the framebuffer update function
 // Returns FALSE, if the function was to be reduced to a simple memcpy()
 // --> In that case, VOSF is not necessary
@@ -610,7 +1040,148 @@ bool Screen_blitter_init(VisualFormat const & visual_format, bool native_byte_or
 	}
 #endif
 	
+#ifdef USE_SIMD_BLITTERS
+	// Use a vectorized variant if the host CPU supports it
+	Screen_blit = Screen_blit_simd(Screen_blit);
+#endif
+
 	// If the blitter simply reduces to a copy, we don't need VOSF in DGA mode
 	// --> In that case, we return FALSE
 	return (Screen_blit != Blit_Copy_Raw);
 }
+
+
+/*
+ *  Test program checking the vectorized blitters against the reference ones,
+ *  and the incremental scanline update
+ */
+
+#ifdef TEST_VIDEO_BLIT
+#include "../SDL/video_sdl_tiles.h"
+
+#ifdef USE_SIMD_BLITTERS
+static bool test_blitter(const char *name, const char *isa, Screen_blit_func ref, Screen_blit_func func)
+{
+	const uint32 max_length = 1024;
+	const uint32 buffer_size = 32 * (max_length + 4) + 64;
+	static uint8 src[max_length + 64 + 4], dst_ref[buffer_size], dst[buffer_size];
+	for (int n = 0; n < 2000; n++) {
+		// Lengths are whole 32-bit words, as scanlines are
+		const uint32 length = 4 * (1 + ((n < 250) ? n : (rand() % (max_length / 4))));
+		const uint32 src_ofs = rand() % 32, dst_ofs = rand() % 32;
+		for (uint32 i = 0; i < sizeof(src); i++)
+			src[i] = rand();
+		for (uint32 i = 0; i < 256; i++)
+			ExpandMap[i] = rand() ^ (rand() << 16);
+		memset(dst_ref, n, buffer_size);
+		memset(dst, n, buffer_size);
+		ref(dst_ref + dst_ofs, src + src_ofs, length);
+		func(dst + dst_ofs, src + src_ofs, length);
+		if (memcmp(dst_ref, dst, buffer_size) != 0) {
+			printf("%s (%s): mismatch for %d bytes (source offset %d, destination offset %d)\n",
+				   name, isa, length, src_ofs, dst_ofs);
+			return false;
+		}
+	}
+	return true;
+}
+#endif
+
+// Blitter expanding each bit of the source to a byte
+static void test_blit_expand_bits(uint8 * dest, const uint8 * source, uint32 length)
+{
+	for (uint32 i = 0; i < length * 8; i++)
+		dest[i] = (source[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+static void test_blit_copy(uint8 * dest, const uint8 * source, uint32 length)
+{
+	memcpy(dest, source, length);
+}
+
+static bool test_changed_tiles(uint32 width, uint32 depth)
+{
+	// 1-bit scanlines are expanded to one byte per pixel, others are copied
+	const uint32 pixels_per_byte = (depth == 1) ? 8 : 1;
+	const uint32 bytes_per_pixel = (depth == 1) ? 1 : depth / 8;
+	const uint32 dest_bytes_per_pixel = bytes_per_pixel;
+	Screen_blit = (depth == 1) ? test_blit_expand_bits : test_blit_copy;
+
+	// Tiles are 64 pixels wide, but at least 16 bytes, as in the SDL driver
+	uint32 tile_shift = 4;
+	while ((1U << tile_shift) < 64 * bytes_per_pixel / pixels_per_byte)
+		tile_shift++;
+	const uint32 length = (width * bytes_per_pixel + pixels_per_byte - 1) / pixels_per_byte;
+	const uint32 dest_length = length * pixels_per_byte / bytes_per_pixel * dest_bytes_per_pixel;
+	const uint32 n_tiles = (length + (1 << tile_shift) - 1) >> tile_shift;
+
+	static uint8 src[8192], copy[8192], dst[65536], dst_ref[65536];
+	bool dirty[256], dirty_ref[256];
+	for (int n = 0; n < 1000; n++) {
+		for (uint32 i = 0; i < length; i++)
+			src[i] = copy[i] = rand();
+		Screen_blit(dst, src, length);
+
+		// A few changed bytes, often in the last tile, sometimes none
+		const int n_changes = n % 5;
+		for (int k = 0; k < n_changes; k++) {
+			const uint32 ofs = (rand() & 1) ? length - 1 - rand() % 16 : rand() % length;
+			src[ofs] ^= 1 + rand() % 255;
+		}
+		bool changed_ref = false;
+		for (uint32 i = 0; i < n_tiles; i++) {
+			const uint32 start = i << tile_shift;
+			const uint32 end = (start + (1 << tile_shift) < length) ? start + (1 << tile_shift) : length;
+			dirty_ref[i] = memcmp(src + start, copy + start, end - start) != 0;
+			changed_ref |= dirty_ref[i];
+		}
+		Screen_blit(dst_ref, src, length);
+
+		memset(dirty, 0, sizeof(dirty));
+		const bool changed = blit_changed_tiles(dst, src, copy, length, tile_shift,
+											   pixels_per_byte, bytes_per_pixel, dest_bytes_per_pixel, dirty);
+		if (changed != changed_ref || memcmp(dirty, dirty_ref, n_tiles) != 0 ||
+			memcmp(copy, src, length) != 0 || memcmp(dst, dst_ref, dest_length) != 0) {
+			printf("blit_changed_tiles: mismatch for %d pixels at %d bpp (%d changes)\n", width, depth, n_changes);
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(void)
+{
+	int n_errors = 0;
+#ifdef USE_SIMD_BLITTERS
+	__builtin_cpu_init();
+	const bool have_sse2 = __builtin_cpu_supports("sse2");
+	const bool have_avx2 = __builtin_cpu_supports("avx2");
+	const int blitters_count = sizeof(Screen_blitters_simd)/sizeof(Screen_blitters_simd[0]);
+	for (int i = 0; i < blitters_count; i++) {
+		const Screen_blit_simd_info & b = Screen_blitters_simd[i];
+		if (have_sse2 && b.handler_sse2 && !test_blitter(b.name, "SSE2", b.handler, b.handler_sse2))
+			n_errors++;
+		if (have_avx2 && b.handler_avx2 && !test_blitter(b.name, "AVX2", b.handler, b.handler_avx2))
+			n_errors++;
+	}
+	printf("%d blitters checked (SSE2 %s, AVX2 %s), %d errors\n", blitters_count,
+		   have_sse2 ? "yes" : "no", have_avx2 ? "yes" : "no", n_errors);
+#else
+	printf("No vectorized blitters on this platform\n");
+#endif
+
+	// Scanline widths are not necessarily a multiple of the tile width
+	static const uint32 widths[] = { 640, 800, 1024, 1366, 1600 };
+	static const uint32 depths[] = { 1, 8, 16, 32 };
+	int n_tile_errors = 0;
+	for (uint32 i = 0; i < sizeof(widths)/sizeof(widths[0]); i++) {
+		for (uint32 j = 0; j < sizeof(depths)/sizeof(depths[0]); j++) {
+			if (!test_changed_tiles(widths[i], depths[j]))
+				n_tile_errors++;
+		}
+	}
+	printf("Incremental scanline update checked, %d errors\n", n_tile_errors);
+	n_errors += n_tile_errors;
+	return n_errors != 0;
+}
+#endif
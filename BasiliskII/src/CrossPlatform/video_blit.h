@@ -171,6 +171,20 @@ static void FB_FUNC_NAME(uint8 * dest, const uint8 * source, uint32 length)
 #undef DEREF_WORD_PTR
 }
 
+#ifdef USE_SIMD_BLITTERS
+// Vectorized variants apply the same blit to whole SSE2/AVX2 registers
+#if FB_DEPTH <= 16
+#define FB_BLIT_V FB_BLIT_1
+DEFINE_SIMD_BLITTER(FB_FUNC_NAME, SSE2, "sse2", blit_v8hu)
+DEFINE_SIMD_BLITTER(FB_FUNC_NAME, AVX2, "avx2", blit_v16hu)
+#else
+#define FB_BLIT_V FB_BLIT_2
+DEFINE_SIMD_BLITTER(FB_FUNC_NAME, SSE2, "sse2", blit_v4su)
+DEFINE_SIMD_BLITTER(FB_FUNC_NAME, AVX2, "avx2", blit_v8su)
+#endif
+#undef FB_BLIT_V
+#endif
+
 #undef FB_FUNC_NAME
 
 #ifdef FB_BLIT_1
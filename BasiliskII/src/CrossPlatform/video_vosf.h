@@ -82,6 +82,10 @@ struct ScreenPageInfo {
     unsigned top, bottom;		// Mapping between this virtual page and Mac scanlines
 };
 
+struct ScreenRowInfo {
+    uint32 src, dst;			// Offsets of a scanline to update in the_buffer and the_host_buffer
+};
+
 struct ScreenInfo {
     uintptr memStart;			// Start address aligned to page boundary
     uint32 memLength;			// Length of the memory addressed by the screen pages
@@ -92,8 +96,12 @@ struct ScreenInfo {
     
 	bool dirty;					// Flag: set if the frame buffer was touched
 	bool very_dirty;			// Flag: set if the frame buffer was completely modified (e.g. colormap changes)
+	bool write_watch;			// Flag: set if the host tracks writes, no page faults
     char * dirtyPages;			// Table of flags set if page was altered
     ScreenPageInfo * pageInfo;	// Table of mappings page -> Mac scanlines
+    ScreenPageInfo * runInfo;	// Table of scanline ranges to update, one per dirty page run
+    ScreenRowInfo * rowInfo;	// Table of scanlines to update, one per Mac scanline
+    uint8 * chunkInfo;			// Table of flags set if a 64-pixel chunk was changed (DGA)
 };
 
 static ScreenInfo mainBuffer;
@@ -212,6 +220,229 @@ static uint32 page_extend(uint32 size)
 	return (size + page_mask) & ~page_mask;
 }
 
+// Allocate frame buffer, have the host track writes to it if possible
+static inline void *vosf_acquire_buffer(uint32 size, int options = VM_MAP_DEFAULT)
+{
+	void *fb = vm_acquire(size, options | VM_MAP_WRITE_WATCH);
+	if (fb == VM_MAP_FAILED)
+		fb = vm_acquire(size, options);
+	return fb;
+}
+
+// Catch writes to pages [FIRST_PAGE, LAST_PAGE[ again. With write-watch,
+// pages are already write-protected when they are reported as dirty
+static int vosf_protect_pages(unsigned first_page, unsigned last_page)
+{
+	if (mainBuffer.write_watch)
+		return 0;
+	const uint32 offset = first_page << mainBuffer.pageBits;
+	const uint32 length = (last_page - first_page) << mainBuffer.pageBits;
+	return vm_protect((char *)mainBuffer.memStart + offset, length, VM_PAGE_READ);
+}
+
+// Collect the pages written to since last time in one go, in place of
+// Screen_fault_handler(). Returns TRUE if the frame buffer is dirty
+static bool video_vosf_dirty(void)
+{
+	if (!mainBuffer.write_watch)
+		return mainBuffer.dirty;
+
+	const int MAX_PAGES = 64;
+	void *pages[MAX_PAGES];
+	uintptr start = mainBuffer.memStart;
+	const uintptr end = mainBuffer.memStart + mainBuffer.memLength;
+	LOCK_VOSF;
+	while (start < end) {
+		unsigned int n_pages = MAX_PAGES;
+		if (vm_get_write_watch((void *)start, end - start, pages, &n_pages, VM_WRITE_WATCH_RESET) < 0) {
+			// Should not happen, redraw everything
+			PFLAG_SET_ALL;
+			break;
+		}
+		for (unsigned int i = 0; i < n_pages; i++)
+			PFLAG_SET(((uintptr)pages[i] - mainBuffer.memStart) >> mainBuffer.pageBits);
+		if (n_pages > 0)
+			mainBuffer.dirty = true;
+		if (n_pages < MAX_PAGES)
+			break;
+		start = (uintptr)pages[MAX_PAGES - 1] + mainBuffer.pageSize;
+	}
+	UNLOCK_VOSF;
+	return mainBuffer.dirty;
+}
+
+
+/*
+ *  Convert scanlines with a pool of threads
+ */
+
+// Parameters of the current conversion, shared with the blitter threads
+static struct {
+	uint32 src_bytes_per_row;
+	uint32 n_chunks, src_chunk_size, dst_chunk_size;
+	uint32 src_chunk_size_left, dst_chunk_size_left;
+} vosf_blit;
+
+// Process scanlines [FIRST_ROW, LAST_ROW[ of mainBuffer.rowInfo
+typedef void (*vosf_rows_func)(int first_row, int last_row);
+
+#ifdef HAVE_PTHREADS
+const int VOSF_MAX_THREADS = 8;
+const uint32 VOSF_PARALLEL_THRESHOLD = 64 * 1024;	// Don't wake up threads for less bytes
+
+static struct {
+	int n_threads;					// Number of threads, including the caller
+	pthread_t threads[VOSF_MAX_THREADS];
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;		// Signalled when a new job is posted
+	pthread_cond_t done_cond;		// Signalled when the last thread completed the job
+	uint32 generation;				// Job number
+	int pending;					// Number of threads still working on the job
+	bool quit;
+	vosf_rows_func func;
+	int n_rows;
+} vosf_pool;
+
+static void *vosf_blit_thread(void *arg)
+{
+	const int band = (int)(intptr)arg;
+	uint32 generation = 0;
+	pthread_mutex_lock(&vosf_pool.lock);
+	for (;;) {
+		while (!vosf_pool.quit && vosf_pool.generation == generation)
+			pthread_cond_wait(&vosf_pool.work_cond, &vosf_pool.lock);
+		if (vosf_pool.quit)
+			break;
+		generation = vosf_pool.generation;
+		const vosf_rows_func func = vosf_pool.func;
+		const int n_rows = vosf_pool.n_rows, n_threads = vosf_pool.n_threads;
+		pthread_mutex_unlock(&vosf_pool.lock);
+
+		func(n_rows * band / n_threads, n_rows * (band + 1) / n_threads);
+
+		pthread_mutex_lock(&vosf_pool.lock);
+		if (--vosf_pool.pending == 0)
+			pthread_cond_signal(&vosf_pool.done_cond);
+	}
+	pthread_mutex_unlock(&vosf_pool.lock);
+	return NULL;
+}
+
+static void vosf_start_threads(void)
+{
+	int n_threads = PrefsFindInt32("vosfthreads");
+	if (n_threads <= 0) {
+		n_threads = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+		n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (n_threads > 4)
+			n_threads = 4;
+#endif
+	}
+	if (n_threads > VOSF_MAX_THREADS)
+		n_threads = VOSF_MAX_THREADS;
+
+	vosf_pool.n_threads = 1;
+	vosf_pool.generation = 0;
+	vosf_pool.quit = false;
+	if (n_threads < 2)
+		return;
+	pthread_mutex_init(&vosf_pool.lock, NULL);
+	pthread_cond_init(&vosf_pool.work_cond, NULL);
+	pthread_cond_init(&vosf_pool.done_cond, NULL);
+	while (vosf_pool.n_threads < n_threads) {
+		if (pthread_create(&vosf_pool.threads[vosf_pool.n_threads], NULL, vosf_blit_thread, (void *)(intptr)vosf_pool.n_threads) != 0)
+			break;
+		vosf_pool.n_threads++;
+	}
+	D(bug("VOSF: converting frame buffer with %d threads\n", vosf_pool.n_threads));
+}
+
+static void vosf_stop_threads(void)
+{
+	if (vosf_pool.n_threads < 2)
+		return;
+	pthread_mutex_lock(&vosf_pool.lock);
+	vosf_pool.quit = true;
+	pthread_cond_broadcast(&vosf_pool.work_cond);
+	pthread_mutex_unlock(&vosf_pool.lock);
+	for (int i = 1; i < vosf_pool.n_threads; i++)
+		pthread_join(vosf_pool.threads[i], NULL);
+	pthread_cond_destroy(&vosf_pool.done_cond);
+	pthread_cond_destroy(&vosf_pool.work_cond);
+	pthread_mutex_destroy(&vosf_pool.lock);
+	vosf_pool.n_threads = 1;
+}
+#else
+static inline void vosf_start_threads(void) { }
+static inline void vosf_stop_threads(void) { }
+#endif
+
+// Split scanlines into bands of consecutive rows, one per thread
+static void vosf_process_rows(vosf_rows_func func, int n_rows)
+{
+#ifdef HAVE_PTHREADS
+	const int n_threads = vosf_pool.n_threads;
+	if (n_threads > 1 && n_rows >= n_threads && n_rows * vosf_blit.src_bytes_per_row >= VOSF_PARALLEL_THRESHOLD) {
+		pthread_mutex_lock(&vosf_pool.lock);
+		vosf_pool.func = func;
+		vosf_pool.n_rows = n_rows;
+		vosf_pool.pending = n_threads - 1;
+		vosf_pool.generation++;
+		pthread_cond_broadcast(&vosf_pool.work_cond);
+		pthread_mutex_unlock(&vosf_pool.lock);
+
+		func(0, n_rows / n_threads);
+
+		pthread_mutex_lock(&vosf_pool.lock);
+		while (vosf_pool.pending > 0)
+			pthread_cond_wait(&vosf_pool.done_cond, &vosf_pool.lock);
+		pthread_mutex_unlock(&vosf_pool.lock);
+		return;
+	}
+#endif
+	func(0, n_rows);
+}
+
+// Convert whole scanlines
+static void vosf_blit_rows(int first_row, int last_row)
+{
+	const ScreenRowInfo *row = mainBuffer.rowInfo;
+	for (int j = first_row; j < last_row; j++)
+		Screen_blit(the_host_buffer + row[j].dst, the_buffer + row[j].src, vosf_blit.src_bytes_per_row);
+}
+
+// Convert 64-pixel chunks that changed since the last update (DGA)
+static void vosf_blit_chunks(int first_row, int last_row)
+{
+	const ScreenRowInfo *row = mainBuffer.rowInfo;
+	const uint32 n_chunks = vosf_blit.n_chunks;
+	const uint32 src_chunk_size = vosf_blit.src_chunk_size;
+	const uint32 dst_chunk_size = vosf_blit.dst_chunk_size;
+	const uint32 src_chunk_size_left = vosf_blit.src_chunk_size_left;
+	const uint32 dst_chunk_size_left = vosf_blit.dst_chunk_size_left;
+	for (int j = first_row; j < last_row; j++) {
+		uint8 *changed = mainBuffer.chunkInfo + j * (n_chunks + 1);
+		uint32 i1 = row[j].src;
+		uint32 i2 = row[j].dst;
+		for (uint32 i = 0; i < n_chunks; i++) {
+			changed[i] = memcmp(the_buffer_copy + i1, the_buffer + i1, src_chunk_size) != 0;
+			if (changed[i]) {
+				memcpy(the_buffer_copy + i1, the_buffer + i1, src_chunk_size);
+				Screen_blit(the_host_buffer + i2, the_buffer + i1, src_chunk_size);
+			}
+			i1 += src_chunk_size;
+			i2 += dst_chunk_size;
+		}
+		if (src_chunk_size_left && dst_chunk_size_left) {
+			if (memcmp(the_buffer_copy + i1, the_buffer + i1, src_chunk_size_left) != 0) {
+				memcpy(the_buffer_copy + i1, the_buffer + i1, src_chunk_size_left);
+				Screen_blit(the_host_buffer + i2, the_buffer + i1, src_chunk_size_left);
+			}
+		}
+	}
+}
+
 
 /*
  *  Check if VOSF acceleration is profitable on this platform
@@ -248,7 +479,9 @@ static bool video_vosf_profitable(uint32 *duration_p = NULL, uint32 *n_page_faul
 
 		PFLAG_CLEAR_ALL;
 		mainBuffer.dirty = false;
-		if (vm_protect((char *)mainBuffer.memStart, mainBuffer.memLength, VM_PAGE_READ) != 0)
+		if (mainBuffer.write_watch)
+			vm_reset_write_watch((char *)mainBuffer.memStart, mainBuffer.memLength);
+		else if (vm_protect((char *)mainBuffer.memStart, mainBuffer.memLength, VM_PAGE_READ) != 0)
 			return false;
 	}
 
@@ -316,9 +549,21 @@ static bool video_vosf_init(MONITOR_INIT)
 		if (a > mainBuffer.memLength)
 			a = mainBuffer.memLength;
 	}
+
+	// Allocate tables of scanlines to update, they are converted in parallel
+	const uint32 n_chunks = VIDEO_MODE_X / 64;
+	mainBuffer.runInfo = (ScreenPageInfo *) malloc(mainBuffer.pageCount * sizeof(ScreenPageInfo));
+	mainBuffer.rowInfo = (ScreenRowInfo *) malloc(VIDEO_MODE_Y * sizeof(ScreenRowInfo));
+	mainBuffer.chunkInfo = (uint8 *) malloc(VIDEO_MODE_Y * (n_chunks + 1));
+	if (mainBuffer.runInfo == NULL || mainBuffer.rowInfo == NULL || mainBuffer.chunkInfo == NULL)
+		return false;
+	vosf_start_threads();
 	
-	// We can now write-protect the frame buffer
-	if (vm_protect((char *)mainBuffer.memStart, mainBuffer.memLength, VM_PAGE_READ) != 0)
+	// We can now write-protect the frame buffer, or simply track writes
+	// to it if it was allocated with VM_MAP_WRITE_WATCH
+	mainBuffer.write_watch = vm_reset_write_watch((char *)mainBuffer.memStart, mainBuffer.memLength) == 0;
+	D(bug("VOSF: %s\n", mainBuffer.write_watch ? "tracking writes to frame buffer" : "using page faults"));
+	if (!mainBuffer.write_watch && vm_protect((char *)mainBuffer.memStart, mainBuffer.memLength, VM_PAGE_READ) != 0)
 		return false;
 	
 	// The frame buffer is sane, i.e. there is no write to it yet
@@ -333,6 +578,19 @@ static bool video_vosf_init(MONITOR_INIT)
 
 static void video_vosf_exit(void)
 {
+	vosf_stop_threads();
+	if (mainBuffer.chunkInfo) {
+		free(mainBuffer.chunkInfo);
+		mainBuffer.chunkInfo = NULL;
+	}
+	if (mainBuffer.rowInfo) {
+		free(mainBuffer.rowInfo);
+		mainBuffer.rowInfo = NULL;
+	}
+	if (mainBuffer.runInfo) {
+		free(mainBuffer.runInfo);
+		mainBuffer.runInfo = NULL;
+	}
 	if (mainBuffer.pageInfo) {
 		free(mainBuffer.pageInfo);
 		mainBuffer.pageInfo = NULL;
@@ -356,7 +614,8 @@ static void vosf_do_set_dirty_area(uintptr first, uintptr last)
 	for (int i = first_page; i <= last_page; i++) {
 		if (PFLAG_ISCLEAR(i)) {
 			PFLAG_SET(i);
-			vm_protect(addr, mainBuffer.pageSize, VM_PAGE_READ | VM_PAGE_WRITE);
+			if (!mainBuffer.write_watch)
+				vm_protect(addr, mainBuffer.pageSize, VM_PAGE_READ | VM_PAGE_WRITE);
 		}
 		addr += mainBuffer.pageSize;
 	}
@@ -482,6 +741,12 @@ static void update_display_window_vosf(VIDEO_DRV_WIN_INIT)
 {
 	VIDEO_MODE_INIT;
 
+	// Collect the scanlines to update, don't process overlapping lines twice
+	const int src_bytes_per_row = VIDEO_MODE_ROW_BYTES;
+	const int dst_bytes_per_row = VIDEO_DRV_ROW_BYTES;
+	ScreenPageInfo * const runs = mainBuffer.runInfo;
+	ScreenRowInfo * const rows = mainBuffer.rowInfo;
+	int n_runs = 0, n_rows = 0, last_scanline = -1;
 	unsigned page = 0;
 	for (;;) {
 		const unsigned first_page = find_next_page_set(page);
@@ -492,27 +757,34 @@ static void update_display_window_vosf(VIDEO_DRV_WIN_INIT)
 		PFLAG_CLEAR_RANGE(first_page, page);
 
 		// Make the dirty pages read-only again
-		const int32 offset  = first_page << mainBuffer.pageBits;
-		const uint32 length = (page - first_page) << mainBuffer.pageBits;
-		vm_protect((char *)mainBuffer.memStart + offset, length, VM_PAGE_READ);
+		vosf_protect_pages(first_page, page);
 		
 		// There is at least one line to update
 		const int y1 = mainBuffer.pageInfo[first_page].top;
 		const int y2 = mainBuffer.pageInfo[page - 1].bottom;
-		const int height = y2 - y1 + 1;
+		runs[n_runs].top = y1;
+		runs[n_runs].bottom = y2;
+		n_runs++;
+		for (int j = (y1 > last_scanline ? y1 : last_scanline + 1); j <= y2; j++) {
+			rows[n_rows].src = j * src_bytes_per_row;
+			rows[n_rows].dst = j * dst_bytes_per_row;
+			n_rows++;
+		}
+		if (y2 > last_scanline)
+			last_scanline = y2;
+	}
 
-		// Update the_host_buffer
+	// Update the_host_buffer
+	if (n_rows > 0) {
 		VIDEO_DRV_LOCK_PIXELS;
-		const int src_bytes_per_row = VIDEO_MODE_ROW_BYTES;
-		const int dst_bytes_per_row = VIDEO_DRV_ROW_BYTES;
-		int i1 = y1 * src_bytes_per_row, i2 = y1 * dst_bytes_per_row, j;
-		for (j = y1; j <= y2; j++) {
-			Screen_blit(the_host_buffer + i2, the_buffer + i1, src_bytes_per_row);
-			i1 += src_bytes_per_row;
-			i2 += dst_bytes_per_row;
-		}
+		vosf_blit.src_bytes_per_row = src_bytes_per_row;
+		vosf_process_rows(vosf_blit_rows, n_rows);
 		VIDEO_DRV_UNLOCK_PIXELS;
+	}
 
+	for (int i = 0; i < n_runs; i++) {
+		const int y1 = runs[i].top;
+		const int height = runs[i].bottom - y1 + 1;
 #ifdef USE_SDL_VIDEO
 		SDL_UpdateRect(drv->s, 0, y1, VIDEO_MODE_X, height);
 #else
@@ -544,19 +816,21 @@ static void update_display_dga_vosf(VIDEO_DRV_DGA_INIT)
 	const int scr_bytes_per_row = VIDEO_DRV_ROW_BYTES;
 	assert(dst_bytes_per_row <= scr_bytes_per_row);
 	const int scr_bytes_left = scr_bytes_per_row - dst_bytes_per_row;
+	ScreenPageInfo * const runs = mainBuffer.runInfo;
+	ScreenRowInfo * const rows = mainBuffer.rowInfo;
 
 	// Full screen update requested?
 	if (mainBuffer.very_dirty) {
 		PFLAG_CLEAR_ALL;
-		vm_protect((char *)mainBuffer.memStart, mainBuffer.memLength, VM_PAGE_READ);
+		vosf_protect_pages(0, mainBuffer.pageCount);
 		memcpy(the_buffer_copy, the_buffer, VIDEO_MODE_ROW_BYTES * VIDEO_MODE_Y);
-		VIDEO_DRV_LOCK_PIXELS;
-		int i1 = 0, i2 = 0;
-		for (uint32_t j = 0;  j < VIDEO_MODE_Y; j++) {
-			Screen_blit(the_host_buffer + i2, the_buffer + i1, src_bytes_per_row);
-			i1 += src_bytes_per_row;
-			i2 += scr_bytes_per_row;
+		for (uint32 j = 0; j < VIDEO_MODE_Y; j++) {
+			rows[j].src = j * src_bytes_per_row;
+			rows[j].dst = j * scr_bytes_per_row;
 		}
+		VIDEO_DRV_LOCK_PIXELS;
+		vosf_blit.src_bytes_per_row = src_bytes_per_row;
+		vosf_process_rows(vosf_blit_rows, VIDEO_MODE_Y);
 #ifdef USE_SDL_VIDEO
 		SDL_UpdateRect(drv->s, 0, 0, VIDEO_MODE_X, VIDEO_MODE_Y);
 #endif
@@ -572,7 +846,12 @@ static void update_display_dga_vosf(VIDEO_DRV_DGA_INIT)
 	const uint32 dst_chunk_size = dst_bytes_per_row / n_chunks;
 	const uint32 src_chunk_size_left = src_bytes_per_row - (n_chunks * src_chunk_size);
 	const uint32 dst_chunk_size_left = dst_bytes_per_row - (n_chunks * dst_chunk_size);
+	const bool chunk_left = src_chunk_size_left && dst_chunk_size_left;
+	const uint32 src_row_size = n_chunks * src_chunk_size + (chunk_left ? src_chunk_size_left : 0);
+	const uint32 dst_row_size = n_chunks * dst_chunk_size + (chunk_left ? dst_chunk_size_left : 0) + scr_bytes_left;
 
+	// Collect the scanlines to update
+	int n_runs = 0, n_rows = 0;
 	unsigned page = 0;
 	uint32 last_scanline = uint32(-1);
 	for (;;) {
@@ -584,9 +863,7 @@ static void update_display_dga_vosf(VIDEO_DRV_DGA_INIT)
 		PFLAG_CLEAR_RANGE(first_page, page);
 
 		// Make the dirty pages read-only again
-		const int32 offset  = first_page << mainBuffer.pageBits;
-		const uint32 length = (page - first_page) << mainBuffer.pageBits;
-		vm_protect((char *)mainBuffer.memStart + offset, length, VM_PAGE_READ);
+		vosf_protect_pages(first_page, page);
 
 		// Optimized for scanlines, don't process overlapping lines again
 		uint32 y1 = mainBuffer.pageInfo[first_page].top;
@@ -599,24 +876,48 @@ static void update_display_dga_vosf(VIDEO_DRV_DGA_INIT)
 		}
 		last_scanline = y2;
 
-		// Update the_host_buffer and copy of the_buffer, one line at a time
+		runs[n_runs].top = y1;
+		runs[n_runs].bottom = y2;
+		n_runs++;
 		uint32 i1 = y1 * src_bytes_per_row;
 		uint32 i2 = y1 * scr_bytes_per_row;
+		for (uint32 j = y1; j <= y2; j++) {
+			rows[n_rows].src = i1;
+			rows[n_rows].dst = i2;
+			n_rows++;
+			i1 += src_row_size;
+			i2 += dst_row_size;
+		}
+	}
+	if (n_rows == 0) {
+		mainBuffer.dirty = false;
+		return;
+	}
+
+	// Update the_host_buffer and copy of the_buffer
+	VIDEO_DRV_LOCK_PIXELS;
+	vosf_blit.src_bytes_per_row = src_bytes_per_row;
+	vosf_blit.n_chunks = n_chunks;
+	vosf_blit.src_chunk_size = src_chunk_size;
+	vosf_blit.dst_chunk_size = dst_chunk_size;
+	vosf_blit.src_chunk_size_left = src_chunk_size_left;
+	vosf_blit.dst_chunk_size_left = dst_chunk_size_left;
+	vosf_process_rows(vosf_blit_chunks, n_rows);
 #ifdef USE_SDL_VIDEO
+	// Compute up to 3 bounding boxes of changed chunks per run
+	const uint8 *changed = mainBuffer.chunkInfo;
+	for (int r = 0; r < n_runs; r++) {
+		const uint32 y1 = runs[r].top;
+		const uint32 y2 = runs[r].bottom;
 		int bbi = 0;
 		SDL_Rect bb[3] = {
 			{ Sint16(VIDEO_MODE_X), Sint16(y1), 0, 0 },
 			{ Sint16(VIDEO_MODE_X), -1, 0, 0 },
 			{ Sint16(VIDEO_MODE_X), -1, 0, 0 }
 		};
-#endif
-		VIDEO_DRV_LOCK_PIXELS;
 		for (uint32 j = y1; j <= y2; j++) {
 			for (uint32 i = 0; i < n_chunks; i++) {
-				if (memcmp(the_buffer_copy + i1, the_buffer + i1, src_chunk_size) != 0) {
-					memcpy(the_buffer_copy + i1, the_buffer + i1, src_chunk_size);
-					Screen_blit(the_host_buffer + i2, the_buffer + i1, src_chunk_size);
-#ifdef USE_SDL_VIDEO
+				if (changed[i]) {
 					const int x = i * n_pixels;
 					if (x < bb[bbi].x) {
 						if (bb[bbi].w)
@@ -627,19 +928,9 @@ static void update_display_dga_vosf(VIDEO_DRV_DGA_INIT)
 					}
 					else if (x >= bb[bbi].x + bb[bbi].w)
 						bb[bbi].w = x + n_pixels - bb[bbi].x;
-#endif
 				}
-				i1 += src_chunk_size;
-				i2 += dst_chunk_size;
 			}
-			if (src_chunk_size_left && dst_chunk_size_left) {
-				if (memcmp(the_buffer_copy + i1, the_buffer + i1, src_chunk_size_left) != 0) {
-					memcpy(the_buffer_copy + i1, the_buffer + i1, src_chunk_size_left);
-					Screen_blit(the_host_buffer + i2, the_buffer + i1, src_chunk_size_left);
-				}
-				i1 += src_chunk_size_left;
-				i2 += dst_chunk_size_left;
-#ifdef USE_SDL_VIDEO
+			if (chunk_left) {
 				const int x = n_chunks * n_pixels;
 				if (x < bb[bbi].x) {
 					if (bb[bbi].w)
@@ -650,10 +941,8 @@ static void update_display_dga_vosf(VIDEO_DRV_DGA_INIT)
 				}
 				else if (x >= bb[bbi].x + bb[bbi].w)
 					bb[bbi].w  = x + n_pixels_left - bb[bbi].x;
-#endif
 			}
-			i2 += scr_bytes_left;
-#ifdef USE_SDL_VIDEO
+			changed += n_chunks + 1;
 			bb[bbi].h++;
 			if (bb[bbi].w && (j == y1 || j == y2 - 1 || j == y2)) {
 				bbi++;
@@ -661,13 +950,11 @@ static void update_display_dga_vosf(VIDEO_DRV_DGA_INIT)
 				if (j != y2)
 					bb[bbi].y = j + 1;
 			}
-#endif
 		}
-#ifdef USE_SDL_VIDEO
 		SDL_UpdateRects(drv->s, bbi, bb);
-#endif
-		VIDEO_DRV_UNLOCK_PIXELS;
 	}
+#endif
+	VIDEO_DRV_UNLOCK_PIXELS;
 	mainBuffer.dirty = false;
 }
 #endif
@@ -109,6 +109,57 @@ static int zero_fd	= -1;
 #endif
 #endif
 
+/* Linux tracks writes to memory registered to userfaultfd in
+   asynchronous write-protect mode, and PAGEMAP_SCAN retrieves and
+   write-protects again the modified pages in one go (Linux 6.7+).
+   Kernel headers may not know about them yet, the ABI is stable.  */
+#if defined(HAVE_MMAP_VM) && defined(HAVE_LINUX_USERFAULTFD_H)
+#define HAVE_LINUX_WRITE_WATCH 1
+#define HAVE_VM_WRITE_WATCH 1
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/types.h>
+#include <linux/fs.h>
+#include <linux/userfaultfd.h>
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY		1
+#endif
+#ifndef UFFD_FEATURE_WP_UNPOPULATED
+#define UFFD_FEATURE_WP_UNPOPULATED	(1 << 13)
+#endif
+#ifndef UFFD_FEATURE_WP_ASYNC
+#define UFFD_FEATURE_WP_ASYNC	(1 << 15)
+#endif
+#ifndef PAGEMAP_SCAN
+#define PAGE_IS_WRITTEN			(1 << 3)
+#define PM_SCAN_WP_MATCHING		(1 << 0)
+#define PM_SCAN_CHECK_WPASYNC	(1 << 1)
+struct page_region {
+	__u64 start;
+	__u64 end;
+	__u64 categories;
+};
+struct pm_scan_arg {
+	__u64 size;
+	__u64 flags;
+	__u64 start;
+	__u64 end;
+	__u64 walk_end;
+	__u64 vec;
+	__u64 vec_len;
+	__u64 max_pages;
+	__u64 category_inverted;
+	__u64 category_mask;
+	__u64 category_anyof_mask;
+	__u64 return_mask;
+};
+#define PAGEMAP_SCAN			_IOWR('f', 16, struct pm_scan_arg)
+#endif
+static int write_watch_fd = -1;		// userfaultfd handling write-protect faults
+static int pagemap_fd = -1;			// /proc/self/pagemap, to scan written pages
+#endif
+
 /* Translate generic VM map flags to host values.  */
 
 #ifdef HAVE_MMAP_VM
@@ -127,6 +178,105 @@ static int translate_map_flags(int vm_flags)
 }
 #endif
 
+/* Set up write tracking of [ ADDR, ADDR + SIZE [, pages are reported
+   as modified once written to. Returns 0 if successful, -1 if the
+   kernel cannot do it, e.g. it is too old or userfaultfd is disabled.  */
+
+#ifdef HAVE_LINUX_WRITE_WATCH
+static int vm_register_write_watch_fd(void * addr, size_t size)
+{
+	struct uffdio_register reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.range.start = (vm_uintptr_t)addr;
+	reg.range.len = size;
+	reg.mode = UFFDIO_REGISTER_MODE_WP;
+	if (ioctl(write_watch_fd, UFFDIO_REGISTER, &reg) < 0)
+		return -1;
+	return vm_reset_write_watch(addr, size);
+}
+
+// Some kernels accept the setup but don't track writes to pages that
+// are already mapped in, so check both first and later writes
+static bool vm_check_write_watch(void)
+{
+	const size_t page_size = getpagesize();
+	const size_t size = 2 * page_size;
+	char * area = (char *)mmap(NULL, size, VM_PAGE_DEFAULT, map_flags | MAP_PRIVATE, zero_fd, 0);
+	if (area == (char *)MAP_FAILED)
+		return false;
+
+	bool ok = vm_register_write_watch_fd(area, size) == 0;
+	void * pages[2];
+	unsigned int n_pages;
+	for (int i = 0; ok && i < 2; i++) {
+		area[page_size] = i + 1;
+		n_pages = 2;
+		ok = vm_get_write_watch(area, size, pages, &n_pages, VM_WRITE_WATCH_RESET) == 0
+			&& n_pages == 1 && pages[0] == area + page_size;
+	}
+	if (ok) {
+		n_pages = 2;
+		ok = vm_get_write_watch(area, size, pages, &n_pages) == 0 && n_pages == 0;
+	}
+
+	munmap((caddr_t)area, size);
+	return ok;
+}
+
+static int vm_init_write_watch(void)
+{
+	static bool failed = false;
+	if (write_watch_fd >= 0)
+		return 0;
+	if (failed)
+		return -1;
+	failed = true;
+
+	// Only faults from user mode are needed, which is allowed to
+	// unprivileged processes even with vm.unprivileged_userfaultfd=0
+	int fd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+	if (fd < 0)
+		fd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+	if (fd < 0)
+		return -1;
+
+	// Writes are resolved by the kernel itself, no fault handler thread
+	struct uffdio_api api;
+	memset(&api, 0, sizeof(api));
+	api.api = UFFD_API;
+	api.features = UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED;
+	if (ioctl(fd, UFFDIO_API, &api) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	pagemap_fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+	if (pagemap_fd < 0) {
+		close(fd);
+		return -1;
+	}
+
+	write_watch_fd = fd;
+	if (!vm_check_write_watch()) {
+		close(write_watch_fd);
+		write_watch_fd = -1;
+		close(pagemap_fd);
+		pagemap_fd = -1;
+		return -1;
+	}
+
+	failed = false;
+	return 0;
+}
+
+static int vm_register_write_watch(void * addr, size_t size)
+{
+	if (vm_init_write_watch() < 0)
+		return -1;
+	return vm_register_write_watch_fd(addr, size);
+}
+#endif
+
 /* Align ADDR and SIZE to 64K boundaries.  */
 
 #ifdef HAVE_WIN32_VM
@@ -220,6 +370,16 @@ void vm_exit(void)
 	}
 #endif
 #endif
+#ifdef HAVE_LINUX_WRITE_WATCH
+	if (write_watch_fd != -1) {
+		close(write_watch_fd);
+		write_watch_fd = -1;
+	}
+	if (pagemap_fd != -1) {
+		close(pagemap_fd);
+		pagemap_fd = -1;
+	}
+#endif
 }
 
 /* Allocate zero-filled memory of SIZE bytes. The mapping is private
@@ -279,6 +439,13 @@ void * vm_acquire(size_t size, int options)
 	// say MacOS X, mmap() doesn't honour the requested protection flags.
 	if (vm_protect(addr, size, VM_PAGE_DEFAULT) != 0)
 		return VM_MAP_FAILED;
+
+#ifdef HAVE_LINUX_WRITE_WATCH
+	if ((options & VM_MAP_WRITE_WATCH) && vm_register_write_watch(addr, size) < 0) {
+		munmap((caddr_t)addr, size);
+		return VM_MAP_FAILED;
+	}
+#endif
 	
 	return addr;
 }
@@ -337,7 +504,60 @@ int vm_acquire_fixed(void * addr, size_t size, int options)
 	if (vm_protect(addr, size, VM_PAGE_DEFAULT) != 0)
 		return -1;
 
+#ifdef HAVE_LINUX_WRITE_WATCH
+	if ((options & VM_MAP_WRITE_WATCH) && vm_register_write_watch(addr, size) < 0) {
+		munmap((caddr_t)addr, size);
+		return -1;
+	}
+#endif
+
+	return 0;
+}
+
+/* Allocate zero-filled memory at ADDR (which must be page-aligned),
+   but only if that region is not mapped yet. Returns 0 if successful,
+   -1 on errors.  */
+
+int vm_acquire_at(void * addr, size_t size, int options)
+{
+	errno = 0;
+
+	// Fixed mappings are required to be private
+	if (options & VM_MAP_SHARED)
+		return -1;
+
+#if defined(HAVE_MMAP_VM)
+#ifndef HAVE_VM_WRITE_WATCH
+	if (options & VM_MAP_WRITE_WATCH)
+		return -1;
+#endif
+
+	// Pass ADDR as a hint, the kernel picks another address if it is busy
+	int fd = zero_fd;
+	int the_map_flags = translate_map_flags(options) | map_flags;
+	void * ret_addr = mmap((caddr_t)addr, size, VM_PAGE_DEFAULT, the_map_flags, fd, 0);
+	if (ret_addr == (void *)MAP_FAILED)
+		return -1;
+	if (ret_addr != addr) {
+		munmap((caddr_t)ret_addr, size);
+		return -1;
+	}
+
+	if (vm_protect(addr, size, VM_PAGE_DEFAULT) != 0) {
+		munmap((caddr_t)addr, size);
+		return -1;
+	}
+#ifdef HAVE_LINUX_WRITE_WATCH
+	if ((options & VM_MAP_WRITE_WATCH) && vm_register_write_watch(addr, size) < 0) {
+		munmap((caddr_t)addr, size);
+		return -1;
+	}
+#endif
 	return 0;
+#else
+	// Other allocators already fail on busy regions
+	return vm_acquire_fixed(addr, size, options);
+#endif
 }
 
 /* Deallocate any mapping for the region starting at ADDR and extending
@@ -417,6 +637,40 @@ int vm_get_write_watch(void * addr, size_t size,
 	*n_pages = count;
 	return 0;
 #endif
+#ifdef HAVE_LINUX_WRITE_WATCH
+	const vm_uintptr_t page_size = getpagesize();
+	const int MAX_REGIONS = 32;
+	struct page_region regions[MAX_REGIONS];
+
+	// Written pages are write-protected again as they are reported
+	struct pm_scan_arg arg;
+	memset(&arg, 0, sizeof(arg));
+	arg.size = sizeof(arg);
+	if (options & VM_WRITE_WATCH_RESET)
+		arg.flags = PM_SCAN_WP_MATCHING | PM_SCAN_CHECK_WPASYNC;
+	arg.start = (vm_uintptr_t)addr;
+	arg.end = (vm_uintptr_t)addr + size;
+	arg.vec = (vm_uintptr_t)regions;
+	arg.vec_len = MAX_REGIONS;
+	arg.category_mask = PAGE_IS_WRITTEN;
+	arg.return_mask = PAGE_IS_WRITTEN;
+
+	unsigned int count = 0;
+	while (arg.start < arg.end && count < *n_pages) {
+		arg.max_pages = *n_pages - count;
+		int n_regions = ioctl(pagemap_fd, PAGEMAP_SCAN, &arg);
+		if (n_regions < 0)
+			return -1;
+		for (int i = 0; i < n_regions; i++) {
+			for (vm_uintptr_t p = regions[i].start; p < regions[i].end; p += page_size)
+				pages[count++] = (void *)p;
+		}
+		arg.start = arg.walk_end;
+	}
+
+	*n_pages = count;
+	return 0;
+#endif
 #endif
 	// Unsupported
 	return -1;
@@ -432,6 +686,15 @@ int vm_reset_write_watch(void * addr, size_t size)
 	int ret_code = ResetWriteWatch(addr, size);
 	return ret_code == 0 ? 0 : -1;
 #endif
+#ifdef HAVE_LINUX_WRITE_WATCH
+	struct uffdio_writeprotect wp;
+	memset(&wp, 0, sizeof(wp));
+	wp.range.start = (vm_uintptr_t)addr;
+	wp.range.len = size;
+	wp.mode = UFFDIO_WRITEPROTECT_MODE_WP;
+	int ret_code = ioctl(write_watch_fd, UFFDIO_WRITEPROTECT, &wp);
+	return ret_code == 0 ? 0 : -1;
+#endif
 #endif
 	// Unsupported
 	return -1;
@@ -104,6 +104,13 @@ extern void * vm_acquire(size_t size, int options = VM_MAP_DEFAULT);
 
 extern int vm_acquire_fixed(void * addr, size_t size, int options = VM_MAP_DEFAULT);
 
+/* Allocate zero-filled memory at ADDR (which must be page-aligned),
+   but only if that region is not mapped yet. Unlike vm_acquire_fixed(),
+   existing mappings are never replaced. Returns 0 if successful, -1 if
+   the region is busy or on errors.  */
+
+extern int vm_acquire_at(void * addr, size_t size, int options = VM_MAP_DEFAULT);
+
 /* Deallocate any mapping for the region starting at ADDR and extending
    LEN bytes. Returns 0 if successful, -1 on errors.  */
 
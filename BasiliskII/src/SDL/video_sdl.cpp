@@ -61,6 +61,7 @@
 #include "video.h"
 #include "video_defs.h"
 #include "video_blit.h"
+#include "video_sdl_tiles.h"
 #include "vm_alloc.h"
 
 #define DEBUG 0
@@ -200,15 +201,20 @@ static void *vm_acquire_framebuffer(uint32 size)
 	// always try to reallocate framebuffer at the same address
 	static void *fb = VM_MAP_FAILED;
 	if (fb != VM_MAP_FAILED) {
-		if (vm_acquire_fixed(fb, size) < 0) {
+		if (vm_acquire_fixed(fb, size, VM_MAP_DEFAULT | VM_MAP_WRITE_WATCH) < 0 &&
+			vm_acquire_fixed(fb, size) < 0) {
 #ifndef SHEEPSHAVER
 			printf("FATAL: Could not reallocate framebuffer at previous address\n");
 #endif
 			fb = VM_MAP_FAILED;
 		}
 	}
-	if (fb == VM_MAP_FAILED)
-		fb = vm_acquire(size, VM_MAP_DEFAULT | VM_MAP_32BIT);
+	if (fb == VM_MAP_FAILED) {
+		// let the host track writes to the frame buffer if it can
+		fb = vm_acquire(size, VM_MAP_DEFAULT | VM_MAP_32BIT | VM_MAP_WRITE_WATCH);
+		if (fb == VM_MAP_FAILED)
+			fb = vm_acquire(size, VM_MAP_DEFAULT | VM_MAP_32BIT);
+	}
 	return fb;
 }
 
@@ -1845,202 +1851,77 @@ static void handle_events(void)
  *  Window display update
  */
 
-// Static display update (fixed frame rate, but incremental)
+// Static display update (fixed frame rate, incremental on a grid of tiles)
 static void update_display_static(driver_base *drv)
 {
-	// Incremental update code
-	int wide = 0, high = 0;
-	uint32 x1, x2, y1, y2;
 	const VIDEO_MODE &mode = drv->mode;
-	int bytes_per_row = VIDEO_MODE_ROW_BYTES;
-	uint8 *p, *p2;
-
-	// Check for first line from top and first line from bottom that have changed
-	y1 = 0;
-	for (uint32 j = 0; j < VIDEO_MODE_Y; j++) {
-		if (memcmp(&the_buffer[j * bytes_per_row], &the_buffer_copy[j * bytes_per_row], bytes_per_row)) {
-			y1 = j;
-			break;
-		}
-	}
-	y2 = y1 - 1;
-	for (uint32 j = VIDEO_MODE_Y; j-- > y1; ) {
-		if (memcmp(&the_buffer[j * bytes_per_row], &the_buffer_copy[j * bytes_per_row], bytes_per_row)) {
-			y2 = j;
-			break;
-		}
-	}
-	high = y2 - y1 + 1;
-
-	// Check for first column from left and first column from right that have changed
-	if (high) {
-		if (VIDEO_MODE_DEPTH < VIDEO_DEPTH_8BIT) {
-			const int src_bytes_per_row = bytes_per_row;
-			const int dst_bytes_per_row = drv->s->pitch;
-			const int pixels_per_byte = VIDEO_MODE_X / src_bytes_per_row;
-
-			x1 = VIDEO_MODE_X / pixels_per_byte;
-			for (uint32 j = y1; j <= y2; j++) {
-				p = &the_buffer[j * bytes_per_row];
-				p2 = &the_buffer_copy[j * bytes_per_row];
-				for (uint32 i = 0; i < x1; i++) {
-					if (*p != *p2) {
-						x1 = i;
-						break;
-					}
-					p++; p2++;
-				}
-			}
-			x2 = x1;
-			for (uint32 j = y1; j <= y2; j++) {
-				p = &the_buffer[j * bytes_per_row];
-				p2 = &the_buffer_copy[j * bytes_per_row];
-				p += bytes_per_row;
-				p2 += bytes_per_row;
-				for (uint32 i = (VIDEO_MODE_X / pixels_per_byte); i > x2; i--) {
-					p--; p2--;
-					if (*p != *p2) {
-						x2 = i;
-						break;
-					}
-				}
-			}
-			x1 *= pixels_per_byte;
-			x2 *= pixels_per_byte;
-			wide = (x2 - x1 + pixels_per_byte - 1) & -pixels_per_byte;
-
-			// Update copy of the_buffer
-			if (high && wide) {
-
-				// Lock surface, if required
-				if (SDL_MUSTLOCK(drv->s))
-					SDL_LockSurface(drv->s);
-
-				// Blit to screen surface
-				int si = y1 * src_bytes_per_row + (x1 / pixels_per_byte);
-				int di = y1 * dst_bytes_per_row + x1;
-				for (uint32 j = y1; j <= y2; j++) {
-					memcpy(the_buffer_copy + si, the_buffer + si, wide / pixels_per_byte);
-					Screen_blit((uint8 *)drv->s->pixels + di, the_buffer + si, wide / pixels_per_byte);
-					si += src_bytes_per_row;
-					di += dst_bytes_per_row;
-				}
-
-				// Unlock surface, if required
-				if (SDL_MUSTLOCK(drv->s))
-					SDL_UnlockSurface(drv->s);
-
-				// Refresh display
-				SDL_UpdateRect(drv->s, x1, y1, wide, high);
-			}
-
-		} else {
-			const int bytes_per_pixel = VIDEO_MODE_ROW_BYTES / VIDEO_MODE_X;
-			const int dst_bytes_per_row = drv->s->pitch;
-
-			x1 = VIDEO_MODE_X;
-			for (uint32 j = y1; j <= y2; j++) {
-				p = &the_buffer[j * bytes_per_row];
-				p2 = &the_buffer_copy[j * bytes_per_row];
-				for (uint32 i = 0; i < x1 * bytes_per_pixel; i++) {
-					if (*p != *p2) {
-						x1 = i / bytes_per_pixel;
-						break;
-					}
-					p++; p2++;
-				}
-			}
-			x2 = x1;
-			for (uint32 j = y1; j <= y2; j++) {
-				p = &the_buffer[j * bytes_per_row];
-				p2 = &the_buffer_copy[j * bytes_per_row];
-				p += bytes_per_row;
-				p2 += bytes_per_row;
-				for (uint32 i = VIDEO_MODE_X * bytes_per_pixel; i > x2 * bytes_per_pixel; i--) {
-					p--;
-					p2--;
-					if (*p != *p2) {
-						x2 = i / bytes_per_pixel;
-						break;
-					}
-				}
-			}
-			wide = x2 - x1;
-
-			// Update copy of the_buffer
-			if (high && wide) {
-
-				// Lock surface, if required
-				if (SDL_MUSTLOCK(drv->s))
-					SDL_LockSurface(drv->s);
-
-				// Blit to screen surface
-				for (uint32 j = y1; j <= y2; j++) {
-					uint32 i = j * bytes_per_row + x1 * bytes_per_pixel;
-					int dst_i = j * dst_bytes_per_row + x1 * bytes_per_pixel;
-					memcpy(the_buffer_copy + i, the_buffer + i, bytes_per_pixel * wide);
-					Screen_blit((uint8 *)drv->s->pixels + dst_i, the_buffer + i, bytes_per_pixel * wide);
-				}
-
-				// Unlock surface, if required
-				if (SDL_MUSTLOCK(drv->s))
-					SDL_UnlockSurface(drv->s);
-
-				// Refresh display
-				SDL_UpdateRect(drv->s, x1, y1, wide, high);
-			}
-		}
-	}
-}
+	const uint32 bytes_per_row = VIDEO_MODE_ROW_BYTES;
+	const uint32 dst_bytes_per_row = drv->s->pitch;
+	const uint32 dst_bytes_per_pixel = drv->s->format->BytesPerPixel;
 
-// Static display update (fixed frame rate, bounding boxes based)
-// XXX use NQD bounding boxes to help detect dirty areas?
-static void update_display_static_bbox(driver_base *drv)
-{
-	const VIDEO_MODE &mode = drv->mode;
+	// Pixels are packed at depths below 8 bits
+	uint32 pixels_per_byte = 1, bytes_per_pixel = 1;
+	if ((int)VIDEO_MODE_DEPTH < VIDEO_DEPTH_8BIT)
+		pixels_per_byte = VIDEO_MODE_X / bytes_per_row;
+	else
+		bytes_per_pixel = bytes_per_row / VIDEO_MODE_X;
+	const uint32 row_length = VIDEO_MODE_X * bytes_per_pixel / pixels_per_byte;		// Whole bytes, as in VIDEO_MODE_ROW_BYTES
+
+	// Tiles are TILE_X pixels wide, but at least 16 bytes
+	const uint32 TILE_X = 64;
+	const uint32 TILE_Y = 16;
+	uint32 tile_shift = 4;
+	while ((1U << tile_shift) < TILE_X * bytes_per_pixel / pixels_per_byte)
+		tile_shift++;
+	const uint32 tile_bytes = 1 << tile_shift;
+	const uint32 n_x_tiles = (row_length + tile_bytes - 1) / tile_bytes;
+	const uint32 n_y_tiles = (VIDEO_MODE_Y + TILE_Y - 1) / TILE_Y;
+	bool *dirty = (bool *)alloca(sizeof(bool) * n_x_tiles);
 
 	// Allocate bounding boxes for SDL_UpdateRects()
-	const uint32 N_PIXELS = 64;
-	const uint32 n_x_boxes = (VIDEO_MODE_X + N_PIXELS - 1) / N_PIXELS;
-	const uint32 n_y_boxes = (VIDEO_MODE_Y + N_PIXELS - 1) / N_PIXELS;
-	SDL_Rect *boxes = (SDL_Rect *)alloca(sizeof(SDL_Rect) * n_x_boxes * n_y_boxes);
+	SDL_Rect *boxes = (SDL_Rect *)alloca(sizeof(SDL_Rect) * n_x_tiles * n_y_tiles);
 	uint32 nr_boxes = 0;
 
 	// Lock surface, if required
 	if (SDL_MUSTLOCK(drv->s))
 		SDL_LockSurface(drv->s);
 
-	// Update the surface from Mac screen
-	const uint32 bytes_per_row = VIDEO_MODE_ROW_BYTES;
-	const uint32 bytes_per_pixel = bytes_per_row / VIDEO_MODE_X;
-	const uint32 dst_bytes_per_row = drv->s->pitch;
-	for (uint32 y = 0; y < VIDEO_MODE_Y; y += N_PIXELS) {
-		uint32 h = N_PIXELS;
+	for (uint32 y = 0; y < VIDEO_MODE_Y; y += TILE_Y) {
+		uint32 h = TILE_Y;
 		if (h > VIDEO_MODE_Y - y)
 			h = VIDEO_MODE_Y - y;
-		for (uint32 x = 0; x < VIDEO_MODE_X; x += N_PIXELS) {
-			uint32 w = N_PIXELS;
+
+		// Update the changed tile rows in this row of tiles
+		memset(dirty, 0, sizeof(bool) * n_x_tiles);
+		bool changed = false;
+		for (uint32 j = y; j < y + h; j++) {
+			const uint32 yb = j * bytes_per_row;
+			uint8 *dst = (uint8 *)drv->s->pixels + j * dst_bytes_per_row;
+			if (blit_changed_tiles(dst, the_buffer + yb, the_buffer_copy + yb, row_length, tile_shift,
+								   pixels_per_byte, bytes_per_pixel, dst_bytes_per_pixel, dirty))
+				changed = true;
+		}
+		if (!changed)
+			continue;
+
+		// Add a bounding box for each run of changed tiles
+		for (uint32 i = 0; i < n_x_tiles; ) {
+			if (!dirty[i]) {
+				i++;
+				continue;
+			}
+			const uint32 first = i;
+			while (i < n_x_tiles && dirty[i])
+				i++;
+			const uint32 x = first * tile_bytes * pixels_per_byte / bytes_per_pixel;
+			uint32 w = (i - first) * tile_bytes * pixels_per_byte / bytes_per_pixel;
 			if (w > VIDEO_MODE_X - x)
 				w = VIDEO_MODE_X - x;
-			const int xs = w * bytes_per_pixel;
-			const int xb = x * bytes_per_pixel;
-			bool dirty = false;
-			for (uint32 j = y; j < (y + h); j++) {
-				const uint32 yb = j * bytes_per_row;
-				const uint32 dst_yb = j * dst_bytes_per_row;
-				if (memcmp(&the_buffer[yb + xb], &the_buffer_copy[yb + xb], xs) != 0) {
-					memcpy(&the_buffer_copy[yb + xb], &the_buffer[yb + xb], xs);
-					Screen_blit((uint8 *)drv->s->pixels + dst_yb + xb, the_buffer + yb + xb, xs);
-					dirty = true;
-				}
-			}
-			if (dirty) {
-				boxes[nr_boxes].x = x;
-				boxes[nr_boxes].y = y;
-				boxes[nr_boxes].w = w;
-				boxes[nr_boxes].h = h;
-				nr_boxes++;
-			}
+			boxes[nr_boxes].x = x;
+			boxes[nr_boxes].y = y;
+			boxes[nr_boxes].w = w;
+			boxes[nr_boxes].h = h;
+			nr_boxes++;
 		}
 	}
 
@@ -2114,7 +1995,7 @@ static void video_refresh_dga_vosf(void)
 	static uint32 tick_counter = 0;
 	if (++tick_counter >= frame_skip) {
 		tick_counter = 0;
-		if (mainBuffer.dirty) {
+		if (video_vosf_dirty()) {
 			LOCK_VOSF;
 			update_display_dga_vosf(drv);
 			UNLOCK_VOSF;
@@ -2132,7 +2013,7 @@ static void video_refresh_window_vosf(void)
 	static uint32 tick_counter = 0;
 	if (++tick_counter >= frame_skip) {
 		tick_counter = 0;
-		if (mainBuffer.dirty) {
+		if (video_vosf_dirty()) {
 			LOCK_VOSF;
 			update_display_window_vosf(drv);
 			UNLOCK_VOSF;
@@ -2150,11 +2031,7 @@ static void video_refresh_window_static(void)
 	static uint32 tick_counter = 0;
 	if (++tick_counter >= frame_skip) {
 		tick_counter = 0;
-		const VIDEO_MODE &mode = drv->mode;
-		if ((int)VIDEO_MODE_DEPTH >= VIDEO_DEPTH_8BIT)
-			update_display_static_bbox(drv);
-		else
-			update_display_static(drv);
+		update_display_static(drv);
 	}
 }
 
@@ -0,0 +1,90 @@
+/*
+ *  video_sdl_tiles.h - Incremental update of SDL video tiles
+ *
+ *  Basilisk II (C) 1997-2008 Christian Bauer
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef VIDEO_SDL_TILES_H
+#define VIDEO_SDL_TILES_H
+
+// Note: this file must be #include'd only in video_sdl.cpp (and the
+// video_blit.cpp test program), after video_blit.h
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Return the offset of the first difference between a span of the frame
+// buffer and its copy, rounded down to 16 bytes, or length if there is none
+static inline uint32 span_diff(const uint8 * p, const uint8 * p2, uint32 length)
+{
+	uint32 i = 0;
+#ifdef __SSE2__
+	for (; i + 32 <= length; i += 32) {
+		const __m128i a0 = _mm_loadu_si128((const __m128i *)(p + i));
+		const __m128i b0 = _mm_loadu_si128((const __m128i *)(p2 + i));
+		const __m128i a1 = _mm_loadu_si128((const __m128i *)(p + i + 16));
+		const __m128i b1 = _mm_loadu_si128((const __m128i *)(p2 + i + 16));
+		const __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(a0, b0), _mm_cmpeq_epi8(a1, b1));
+		if (_mm_movemask_epi8(eq) != 0xffff)
+			return _mm_movemask_epi8(_mm_cmpeq_epi8(a0, b0)) != 0xffff ? i : i + 16;
+	}
+#endif
+	for (; i < length; i++) {
+		if (p[i] != p2[i])
+			return i & ~15;
+	}
+	return length;
+}
+
+// Copy the tiles of a scanline of length bytes that differ from their
+// copy, and blit them to dest. Tiles are (1 << tile_shift) bytes wide,
+// the last one ends with the scanline. Returns whether any tile changed,
+// and sets dirty[] for each of them
+static inline bool blit_changed_tiles(uint8 * dest, const uint8 * source, uint8 * source_copy, uint32 length, uint32 tile_shift,
+									  uint32 pixels_per_byte, uint32 bytes_per_pixel, uint32 dest_bytes_per_pixel, bool * dirty)
+{
+	bool changed = false;
+	uint32 xb = 0, run_start = 0, run_end = 0;
+	for (;;) {
+		xb += span_diff(source + xb, source_copy + xb, length - xb);
+		const bool done = (xb >= length);
+		const uint32 i = xb >> tile_shift;
+		if (!done)
+			xb = i << tile_shift;
+
+		// Blit runs of adjacent changed tiles at once
+		if (done || xb != run_end) {
+			if (run_end > run_start) {
+				const uint32 x = run_start * pixels_per_byte / bytes_per_pixel;
+				memcpy(source_copy + run_start, source + run_start, run_end - run_start);
+				Screen_blit(dest + x * dest_bytes_per_pixel, source + run_start, run_end - run_start);
+			}
+			if (done)
+				break;
+			run_start = xb;
+		}
+		xb += 1 << tile_shift;
+		if (xb > length)
+			xb = length;
+		run_end = xb;
+		dirty[i] = changed = true;
+	}
+	return changed;
+}
+
+#endif /* VIDEO_SDL_TILES_H */
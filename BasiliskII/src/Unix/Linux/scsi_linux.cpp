@@ -41,12 +41,20 @@
 static int fds[8];				// fd's for 8 units
 static int fd;					// Active fd (selected target)
 
-static uint32 buffer_size;		// Size of data buffer
-static uint8 *buffer = NULL;	// Pointer to data buffer
-
 static uint8 the_cmd[12];		// Active SCSI command
 static int the_cmd_len;
 
+#ifdef SG_IO
+static sg_iovec *iov = NULL;	// S/G table passed to the kernel
+static int iov_size = 0;		// Number of entries in iov
+
+static uint8 sense_data[16];	// Autosense data of last command
+static bool sense_valid = false;	// Flag: sense_data valid for Request Sense
+#else
+static uint32 buffer_size;		// Size of data buffer
+static uint8 *buffer = NULL;	// Pointer to data buffer
+#endif
+
 
 /*
  *  Initialization
@@ -56,8 +64,10 @@ void SCSIInit(void)
 {
 	int id;
 
+#ifndef SG_IO
 	// Allocate buffer
 	buffer = (uint8 *)malloc(buffer_size = 0x10000);
+#endif
 
 	// Open generic SCSI driver for all 8 units
     for (id=0; id<8; id++) {
@@ -110,14 +120,22 @@ void SCSIExit(void)
 			close(fd);
 	}
 
+#ifdef SG_IO
+	// Free S/G table
+	free(iov);
+	iov = NULL;
+	iov_size = 0;
+#else
 	// Free buffer
 	if (buffer) {
 		free(buffer);
 		buffer = NULL;
 	}
+#endif
 }
 
 
+#ifndef SG_IO
 /*
  *  Check if requested data size fits into buffer, allocate new buffer if needed
  */
@@ -136,6 +154,7 @@ static bool try_buffer(uint32 size)
 	buffer_size = size;
 	return true;
 }
+#endif
 
 
 /*
@@ -169,8 +188,12 @@ bool scsi_set_target(int id, int lun)
 		return false;
 	if (new_fd != fd) {
 		// New target, clear autosense data
+#ifdef SG_IO
+		sense_valid = false;
+#else
 		sg_header *h = (sg_header *)buffer;
 		h->driver_status &= ~DRIVER_SENSE;
+#endif
 	}
 	fd = new_fd;
 	return true;
@@ -184,6 +207,71 @@ bool scsi_set_target(int id, int lun)
 
 bool scsi_send_cmd(size_t data_length, bool reading, int sg_size, uint8 **sg_ptr, uint32 *sg_len, uint16 *stat, uint32 timeout)
 {
+#ifdef SG_IO
+	// Request Sense and autosense data valid?
+	if (reading && the_cmd[0] == 0x03 && sense_valid) {
+
+		// Yes, fake command
+		D(bug(" autosense\n"));
+		uint8 *sense_ptr = sense_data;
+		size_t sense_left = sizeof(sense_data);
+		for (int i=0; i<sg_size && sense_left; i++) {
+			uint32 len = sg_len[i] < sense_left ? sg_len[i] : sense_left;
+			memcpy(sg_ptr[i], sense_ptr, len);
+			sense_ptr += len;
+			sense_left -= len;
+		}
+		sense_valid = false;
+		*stat = 0;
+		return true;
+	}
+
+	// No, send regular command, the kernel transfers the data directly
+	// from/to the S/G table (one ioctl, no bounce buffer)
+	if (sg_size > iov_size) {
+		sg_iovec *new_iov = (sg_iovec *)realloc(iov, sg_size * sizeof(sg_iovec));
+		if (new_iov == NULL)
+			return false;
+		iov = new_iov;
+		iov_size = sg_size;
+	}
+	for (int i=0; i<sg_size; i++) {
+		D(bug("  %d bytes %s %08lx\n", sg_len[i], reading ? "to" : "from", sg_ptr[i]));
+		iov[i].iov_base = sg_ptr[i];
+		iov[i].iov_len = sg_len[i];
+	}
+
+	sg_io_hdr_t io;
+	memset(&io, 0, sizeof(io));
+	io.interface_id = 'S';
+	io.cmd_len = the_cmd_len;
+	io.cmdp = the_cmd;
+	io.mx_sb_len = sizeof(sense_data);
+	io.sbp = sense_data;
+	io.timeout = timeout * 1000 / 60;	// 0 = driver default
+	if (data_length == 0 || sg_size == 0)
+		io.dxfer_direction = SG_DXFER_NONE;
+	else {
+		io.dxfer_direction = reading ? SG_DXFER_FROM_DEV : SG_DXFER_TO_DEV;
+		io.dxfer_len = data_length;
+		if (sg_size == 1)
+			io.dxferp = sg_ptr[0];
+		else {
+			io.iovec_count = sg_size;
+			io.dxferp = iov;
+		}
+	}
+
+	D(bug(" sending command, length %d, %d S/G entries\n", data_length, sg_size));
+	int res = ioctl(fd, SG_IO, &io);
+	D(bug(" command done, result %d, status %02x\n", res, io.status));
+	if (res < 0)
+		return false;
+
+	sense_valid = (io.driver_status & DRIVER_SENSE) && io.sb_len_wr > 0;
+	*stat = io.status;
+	return true;
+#else
 	static int pack_id = 0;
 
 	// Check if buffer is large enough, allocate new buffer if needed
@@ -268,4 +356,5 @@ bool scsi_send_cmd(size_t data_length, bool reading, int sg_size, uint8 **sg_ptr
 		}
 	}
 	return res >= 0;
+#endif
 }
@@ -24,7 +24,11 @@
 #include <unistd.h>
 #include <errno.h>
 #include <pthread.h>
-#include <semaphore.h>
+#include <time.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #ifdef __linux__
 #include <linux/soundcard.h>
@@ -58,8 +62,6 @@ static int audio_channel_count_index = 0;
 static bool is_dsp_audio = false;					// Flag: is DSP audio
 static int audio_fd = -1;							// fd of dsp or ESD
 static int mixer_fd = -1;							// fd of mixer
-static sem_t audio_irq_done_sem;					// Signal from interrupt to streaming thread: data block read
-static bool sem_inited = false;						// Flag: audio_irq_done_sem initialized
 static int sound_buffer_size;						// Size of sound buffer in bytes
 static bool little_endian = false;					// Flag: DSP accepts only little-endian 16-bit sound data
 static uint8 silence_byte;							// Byte value to use to fill sound buffers with silence
@@ -68,6 +70,17 @@ static pthread_attr_t stream_thread_attr;			// Streaming thread attributes
 static bool stream_thread_active = false;			// Flag: streaming thread installed
 static volatile bool stream_thread_cancel = false;	// Flag: cancel streaming thread
 
+// Ring of sound buffers, filled ahead of time by AudioInterrupt() and played by the streaming thread
+const int AUDIO_RING_MAX = 8;						// Maximum number of buffers filled ahead
+static uint8 *audio_ring[AUDIO_RING_MAX];			// Sound buffers, in DSP format
+static volatile uint32 audio_ring_head = 0;			// Next buffer to be filled by AudioInterrupt()
+static volatile uint32 audio_ring_tail = 0;			// Next buffer to be played
+static int audio_ring_target = 1;					// Number of buffers to keep filled ahead
+static volatile int audio_irq_pending = 0;			// Flag: INTFLAG_AUDIO raised, AudioInterrupt() not run yet
+static uint32 audio_underruns = 0;					// Number of buffers replaced by silence because the guest was late
+static pthread_mutex_t audio_ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t audio_ring_filled = PTHREAD_COND_INITIALIZER;	// Signal from interrupt to streaming thread: buffer filled
+
 // Prototypes
 static void *stream_func(void *arg);
 
@@ -266,6 +279,19 @@ dev_opened:
 	sound_buffer_size = (audio_sample_sizes[audio_sample_size_index] >> 3) * audio_channel_counts[audio_channel_count_index] * audio_frames_per_block;
 	set_audio_status_format();
 
+	// Allocate sound buffer ring, keep enough buffers filled ahead to cover the requested latency
+	for (int i=0; i<AUDIO_RING_MAX; i++)
+		audio_ring[i] = new uint8[sound_buffer_size];
+	audio_ring_head = audio_ring_tail = 0;
+	audio_irq_pending = 0;
+	int latency_frames = PrefsFindInt32("audiolatency") * (AudioStatus.sample_rate >> 16) / 1000;
+	audio_ring_target = (latency_frames + audio_frames_per_block - 1) / audio_frames_per_block;
+	if (audio_ring_target < 1)
+		audio_ring_target = 1;
+	else if (audio_ring_target > AUDIO_RING_MAX)
+		audio_ring_target = AUDIO_RING_MAX;
+	D(bug("%d sound buffers of %d bytes filled ahead\n", audio_ring_target, sound_buffer_size));
+
 	// Start streaming thread
 	Set_pthread_attr(&stream_thread_attr, 0);
 	stream_thread_active = (pthread_create(&stream_thread, &stream_thread_attr, stream_func, NULL) == 0);
@@ -289,11 +315,6 @@ void AudioInit(void)
 	if (PrefsFindBool("nosound"))
 		return;
 
-	// Init semaphore
-	if (sem_init(&audio_irq_done_sem, 0, 0) < 0)
-		return;
-	sem_inited = true;
-
 	// Try to open the mixer device
 	const char *mixer = PrefsFindString("mixer");
 	mixer_fd = open(mixer, O_RDWR);
@@ -321,6 +342,12 @@ static void close_audio(void)
 		stream_thread_active = false;
 	}
 
+	// Free sound buffer ring
+	for (int i=0; i<AUDIO_RING_MAX; i++) {
+		delete[] audio_ring[i];
+		audio_ring[i] = NULL;
+	}
+
 	// Close dsp or ESD socket
 	if (audio_fd >= 0) {
 		close(audio_fd);
@@ -339,12 +366,8 @@ void AudioExit(void)
 
 	// Close audio device
 	close_audio();
-
-	// Delete semaphore
-	if (sem_inited) {
-		sem_destroy(&audio_irq_done_sem);
-		sem_inited = false;
-	}
+	if (audio_underruns)
+		printf("%u audio buffer underruns\n", audio_underruns);
 
 	// Close mixer device
 	if (mixer_fd >= 0) {
@@ -378,59 +401,75 @@ void audio_exit_stream()
  *  Streaming function
  */
 
+// Trigger audio interrupt to get a new buffer, unless one is already pending
+static void request_audio_buffer(void)
+{
+	if (__sync_bool_compare_and_swap(&audio_irq_pending, 0, 1)) {
+		D(bug("stream: triggering irq\n"));
+		SetInterruptFlag(INTFLAG_AUDIO);
+		TriggerInterrupt();
+	}
+}
+
+// Release audio_ring_lock when the streaming thread is cancelled while waiting
+static void unlock_audio_ring(void *arg)
+{
+	pthread_mutex_unlock(&audio_ring_lock);
+}
+
 static void *stream_func(void *arg)
 {
 	int16 *silent_buffer = new int16[sound_buffer_size / 2];
-	int16 *last_buffer = new int16[sound_buffer_size / 2];
 	memset(silent_buffer, silence_byte, sound_buffer_size);
 
+	// Time the guest gets to deliver a late buffer: half a buffer, the DSP still has data queued
+	const long wait_nsec = (long)(500000000.0 * audio_frames_per_block / (AudioStatus.sample_rate >> 16));
+	bool playing = false;
+
 	while (!stream_thread_cancel) {
-		if (AudioStatus.num_sources) {
-
-			// Trigger audio interrupt to get new buffer
-			D(bug("stream: triggering irq\n"));
-			SetInterruptFlag(INTFLAG_AUDIO);
-			TriggerInterrupt();
-			D(bug("stream: waiting for ack\n"));
-			sem_wait(&audio_irq_done_sem);
-			D(bug("stream: ack received\n"));
-
-			// Get size of audio data
-			uint32 apple_stream_info = ReadMacInt32(audio_data + adatStreamInfo);
-			if (apple_stream_info) {
-				int work_size = ReadMacInt32(apple_stream_info + scd_sampleCount) * (AudioStatus.sample_size >> 3) * AudioStatus.channels;
-				D(bug("stream: work_size %d\n", work_size));
-				if (work_size > sound_buffer_size)
-					work_size = sound_buffer_size;
-				if (work_size == 0)
-					goto silence;
-
-				// Send data to DSP
-				if (work_size == sound_buffer_size && !little_endian)
-					write(audio_fd, Mac2HostAddr(ReadMacInt32(apple_stream_info + scd_buffer)), sound_buffer_size);
-				else {
-					// Last buffer or little-endian DSP
-					if (little_endian) {
-						int16 *p = (int16 *)Mac2HostAddr(ReadMacInt32(apple_stream_info + scd_buffer));
-						for (int i=0; i<work_size/2; i++)
-							last_buffer[i] = ntohs(p[i]);
-					} else
-						Mac2Host_memcpy(last_buffer, ReadMacInt32(apple_stream_info + scd_buffer), work_size);
-					memset((uint8 *)last_buffer + work_size, silence_byte, sound_buffer_size - work_size);
-					write(audio_fd, last_buffer, sound_buffer_size);
-				}
-				D(bug("stream: data written\n"));
-			} else
-				goto silence;
+
+		// Keep the ring filled ahead
+		if (AudioStatus.num_sources && audio_ring_head - audio_ring_tail < (uint32)audio_ring_target)
+			request_audio_buffer();
+
+		// Ring empty? Wait a little for the pending buffer
+		if (audio_ring_head == audio_ring_tail && AudioStatus.num_sources) {
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += wait_nsec;
+			if (ts.tv_nsec >= 1000000000) {
+				ts.tv_sec++;
+				ts.tv_nsec -= 1000000000;
+			}
+			pthread_mutex_lock(&audio_ring_lock);
+			pthread_cleanup_push(unlock_audio_ring, NULL);
+			while (audio_ring_head == audio_ring_tail && pthread_cond_timedwait(&audio_ring_filled, &audio_ring_lock, &ts) == 0) ;
+			pthread_cleanup_pop(1);
+			if (audio_ring_head == audio_ring_tail && playing) {
+				audio_underruns++;
+				D(bug("stream: underrun\n"));
+			}
+		}
+
+		if (audio_ring_head != audio_ring_tail) {
+
+			// Send next buffer to DSP
+			__sync_synchronize();
+			write(audio_fd, audio_ring[audio_ring_tail % AUDIO_RING_MAX], sound_buffer_size);
+			__sync_synchronize();
+			audio_ring_tail = audio_ring_tail + 1;
+			playing = true;
+			D(bug("stream: data written\n"));
 
 		} else {
 
-			// Audio not active, play silence
-silence:	write(audio_fd, silent_buffer, sound_buffer_size);
+			// Audio not active or guest late, play silence
+			if (AudioStatus.num_sources == 0)
+				playing = false;
+			write(audio_fd, silent_buffer, sound_buffer_size);
 		}
 	}
 	delete[] silent_buffer;
-	delete[] last_buffer;
 	return NULL;
 }
 
@@ -439,6 +478,20 @@ silence:	write(audio_fd, silent_buffer, sound_buffer_size);
  *  MacOS audio interrupt, read next data block
  */
 
+// Copy 16-bit samples, swapping their byte order
+static void copy_swap_16(uint16 *dst, const uint16 *src, int count)
+{
+	int i = 0;
+#ifdef __SSE2__
+	for (; i + 8 <= count; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+	}
+#endif
+	for (; i < count; i++)
+		dst[i] = (src[i] >> 8) | (src[i] << 8);
+}
+
 void AudioInterrupt(void)
 {
 	D(bug("AudioInterrupt\n"));
@@ -453,8 +506,37 @@ void AudioInterrupt(void)
 	} else
 		WriteMacInt32(audio_data + adatStreamInfo, 0);
 
+	// Convert data into the next free buffer of the ring
+	if (audio_ring[0] && audio_ring_head - audio_ring_tail < AUDIO_RING_MAX) {
+		uint8 *buffer = audio_ring[audio_ring_head % AUDIO_RING_MAX];
+		int work_size = 0;
+		uint32 apple_stream_info = ReadMacInt32(audio_data + adatStreamInfo);
+		if (apple_stream_info) {
+			work_size = ReadMacInt32(apple_stream_info + scd_sampleCount) * (AudioStatus.sample_size >> 3) * AudioStatus.channels;
+			D(bug(" work_size %d\n", work_size));
+			if (work_size > sound_buffer_size)
+				work_size = sound_buffer_size;
+			uint32 data = ReadMacInt32(apple_stream_info + scd_buffer);
+			if (little_endian && AudioStatus.sample_size == 16)
+				copy_swap_16((uint16 *)buffer, (uint16 *)Mac2HostAddr(data), work_size / 2);
+			else
+				Mac2Host_memcpy(buffer, data, work_size);
+		}
+		memset(buffer + work_size, silence_byte, sound_buffer_size - work_size);
+		__sync_synchronize();
+		audio_ring_head = audio_ring_head + 1;
+	}
+
+	// Fill ahead until the target is reached
+	audio_irq_pending = 0;
+	__sync_synchronize();
+	if (AudioStatus.num_sources && audio_ring_head - audio_ring_tail < (uint32)audio_ring_target)
+		request_audio_buffer();
+
 	// Signal stream function
-	sem_post(&audio_irq_done_sem);
+	pthread_mutex_lock(&audio_ring_lock);
+	pthread_cond_signal(&audio_ring_filled);
+	pthread_mutex_unlock(&audio_ring_lock);
 	D(bug("AudioInterrupt done\n"));
 }
 
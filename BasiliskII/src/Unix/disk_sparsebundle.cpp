@@ -23,6 +23,7 @@
 
 #include <errno.h>
 #include <limits.h>
+#include <sys/stat.h>
 #include <algorithm>
 
 #if defined __APPLE__ && defined __MACH__
@@ -33,13 +34,14 @@ struct disk_sparsebundle : disk_generic {
 	disk_sparsebundle(const char *bands, int fd, bool read_only,
 		loff_t band_size, loff_t total_size)
 	: token_fd(fd), read_only(read_only), band_size(band_size),
-		total_size(total_size), band_dir(strdup(bands)),
-		band_cur(-1), band_fd(-1), band_alloc(-1) {
+		total_size(total_size), band_dir(strdup(bands)), band_clock(0) {
 	}
 	
 	virtual ~disk_sparsebundle() {
-		if (band_fd != -1)
-			close(band_fd);
+		for (int i = 0; i < BAND_CACHE_SIZE; ++i) {
+			if (bands[i].fd != -1)
+				close(bands[i].fd);
+		}
 		close(token_fd);
 		free(band_dir);
 	}
@@ -48,11 +50,11 @@ struct disk_sparsebundle : disk_generic {
 	virtual loff_t size() { return total_size; }
 	
 	virtual size_t read(void *buf, loff_t offset, size_t length) {
-		return band_do(&disk_sparsebundle::band_read, buf, offset, length);
+		return band_do(false, buf, offset, length);
 	}
 	
 	virtual size_t write(void *buf, loff_t offset, size_t length) {
-		return band_do(&disk_sparsebundle::band_write, buf, offset, length);
+		return band_do(true, buf, offset, length);
 	}
 	
 protected:
@@ -61,48 +63,156 @@ protected:
 	loff_t band_size, total_size;
 	char *band_dir;			// directory containing band files
 	
-	// Currently open band
-	loff_t band_cur;		// index of the band
-	int band_fd;			// -1 if not open
-	loff_t band_alloc;		// how much space is already used?
+	// Cache of open bands, least recently used one is closed first.
+	// Bands known not to exist are cached too (fd -1), as nobody else
+	// may create them while we hold the token.
+	enum {
+		BAND_CACHE_SIZE = 32,
+		BAND_BATCH_SIZE = 4,			// max bands accessed in parallel
+		BAND_PARALLEL_MIN = 256 * 1024,	// min request size for parallel I/O
+	};
+	struct band_info {
+		band_info() : band(-1), fd(-1), alloc(0), last_use(0) { }
+		loff_t band;		// index of the band, -1 if slot is unused
+		int fd;				// -1 if not open
+		loff_t alloc;		// how much space is already used?
+		uint32 last_use;	// band_clock at last access
+	};
+	band_info bands[BAND_CACHE_SIZE];
+	uint32 band_clock;
 	
-	typedef ssize_t (disk_sparsebundle::*band_func)(char *buf, loff_t band,
-		size_t offset, size_t len);
+	// Part of an (offset, length) operation that falls into one band
+	struct band_seg {
+		disk_sparsebundle *disk;
+		bool write;
+		band_info *info;	// NULL if the band doesn't exist
+		char *buf;
+		size_t off, len;
+		size_t nz;			// length without trailing zeros (writes)
+		ssize_t result;
+	};
 	
-	// Split an (offset, length) operation into bands.
-	size_t band_do(band_func func, void *buf, loff_t offset, size_t length) {
+	// Split an (offset, length) operation into bands. The bands of each
+	// batch are opened here, the transfers of big requests then run in
+	// parallel.
+	size_t band_do(bool write, void *buf, loff_t offset, size_t length) {
 		char *b = (char*)buf;
 		loff_t band = offset / band_size;
 		size_t done = 0;
-		while (length) {
-			if (offset >= total_size)
-				break;
-			size_t start = offset % band_size;
-			size_t segment = std::min((size_t)band_size - start, length);
+		while (length && offset < total_size) {
+			band_seg segs[BAND_BATCH_SIZE];
+			int n = 0;
+			size_t batch_len = 0;
+			bool failed = false;
+			while (n < BAND_BATCH_SIZE && length && offset < total_size) {
+				band_seg &s = segs[n];
+				s.disk = this;
+				s.write = write;
+				s.buf = b;
+				s.off = offset % band_size;
+				s.len = std::min((size_t)band_size - s.off, length);
+				s.result = -1;
+				if (!band_prepare(s, band)) {
+					failed = true;
+					break;
+				}
+				++n;
+				
+				b += s.len;
+				offset += s.len;
+				length -= s.len;
+				batch_len += s.len;
+				++band;
+			}
 			
-			ssize_t err = (this->*func)(b, band, start, segment);
-			if (err > 0)
-				done += err;
-			if (err < segment)
-				break;
+			band_run(segs, n, batch_len);
 			
-			b += segment;
-			offset += segment;
-			length -= segment;
-			++band;
+			for (int i = 0; i < n; ++i) {
+				ssize_t err = segs[i].result;
+				if (err > 0)
+					done += err;
+				if (err < (ssize_t)segs[i].len)
+					return done;
+			}
+			if (failed)
+				break;
 		}
 		return done;
 	}
+	
+	// Perform the transfers of a batch
+	void band_run(band_seg *segs, int n, size_t batch_len) {
+#ifdef HAVE_PTHREADS
+		if (n > 1 && batch_len >= BAND_PARALLEL_MIN) {
+			pthread_t threads[BAND_BATCH_SIZE];
+			bool started[BAND_BATCH_SIZE];
+			for (int i = 1; i < n; ++i)
+				started[i] = pthread_create(&threads[i], NULL, band_thread, &segs[i]) == 0;
+			band_io(segs[0]);
+			for (int i = 1; i < n; ++i) {
+				if (started[i])
+					pthread_join(threads[i], NULL);
+				else
+					band_io(segs[i]);
+			}
+			return;
+		}
+#endif
+		for (int i = 0; i < n; ++i)
+			band_io(segs[i]);
+	}
+	
+	static void *band_thread(void *arg) {
+		band_seg *s = (band_seg *)arg;
+		s->disk->band_io(*s);
+		return NULL;
+	}
+	
+	void band_io(band_seg &s) {
+		s.result = s.write ? band_write(s) : band_read(s);
+	}
+	
+	// Look up or open the band of a segment, false on error
+	bool band_prepare(band_seg &s, loff_t band) {
+		s.nz = 0;
+		if (s.write) {
+			// If space is unused, don't needlessly fill it with zeros
+			
+			// Find min length such that all trailing chars are zero:
+			s.nz = s.len;
+			for (; s.nz > 0 && !s.buf[s.nz-1]; --s.nz)
+				; // pass
+		}
 		
+		s.info = NULL;
+		return open_band(band, s.nz > 0, &s.info) != OPEN_FAILED;
+	}
+	
 	// Open a band by index. It's ok if the band is already open.
 	enum open_ret {
 		OPEN_FAILED = 0,
 		OPEN_NOENT,		// Band doesn't exist yet
 		OPEN_OK,
 	};
-	open_ret open_band(loff_t band, bool create) {
-		if (band_cur == band)
-			return OPEN_OK;
+	open_ret open_band(loff_t band, bool create, band_info **info) {
+		*info = NULL;
+		band_info *victim = &bands[0];
+		for (int i = 0; i < BAND_CACHE_SIZE; ++i) {
+			band_info &bi = bands[i];
+			if (bi.band == band) {
+				if (bi.fd == -1 && create) {	// must create it now
+					victim = &bi;
+					break;
+				}
+				bi.last_use = ++band_clock;
+				if (bi.fd == -1)
+					return OPEN_NOENT;
+				*info = &bi;
+				return OPEN_OK;
+			}
+			if (bi.last_use < victim->last_use)
+				victim = &bi;
+		}
 		
 		char path[PATH_MAX + 1];
 		if (snprintf(path, PATH_MAX, "%s/%lx", band_dir,
@@ -110,76 +220,66 @@ protected:
 			return OPEN_FAILED;
 		}
 		
-		if (band_fd != -1)
-			close(band_fd);
-		band_alloc = -1;
-		band_cur = -1;
-		
 		int oflags = read_only ? O_RDONLY : O_RDWR;
 		if (create)
 			oflags |= O_CREAT;
-		band_fd = open(path, oflags, 0644);
-		if (band_fd == -1) {
-			return (!create && errno == ENOENT) ? OPEN_NOENT : OPEN_FAILED;
-		}
+		int fd = open(path, oflags, 0644);
+		if (fd == -1 && (create || errno != ENOENT))
+			return OPEN_FAILED;
 		
 		// Get the allocated size
-		if (!read_only) {
-			band_alloc = lseek(band_fd, 0, SEEK_END);
-			if (band_alloc == -1)
-				band_alloc = band_size;
+		loff_t alloc = 0;
+		if (fd != -1) {
+			struct stat st;
+			alloc = fstat(fd, &st) == 0 ? st.st_size : band_size;
 		}
-		band_cur = band;
+		
+		// Reuse the least recently used slot
+		if (victim->fd != -1)
+			close(victim->fd);
+		victim->band = band;
+		victim->fd = fd;
+		victim->alloc = alloc;
+		victim->last_use = ++band_clock;
+		if (fd == -1)
+			return OPEN_NOENT;
+		*info = victim;
 		return OPEN_OK;
 	}
 	
-	ssize_t band_read(char *buf, loff_t band, size_t off, size_t len) {
-		open_ret st = open_band(band, false);
-		if (st == OPEN_FAILED)
-			return -1;
-		
+	ssize_t band_read(band_seg &s) {
 		// Unallocated bytes 
-		size_t want = (st == OPEN_NOENT || off >= band_alloc) ? 0
-			: std::min(len, (size_t)band_alloc - off);
+		band_info *bi = s.info;
+		size_t want = (!bi || s.off >= bi->alloc) ? 0
+			: std::min(s.len, (size_t)bi->alloc - s.off);
 		if (want) {
-			if (lseek(band_fd, off, SEEK_SET) == -1)
-				return -1;
-			ssize_t err = ::read(band_fd, buf, want);
-			if (err < want)
+			ssize_t err = ::pread(bi->fd, s.buf, want, s.off);
+			if (err < (ssize_t)want)
 				return err;
 		}
-		memset(buf + want, 0, len - want);
-		return len;
+		memset(s.buf + want, 0, s.len - want);
+		return s.len;
 	}
 
-	ssize_t band_write(char *buf, loff_t band, size_t off, size_t len) {
-		// If space is unused, don't needlessly fill it with zeros
+	ssize_t band_write(band_seg &s) {
+		band_info *bi = s.info;
+		if (!bi)	// all zeros and the band doesn't exist
+			return s.len;
 		
-		// Find min length such that all trailing chars are zero:
-		size_t nz = len;
-		for (; nz > 0 && !buf[nz-1]; --nz)
-			; // pass
-		
-		open_ret st = open_band(band, nz);
-		if (st != OPEN_OK)
-			return st == OPEN_NOENT ? len : -1;
-
-		if (lseek(band_fd, off, SEEK_SET) == -1)
-			return -1;
-		
-		size_t space = (off >= band_alloc ? 0 : band_alloc - off);
-		size_t want = std::max(nz, std::min(space, len));
-		ssize_t err = ::write(band_fd, buf, want);
+		size_t space = (s.off >= bi->alloc ? 0 : bi->alloc - s.off);
+		size_t want = std::max(s.nz, std::min(space, s.len));
+		ssize_t err = ::pwrite(bi->fd, s.buf, want, s.off);
 		if (err >= 0)
-			band_alloc = std::max(band_alloc, loff_t(off + err));
-		if (err < want)
+			bi->alloc = std::max(bi->alloc, loff_t(s.off + err));
+		if (err < (ssize_t)want)
 			return err;
-		return len;
+		return s.len;
 	}
 };
 
 
 
+
 using tinyxml2::XML_NO_ERROR;
 using tinyxml2::XMLElement;
 
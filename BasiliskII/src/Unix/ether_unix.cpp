@@ -36,13 +36,25 @@
 // Define to let the slirp library determine the right timeout for select()
 #define USE_SLIRP_TIMEOUT 1
 
+// Use an epoll set and an eventfd for the slirp thread, instead of select() and a pipe
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_EVENTFD_H)
+#define USE_EPOLL 1
+#else
+#define USE_EPOLL 0
+#endif
+
 #ifdef HAVE_SYS_POLL_H
 #include <sys/poll.h>
 #endif
+#if USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/wait.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <pthread.h>
 #include <semaphore.h>
 #include <errno.h>
@@ -118,11 +130,13 @@ static char *net_if_name = NULL;			// TUN/TAP device name
 static const char *net_if_script = NULL;	// Network config script
 static pthread_t slirp_thread;				// Slirp reception thread
 static bool slirp_thread_active = false;	// Flag: Slirp reception threadinstalled
-static int slirp_output_fd = -1;			// fd of slirp output pipe
-static int slirp_input_fds[2] = { -1, -1 };	// fds of slirp input pipe
+static int slirp_wakeup_fds[2] = { -1, -1 };	// fds waking up the slirp thread (read and write end, or the same eventfd)
+static int slirp_epoll_fd = -1;				// epoll set of the slirp thread
 static amqp_connection_state_t amqp_connection = 0;	// AMQP connection
-static amqp_envelope_t *amqp_envelope = 0;	// AMQP packet, saved here so it can be passed to the interrupt code
 static char amqp_exchange[128];				// AMQP exchange to publish upon
+static bool amqp_transient = false;			// Flag: publish frames as transient messages
+static bool amqp_confirm = false;			// Flag: wait for publisher confirms after each batch
+static bool amqp_routing = false;			// Flag: route packets by destination on a topic exchange
 #ifdef SHEEPSHAVER
 static bool net_open = false;				// Flag: initialization succeeded, network device open
 static uint8 ether_addr[6];					// Our Ethernet address
@@ -133,15 +147,66 @@ const bool ether_driver_opened = true;		// Flag: is the MacOS driver opened?
 // Attached network protocols, maps protocol type to MacOS handler address
 static map<uint16, uint32> net_protocols;
 
+// Received packets ring, filled by the reception thread (or the slirp thread,
+// which then is the only producer) and drained in bulk by ether_do_interrupt()
+const int ETHER_RING_SIZE = 64;				// Must be a power of two
+
+struct ether_frame {
+	uint32 length;							// Length of packet data
+#ifndef SHEEPSHAVER
+	struct sockaddr_in from;				// Sender address (UDP tunnel)
+#endif
+	uint8 data[1516];						// Packet data, as read from the device
+};
+
+static ether_frame ether_ring[ETHER_RING_SIZE];
+static volatile uint32 ring_head = 0;		// Next slot to be filled by the producer
+static volatile uint32 ring_tail = 0;		// Next slot to be drained by ether_do_interrupt()
+static volatile int ring_waiting = 0;		// Flag: producer waits on int_ack for free slots
+static volatile int ring_irq_pending = 0;	// Flag: INTFLAG_ETHER raised, ring not drained yet
+
+#ifdef HAVE_SLIRP
+// Packets sent to slirp, queued by ether_do_write() and fed to slirp_input() by the slirp thread
+static ether_frame slirp_tx_ring[ETHER_RING_SIZE];
+static volatile uint32 slirp_tx_head = 0;	// Next slot to be filled by ether_do_write()
+static volatile uint32 slirp_tx_tail = 0;	// Next slot to be consumed by the slirp thread
+#if USE_EPOLL
+static uint8 slirp_epoll_events[FD_SETSIZE];	// Events registered with slirp_epoll_fd, per socket
+static int slirp_epoll_nfds = 0;			// Highest registered socket + 1
+#endif
+#endif
+
+// Outgoing AMQP frames, queued by ether_do_write() and published in batches by amqp_send_func()
+const int AMQP_TX_QUEUE_SIZE = 256;			// Must be a power of two
+
+struct amqp_tx_frame {
+	uint32 length;
+	uint8 data[1516];
+};
+
+static amqp_tx_frame amqp_tx_queue[AMQP_TX_QUEUE_SIZE];
+static uint32 amqp_tx_head = 0;				// Next slot to be filled by ether_do_write()
+static uint32 amqp_tx_tail = 0;				// Next slot to be published
+static bool amqp_tx_quit = false;			// Flag: sender thread shall exit once the queue is empty
+static pthread_mutex_t amqp_tx_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t amqp_tx_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t amqp_send_thread;			// AMQP sender thread
+static bool amqp_send_thread_active = false;	// Flag: AMQP sender thread installed
+static uint64 amqp_published = 0;			// Delivery tag of the last published message
+static uint64 amqp_confirmed = 0;			// Delivery tag of the last confirmed message
+static uint32 amqp_nacked = 0;				// Number of messages rejected by the server
+
 // Prototypes
 static void *receive_func(void *arg);
 static void *slirp_receive_func(void *arg);
+static void *amqp_send_func(void *arg);
 static int16 ether_do_add_multicast(uint8 *addr);
 static int16 ether_do_del_multicast(uint8 *addr);
 static int16 ether_do_write(uint32 arg);
 static void ether_do_interrupt(void);
 static void slirp_add_redirs();
 static int slirp_add_redir(const char *redir_str);
+bool amqp_check_status(amqp_rpc_reply_t status, char const *context);
 amqp_connection_state_t amqp_queue_connect(const char *url);
 void amqp_queue_disconnect(amqp_connection_state_t connection);
 
@@ -156,11 +221,17 @@ static bool start_thread(void)
 		return false;
 	}
 
-	Set_pthread_attr(&ether_thread_attr, 1);
-	thread_active = (pthread_create(&ether_thread, &ether_thread_attr, receive_func, NULL) == 0);
-	if (!thread_active) {
-		printf("WARNING: Cannot start Ethernet thread");
-		return false;
+	ring_head = ring_tail = 0;
+	ring_waiting = ring_irq_pending = 0;
+
+	// The slirp thread feeds the ring directly through slirp_output()
+	if (net_if_type != NET_IF_SLIRP) {
+		Set_pthread_attr(&ether_thread_attr, 1);
+		thread_active = (pthread_create(&ether_thread, &ether_thread_attr, receive_func, NULL) == 0);
+		if (!thread_active) {
+			printf("WARNING: Cannot start Ethernet thread");
+			return false;
+		}
 	}
 
 #ifdef HAVE_SLIRP
@@ -183,6 +254,8 @@ static bool start_thread(void)
 
 static void stop_thread(void)
 {
+	const bool ring_active = thread_active || slirp_thread_active;
+
 #ifdef HAVE_SLIRP
 	if (slirp_thread_active) {
 #ifdef HAVE_PTHREAD_CANCEL
@@ -198,9 +271,77 @@ static void stop_thread(void)
 		pthread_cancel(ether_thread);
 #endif
 		pthread_join(ether_thread, NULL);
-		sem_destroy(&int_ack);
 		thread_active = false;
 	}
+
+	if (ring_active)
+		sem_destroy(&int_ack);
+}
+
+
+/*
+ *  Slirp thread wakeup channel
+ */
+
+static void close_slirp_wakeup(void)
+{
+	if (slirp_epoll_fd >= 0) {
+		close(slirp_epoll_fd);
+		slirp_epoll_fd = -1;
+	}
+	if (slirp_wakeup_fds[1] >= 0 && slirp_wakeup_fds[1] != slirp_wakeup_fds[0])
+		close(slirp_wakeup_fds[1]);
+	if (slirp_wakeup_fds[0] >= 0)
+		close(slirp_wakeup_fds[0]);
+	slirp_wakeup_fds[0] = slirp_wakeup_fds[1] = -1;
+}
+
+#ifdef HAVE_SLIRP
+static void slirp_wakeup(void)
+{
+#if USE_EPOLL
+	uint64 one = 1;
+	write(slirp_wakeup_fds[1], &one, sizeof(one));
+#else
+	uint8 one = 1;
+	write(slirp_wakeup_fds[1], &one, sizeof(one));
+#endif
+}
+#endif
+
+
+/*
+ *  Received packets ring
+ */
+
+static inline bool ring_full(void)
+{
+	return ring_head - ring_tail >= ETHER_RING_SIZE;
+}
+
+// Get the next free slot, wait for ether_do_interrupt() to drain the ring if it is full (producer side)
+static ether_frame *ring_reserve(void)
+{
+	while (ring_full()) {
+		ring_waiting = 1;
+		__sync_synchronize();
+		if (ring_full())
+			sem_wait(&int_ack);
+	}
+	return &ether_ring[ring_head & (ETHER_RING_SIZE - 1)];
+}
+
+// Publish the slot returned by ring_reserve(), trigger Ethernet interrupt unless one is already pending
+static void ring_commit(void)
+{
+	__sync_synchronize();
+	ring_head = ring_head + 1;
+	__sync_synchronize();
+	if (__sync_bool_compare_and_swap(&ring_irq_pending, 0, 1)) {
+		D(bug(" packet received, triggering Ethernet interrupt\n"));
+		SetInterruptFlag(INTFLAG_ETHER);
+		TriggerInterrupt();
+	}
 }
 
 
@@ -283,16 +424,28 @@ bool ether_init(void)
 			return false;
 		}
 
-		// Open slirp output pipe
-		int fds[2];
-		if (pipe(fds) < 0)
+		// Open slirp thread wakeup channel
+		slirp_tx_head = slirp_tx_tail = 0;
+#if USE_EPOLL
+		slirp_wakeup_fds[0] = slirp_wakeup_fds[1] = eventfd(0, EFD_NONBLOCK);
+		if (slirp_wakeup_fds[0] < 0)
 			return false;
-		fd = fds[0];
-		slirp_output_fd = fds[1];
-
-		// Open slirp input pipe
-		if (pipe(slirp_input_fds) < 0)
+		slirp_epoll_fd = epoll_create(64);
+		if (slirp_epoll_fd < 0)
+			return false;
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.fd = slirp_wakeup_fds[0];
+		if (epoll_ctl(slirp_epoll_fd, EPOLL_CTL_ADD, slirp_wakeup_fds[0], &ev) < 0)
 			return false;
+		memset(slirp_epoll_events, 0, sizeof(slirp_epoll_events));
+		slirp_epoll_nfds = 0;
+#else
+		if (pipe(slirp_wakeup_fds) < 0)
+			return false;
+		fcntl(slirp_wakeup_fds[0], F_SETFL, O_NONBLOCK);
+		fcntl(slirp_wakeup_fds[1], F_SETFL, O_NONBLOCK);
+#endif
 
 		// Set up port redirects
 		slirp_add_redirs();
@@ -300,9 +453,42 @@ bool ether_init(void)
 #endif
 
 	if(net_if_type == NET_IF_AMQP) {
+		amqp_routing = PrefsFindBool("amqprouting");
 		amqp_connection = amqp_queue_connect(name);
 		if(amqp_connection == 0)
 			return false;
+
+		// Pick a random locally administered Ethernet address, the server routes unicast packets by it
+		int rnd = open("/dev/urandom", O_RDONLY);
+		if (rnd < 0 || read(rnd, ether_addr, 6) != 6) {
+			srand(time(NULL) ^ getpid());
+			for (int i=0; i<6; i++)
+				ether_addr[i] = rand() >> 8;
+		}
+		if (rnd >= 0)
+			close(rnd);
+		ether_addr[0] = (ether_addr[0] & 0xfc) | 0x02;
+		D(bug("Ethernet address %02x %02x %02x %02x %02x %02x\n", ether_addr[0], ether_addr[1], ether_addr[2], ether_addr[3], ether_addr[4], ether_addr[5]));
+
+		// Put publishing channel in confirm mode if requested
+		amqp_transient = PrefsFindBool("amqptransient");
+		amqp_confirm = PrefsFindBool("amqpconfirm");
+		if (amqp_confirm) {
+			amqp_confirm_select(amqp_connection, 1);
+			if (amqp_check_status(amqp_get_rpc_reply(amqp_connection), "amqp_confirm_select") == false)
+				amqp_confirm = false;
+		}
+
+		// Start packet sender thread, it owns amqp_connection from now on
+		amqp_tx_head = amqp_tx_tail = 0;
+		amqp_tx_quit = false;
+		amqp_published = amqp_confirmed = 0;
+		amqp_send_thread_active = (pthread_create(&amqp_send_thread, NULL, amqp_send_func, NULL) == 0);
+		if (!amqp_send_thread_active) {
+			printf("WARNING: Cannot start AMQP sender thread\n");
+			return false;
+		}
+
 		// Start packet reception thread
 		if (!start_thread())
 			goto open_error;
@@ -375,21 +561,23 @@ bool ether_init(void)
 #endif
 
 	// Set nonblocking I/O
+	if (net_if_type != NET_IF_SLIRP) {
 #ifdef USE_FIONBIO
-	int nonblock = 1;
-	if (ioctl(fd, FIONBIO, &nonblock) < 0) {
-		sprintf(str, GetString(STR_BLOCKING_NET_SOCKET_WARN), strerror(errno));
-		WarningAlert(str);
-		goto open_error;
-	}
+		int nonblock = 1;
+		if (ioctl(fd, FIONBIO, &nonblock) < 0) {
+			sprintf(str, GetString(STR_BLOCKING_NET_SOCKET_WARN), strerror(errno));
+			WarningAlert(str);
+			goto open_error;
+		}
 #else
-	val = fcntl(fd, F_GETFL, 0);
-	if (val < 0 || fcntl(fd, F_SETFL, val | O_NONBLOCK) < 0) {
-		sprintf(str, GetString(STR_BLOCKING_NET_SOCKET_WARN), strerror(errno));
-		WarningAlert(str);
-		goto open_error;
-	}
+		val = fcntl(fd, F_GETFL, 0);
+		if (val < 0 || fcntl(fd, F_SETFL, val | O_NONBLOCK) < 0) {
+			sprintf(str, GetString(STR_BLOCKING_NET_SOCKET_WARN), strerror(errno));
+			WarningAlert(str);
+			goto open_error;
+		}
 #endif
+	}
 
 	// Get Ethernet address
 	if (net_if_type == NET_IF_ETHERTAP || net_if_type == NET_IF_TUNTAP) {
@@ -427,18 +615,7 @@ open_error:
 		close(fd);
 		fd = -1;
 	}
-	if (slirp_input_fds[0] >= 0) {
-		close(slirp_input_fds[0]);
-		slirp_input_fds[0] = -1;
-	}
-	if (slirp_input_fds[1] >= 0) {
-		close(slirp_input_fds[1]);
-		slirp_input_fds[1] = -1;
-	}
-	if (slirp_output_fd >= 0) {
-		close(slirp_output_fd);
-		slirp_output_fd = -1;
-	}
+	close_slirp_wakeup();
 	return false;
 }
 
@@ -464,17 +641,21 @@ void ether_exit(void)
 	if (fd > 0)
 		close(fd);
 
-	// Close slirp input buffer
-	if (slirp_input_fds[0] >= 0)
-		close(slirp_input_fds[0]);
-	if (slirp_input_fds[1] >= 0)
-		close(slirp_input_fds[1]);
-
-	// Close slirp output buffer
-	if (slirp_output_fd > 0)
-		close(slirp_output_fd);
+	// Close slirp thread wakeup channel
+	close_slirp_wakeup();
 
 	if(net_if_type == NET_IF_AMQP) {
+		// Stop sender thread after it has published the pending frames
+		if (amqp_send_thread_active) {
+			pthread_mutex_lock(&amqp_tx_lock);
+			amqp_tx_quit = true;
+			pthread_cond_signal(&amqp_tx_cond);
+			pthread_mutex_unlock(&amqp_tx_lock);
+			pthread_join(amqp_send_thread, NULL);
+			amqp_send_thread_active = false;
+		}
+		D(bug("%u AMQP messages rejected by server\n", amqp_nacked));
+
 		if(amqp_connection != 0) {
 			amqp_queue_disconnect(amqp_connection);
 			amqp_connection = 0;
@@ -591,10 +772,7 @@ void EtherIRQ(void)
 	OTEnterInterrupt();
 	ether_do_interrupt();
 	OTLeaveInterrupt();
-
-	// Acknowledge interrupt to reception thread
 	D(bug(" EtherIRQ done\n"));
-	sem_post(&int_ack);
 }
 #else
 // Add multicast address
@@ -657,10 +835,7 @@ void EtherInterrupt(void)
 {
 	D(bug("EtherIRQ\n"));
 	ether_do_interrupt();
-
-	// Acknowledge interrupt to reception thread
 	D(bug(" EtherIRQ done\n"));
-	sem_post(&int_ack);
 }
 #endif
 
@@ -773,22 +948,36 @@ static int16 ether_do_write(uint32 arg)
 	// Transmit packet
 #ifdef HAVE_SLIRP
 	if (net_if_type == NET_IF_SLIRP) {
-		const int slirp_input_fd = slirp_input_fds[1];
-		write(slirp_input_fd, &len, sizeof(len));
-		write(slirp_input_fd, packet, len);
+		const uint32 head = slirp_tx_head;
+		if (head - slirp_tx_tail >= ETHER_RING_SIZE)
+			return excessCollsns;
+		ether_frame *f = &slirp_tx_ring[head & (ETHER_RING_SIZE - 1)];
+		memcpy(f->data, packet, len);
+		f->length = len;
+		__sync_synchronize();
+		slirp_tx_head = head + 1;
+		__sync_synchronize();
+
+		// Wake up slirp thread if it may have found the queue empty
+		if (slirp_tx_tail == head)
+			slirp_wakeup();
 		return noErr;
 	} else
 #endif
 	if(net_if_type == NET_IF_AMQP) {
-		amqp_basic_properties_t props;
-		props._flags = AMQP_BASIC_CONTENT_TYPE_FLAG | AMQP_BASIC_DELIVERY_MODE_FLAG;
-		props.content_type = amqp_cstring_bytes("application/x-appletalk-packet");
-		props.delivery_mode = 2; /* persistent delivery mode */
-		amqp_bytes_t messageBody;
-		messageBody.len = len;
-		messageBody.bytes = packet;
-		if(amqp_basic_publish(amqp_connection, 1, amqp_cstring_bytes(amqp_exchange), amqp_cstring_bytes("basilisk_ii"), 0, 0, &props, messageBody) < 0)
-			WarningAlert("Unable to publish packet to AMQP server");
+		// Hand packet over to the sender thread
+		pthread_mutex_lock(&amqp_tx_lock);
+		if (amqp_tx_head - amqp_tx_tail >= AMQP_TX_QUEUE_SIZE) {
+			pthread_mutex_unlock(&amqp_tx_lock);
+			D(bug("WARNING: AMQP send queue full\n"));
+			return excessCollsns;
+		}
+		amqp_tx_frame *f = &amqp_tx_queue[amqp_tx_head & (AMQP_TX_QUEUE_SIZE - 1)];
+		memcpy(f->data, packet, len);
+		f->length = len;
+		if (amqp_tx_head++ == amqp_tx_tail)
+			pthread_cond_signal(&amqp_tx_cond);
+		pthread_mutex_unlock(&amqp_tx_lock);
 		return noErr;
 	} else
 	if (write(fd, packet, len) < 0) {
@@ -829,40 +1018,99 @@ void ether_stop_udp_thread(void)
 #ifdef HAVE_SLIRP
 int slirp_can_output(void)
 {
-	return 1;
+	// Let slirp keep packets queued while the ring is full
+	return !ring_full();
 }
 
 void slirp_output(const uint8 *packet, int len)
 {
-	write(slirp_output_fd, packet, len);
+	if (!ether_driver_opened || ring_full() || len < 14 || len > 1514)
+		return;
+	ether_frame *f = ring_reserve();
+	memcpy(f->data, packet, len);
+	f->length = len;
+	ring_commit();
 }
 
-void *slirp_receive_func(void *arg)
+int slirp_closesocket(int s)
 {
-	const int slirp_input_fd = slirp_input_fds[0];
+#if USE_EPOLL
+	// The socket number may be reused right away, forget its registration
+	if (s >= 0 && s < FD_SETSIZE && slirp_epoll_events[s]) {
+		epoll_ctl(slirp_epoll_fd, EPOLL_CTL_DEL, s, NULL);
+		slirp_epoll_events[s] = 0;
+	}
+#endif
+	return close(s);
+}
 
-	for (;;) {
-		// Wait for packets to arrive
-		fd_set rfds, wfds, xfds;
-		int nfds;
-		struct timeval tv;
+// Feed packets queued by ether_do_write() to slirp
+static void slirp_drain_tx(void)
+{
+	// Reset wakeup channel before looking at the queue, so no wakeup is lost
+#if USE_EPOLL
+	uint64 count;
+	read(slirp_wakeup_fds[0], &count, sizeof(count));
+#else
+	uint8 buf[64];
+	while (read(slirp_wakeup_fds[0], buf, sizeof(buf)) > 0) ;
+#endif
+	__sync_synchronize();
+
+	while (slirp_tx_tail != slirp_tx_head) {
+		__sync_synchronize();
+		ether_frame *f = &slirp_tx_ring[slirp_tx_tail & (ETHER_RING_SIZE - 1)];
+		slirp_input(f->data, f->length);
+		__sync_synchronize();
+		slirp_tx_tail = slirp_tx_tail + 1;
+		__sync_synchronize();
+	}
+}
 
-		// ... in the input queue
-		FD_ZERO(&rfds);
-		FD_SET(slirp_input_fd, &rfds);
-		tv.tv_sec = 0;
-		tv.tv_usec = 0;
-		if (select(slirp_input_fd + 1, &rfds, NULL, NULL, &tv) > 0) {
-			int len;
-			read(slirp_input_fd, &len, sizeof(len));
-			uint8 packet[1516];
-			assert(len <= sizeof(packet));
-			read(slirp_input_fd, packet, len);
-			slirp_input(packet, len);
+#if USE_EPOLL
+// Bring the epoll set in line with the sockets slirp wants to watch
+static void slirp_epoll_update(int nfds, fd_set *rfds, fd_set *wfds, fd_set *xfds)
+{
+	const int n = nfds > slirp_epoll_nfds ? nfds : slirp_epoll_nfds;
+	for (int s = 0; s < n; s++) {
+		uint8 events = 0;
+		if (s < nfds) {
+			if (FD_ISSET(s, rfds))
+				events |= EPOLLIN;
+			if (FD_ISSET(s, wfds))
+				events |= EPOLLOUT;
+			if (FD_ISSET(s, xfds))
+				events |= EPOLLPRI;
+		}
+		if (events == slirp_epoll_events[s])
+			continue;
+
+		struct epoll_event ev;
+		ev.events = events;
+		ev.data.fd = s;
+		if (events == 0)
+			epoll_ctl(slirp_epoll_fd, EPOLL_CTL_DEL, s, NULL);
+		else if (slirp_epoll_events[s] == 0) {
+			if (epoll_ctl(slirp_epoll_fd, EPOLL_CTL_ADD, s, &ev) < 0 && errno == EEXIST)
+				epoll_ctl(slirp_epoll_fd, EPOLL_CTL_MOD, s, &ev);
+		} else {
+			if (epoll_ctl(slirp_epoll_fd, EPOLL_CTL_MOD, s, &ev) < 0 && errno == ENOENT)
+				epoll_ctl(slirp_epoll_fd, EPOLL_CTL_ADD, s, &ev);
 		}
+		slirp_epoll_events[s] = events;
+	}
+	slirp_epoll_nfds = nfds;
+}
+#endif
 
-		// ... in the output queue
-		nfds = -1;
+void *slirp_receive_func(void *arg)
+{
+	const int slirp_wakeup_fd = slirp_wakeup_fds[0];
+
+	for (;;) {
+		// Get sockets to watch from slirp
+		fd_set rfds, wfds, xfds;
+		int nfds = -1;
 		FD_ZERO(&rfds);
 		FD_ZERO(&wfds);
 		FD_ZERO(&xfds);
@@ -870,9 +1118,52 @@ void *slirp_receive_func(void *arg)
 #if ! USE_SLIRP_TIMEOUT
 		timeout = 10000;
 #endif
+
+		// Wait for packets to arrive, in the input queue or from the network
+		bool wakeup = false;
+#if USE_EPOLL
+		slirp_epoll_update(nfds + 1, &rfds, &wfds, &xfds);
+		struct epoll_event events[64];
+		int n = epoll_wait(slirp_epoll_fd, events, 64, (timeout + 999) / 1000);
+		FD_ZERO(&rfds);
+		FD_ZERO(&wfds);
+		FD_ZERO(&xfds);
+		for (int i = 0; i < n; i++) {
+			const int s = events[i].data.fd;
+			if (s == slirp_wakeup_fd) {
+				wakeup = true;
+				continue;
+			}
+
+			// Errors and hangups wake up select() for reading and writing as well
+			uint32 ready = events[i].events;
+			if (ready & (EPOLLERR | EPOLLHUP))
+				ready |= EPOLLIN | EPOLLOUT;
+			ready &= slirp_epoll_events[s];
+			if (ready & EPOLLIN)
+				FD_SET(s, &rfds);
+			if (ready & EPOLLOUT)
+				FD_SET(s, &wfds);
+			if (ready & EPOLLPRI)
+				FD_SET(s, &xfds);
+		}
+#else
+		FD_SET(slirp_wakeup_fd, &rfds);
+		if (slirp_wakeup_fd > nfds)
+			nfds = slirp_wakeup_fd;
+		struct timeval tv;
 		tv.tv_sec = 0;
 		tv.tv_usec = timeout;
-		if (select(nfds + 1, &rfds, &wfds, &xfds, &tv) >= 0)
+		int n = select(nfds + 1, &rfds, &wfds, &xfds, &tv);
+		if (n > 0 && FD_ISSET(slirp_wakeup_fd, &rfds)) {
+			FD_CLR(slirp_wakeup_fd, &rfds);
+			wakeup = true;
+		}
+#endif
+
+		if (wakeup)
+			slirp_drain_tx();
+		if (n >= 0)
 			slirp_select_poll(&rfds, &wfds, &xfds);
 
 #ifdef HAVE_PTHREAD_TESTCANCEL
@@ -946,7 +1237,9 @@ amqp_connection_state_t amqp_queue_connect(const char *url) {
 	char *hostname = (char*)"localhost";
 	int port = 5671;
 	char *vhost = (char*)"/";
-	char *exchange = (char*)"appleshare";
+	// A fanout exchange can't be declared again as a topic one, so
+	// routing uses an exchange of its own by default
+	char *exchange = (char*)(amqp_routing ? "appleshare.topic" : "appleshare");
 
 	if(strncmp(parsedUrl, "amqps", 5) == 0)
 		useSSL = true;
@@ -1017,7 +1310,7 @@ amqp_connection_state_t amqp_queue_connect(const char *url) {
 		return 0;
 	}
 
-	amqp_exchange_declare(connection, 1, amqp_cstring_bytes(exchange), amqp_cstring_bytes("fanout"), 0, 0, 0, 0, amqp_empty_table);
+	amqp_exchange_declare(connection, 1, amqp_cstring_bytes(exchange), amqp_cstring_bytes(amqp_routing ? "topic" : "fanout"), 0, 0, 0, 0, amqp_empty_table);
 	status = amqp_get_rpc_reply(connection);
 	if(amqp_check_status(status, "amqp_exchange_declare") == false) {
 		amqp_queue_disconnect(connection);
@@ -1042,6 +1335,123 @@ void amqp_queue_disconnect(amqp_connection_state_t connection) {
 }
 
 
+/*
+ *  AMQP routing keys: with "amqprouting", "unicast.<destination>" or
+ *  "multicast.<destination>", and each instance binds its queue to its own
+ *  unicast key and to "multicast.*". Otherwise, packets are published as
+ *  "basilisk_ii" to a fanout exchange, which delivers them to everyone
+ */
+
+static void amqp_routing_key(char *key, const uint8 *dest)
+{
+	if (!amqp_routing)
+		strcpy(key, "basilisk_ii");
+	else
+		sprintf(key, "%s.%02x%02x%02x%02x%02x%02x", (dest[0] & 1) ? "multicast" : "unicast",
+			dest[0], dest[1], dest[2], dest[3], dest[4], dest[5]);
+}
+
+
+/*
+ *  AMQP packet sender thread
+ */
+
+// Read publisher confirms until all published messages are acknowledged
+static bool amqp_wait_confirms(void)
+{
+	while (amqp_confirmed < amqp_published) {
+		amqp_frame_t frame;
+		struct timeval tv = { 1, 0 };
+		int status = amqp_simple_wait_frame_noblock(amqp_connection, &frame, &tv);
+		if (status != AMQP_STATUS_OK) {
+			printf("WARNING: No AMQP publisher confirm received (%d)\n", status);
+			return false;
+		}
+		if (frame.frame_type != AMQP_FRAME_METHOD)
+			continue;
+		switch (frame.payload.method.id) {
+			case AMQP_BASIC_ACK_METHOD: {
+				amqp_basic_ack_t *ack = (amqp_basic_ack_t *)frame.payload.method.decoded;
+				if (ack->delivery_tag > amqp_confirmed)
+					amqp_confirmed = ack->delivery_tag;
+				break;
+			}
+			case AMQP_BASIC_NACK_METHOD: {
+				amqp_basic_nack_t *nack = (amqp_basic_nack_t *)frame.payload.method.decoded;
+				if (nack->delivery_tag > amqp_confirmed) {
+					amqp_nacked += nack->multiple ? uint32(nack->delivery_tag - amqp_confirmed) : 1;
+					amqp_confirmed = nack->delivery_tag;
+				}
+				break;
+			}
+			case AMQP_CHANNEL_CLOSE_METHOD:
+			case AMQP_CONNECTION_CLOSE_METHOD:
+				printf("WARNING: AMQP server closed the publishing channel\n");
+				return false;
+		}
+	}
+	return true;
+}
+
+static void *amqp_send_func(void *arg)
+{
+	amqp_basic_properties_t props;
+	props._flags = AMQP_BASIC_CONTENT_TYPE_FLAG | AMQP_BASIC_DELIVERY_MODE_FLAG;
+	props.content_type = amqp_cstring_bytes("application/x-appletalk-packet");
+	props.delivery_mode = amqp_transient ? 1 : 2; /* transient or persistent delivery mode */
+
+	bool publish_ok = true;
+	for (;;) {
+
+		// Wait for packets to send
+		pthread_mutex_lock(&amqp_tx_lock);
+		while (amqp_tx_head == amqp_tx_tail && !amqp_tx_quit)
+			pthread_cond_wait(&amqp_tx_cond, &amqp_tx_lock);
+		const uint32 tail = amqp_tx_tail, n = amqp_tx_head - tail;
+		pthread_mutex_unlock(&amqp_tx_lock);
+		if (n == 0)
+			break;
+
+		// Publish all queued packets, letting the kernel coalesce them into as few TCP segments as possible
+#ifdef TCP_CORK
+		int sock = amqp_get_sockfd(amqp_connection), on = 1, off = 0;
+		if (n > 1)
+			setsockopt(sock, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+#endif
+		for (uint32 i = 0; i < n; i++) {
+			amqp_tx_frame *f = &amqp_tx_queue[(tail + i) & (AMQP_TX_QUEUE_SIZE - 1)];
+			char key[32];
+			amqp_routing_key(key, f->data);
+			amqp_bytes_t messageBody;
+			messageBody.len = f->length;
+			messageBody.bytes = f->data;
+			if (amqp_basic_publish(amqp_connection, 1, amqp_cstring_bytes(amqp_exchange), amqp_cstring_bytes(key), 0, 0, &props, messageBody) < 0) {
+				if (publish_ok)
+					printf("WARNING: Unable to publish packet to AMQP server\n");
+				publish_ok = false;
+			} else {
+				publish_ok = true;
+				amqp_published++;
+			}
+		}
+#ifdef TCP_CORK
+		if (n > 1)
+			setsockopt(sock, IPPROTO_TCP, TCP_CORK, &off, sizeof(off));
+#endif
+
+		// Don't let the server fall behind by more than one batch
+		if (amqp_confirm && !amqp_wait_confirms())
+			amqp_confirmed = amqp_published;
+
+		// Release slots to ether_do_write()
+		pthread_mutex_lock(&amqp_tx_lock);
+		amqp_tx_tail = tail + n;
+		pthread_mutex_unlock(&amqp_tx_lock);
+	}
+	return NULL;
+}
+
+
 /*
  *  Packet reception thread
  */
@@ -1049,6 +1459,7 @@ void amqp_queue_disconnect(amqp_connection_state_t connection) {
 static void *receive_func(void *arg)
 {
 	amqp_connection_state_t readQueue = 0;
+	amqp_envelope_t amqp_envelope;
 	if(net_if_type == NET_IF_AMQP) {
 		readQueue = amqp_queue_connect(PrefsFindString("ether"));
 		if(readQueue == 0)
@@ -1069,12 +1480,26 @@ static void *receive_func(void *arg)
 
 		D(bug("Listening for message on queue: %.*s\n", (int)queueName.len, queueName.bytes));
 
-		amqp_queue_bind(readQueue, 1, queueName, amqp_cstring_bytes(amqp_exchange), amqp_cstring_bytes("*"), amqp_empty_table);
+		// Let the server deliver only packets addressed to us, and broadcasts/multicasts
+		char key[32];
+		if (amqp_routing)
+			amqp_routing_key(key, ether_addr);
+		else
+			strcpy(key, "*");
+		amqp_queue_bind(readQueue, 1, queueName, amqp_cstring_bytes(amqp_exchange), amqp_cstring_bytes(key), amqp_empty_table);
 		status = amqp_get_rpc_reply(readQueue);
 		if(amqp_check_status(status, "amqp_queue_bind") == false) {
 			amqp_queue_disconnect(readQueue);
 			return 0;
 		}
+		if (amqp_routing) {
+			amqp_queue_bind(readQueue, 1, queueName, amqp_cstring_bytes(amqp_exchange), amqp_cstring_bytes("multicast.*"), amqp_empty_table);
+			status = amqp_get_rpc_reply(readQueue);
+			if(amqp_check_status(status, "amqp_queue_bind") == false) {
+				amqp_queue_disconnect(readQueue);
+				return 0;
+			}
+		}
 
 		amqp_basic_consume(readQueue, 1, queueName, amqp_empty_bytes, 0, 1, 0, amqp_empty_table);
 		status = amqp_get_rpc_reply(readQueue);
@@ -1082,8 +1507,6 @@ static void *receive_func(void *arg)
 			amqp_queue_disconnect(readQueue);
 			return 0;
 		}
-
-		amqp_envelope = (amqp_envelope_t*)malloc(sizeof(amqp_envelope_t));
 	}
 
 	for (;;) {
@@ -1091,49 +1514,77 @@ static void *receive_func(void *arg)
 		if(net_if_type == NET_IF_AMQP && readQueue != 0) {
 			amqp_maybe_release_buffers(readQueue);
 
-			amqp_rpc_reply_t res = amqp_consume_message(readQueue, amqp_envelope, 0, 0);
+			amqp_rpc_reply_t res = amqp_consume_message(readQueue, &amqp_envelope, 0, 0);
 			if (AMQP_RESPONSE_NORMAL != res.reply_type) {
 				printf("AMQP error\n");
 				break;
 			}
 
-			if(strncmp((char*)amqp_envelope->routing_key.bytes, "basilisk_ii", amqp_envelope->routing_key.len) == 0) {
-				amqp_destroy_envelope(amqp_envelope);
-				continue;
+			// Copy the message body to the ring, so the envelope can be released right away
+			// (our own packets come back from the server and are dropped here)
+			size_t length = amqp_envelope.message.body.len;
+			const uint8 *body = (const uint8 *)amqp_envelope.message.body.bytes;
+			bool own_packet;
+			if (amqp_routing)
+				own_packet = (length >= 12 && memcmp(body + 6, ether_addr, 6) == 0);
+			else
+				own_packet = (strncmp((char*)amqp_envelope.routing_key.bytes, "basilisk_ii", amqp_envelope.routing_key.len) == 0);
+			if (ether_driver_opened && length >= 14 && length <= 1514 && !own_packet) {
+				ether_frame *f = ring_reserve();
+				memcpy(f->data, body, length);
+				f->length = length;
+				ring_commit();
 			}
-		} else {
-			// Wait for packets to arrive
+			amqp_destroy_envelope(&amqp_envelope);
+			continue;
+		}
+
+		// Wait for packets to arrive
 #if USE_POLL
-			struct pollfd pf = {fd, POLLIN, 0};
-			int res = poll(&pf, 1, -1);
+		struct pollfd pf = {fd, POLLIN, 0};
+		int res = poll(&pf, 1, -1);
 #else
-			fd_set rfds;
-			FD_ZERO(&rfds);
-			FD_SET(fd, &rfds);
-			// A NULL timeout could cause select() to block indefinitely,
-			// even if it is supposed to be a cancellation point [MacOS X]
-			struct timeval tv = { 0, 20000 };
-			int res = select(fd + 1, &rfds, NULL, NULL, &tv);
+		fd_set rfds;
+		FD_ZERO(&rfds);
+		FD_SET(fd, &rfds);
+		// A NULL timeout could cause select() to block indefinitely,
+		// even if it is supposed to be a cancellation point [MacOS X]
+		struct timeval tv = { 0, 20000 };
+		int res = select(fd + 1, &rfds, NULL, NULL, &tv);
 #ifdef HAVE_PTHREAD_TESTCANCEL
-			pthread_testcancel();
+		pthread_testcancel();
 #endif
-			if (res == 0 || (res == -1 && errno == EINTR))
-				continue;
+		if (res == 0 || (res == -1 && errno == EINTR))
+			continue;
 #endif
-			if (res <= 0)
-				break;
-		}
-
-		if (ether_driver_opened) {
-			// Trigger Ethernet interrupt
-			D(bug(" packet received, triggering Ethernet interrupt\n"));
-			SetInterruptFlag(INTFLAG_ETHER);
-			TriggerInterrupt();
+		if (res <= 0)
+			break;
 
-			// Wait for interrupt acknowledge by EtherInterrupt()
-			sem_wait(&int_ack);
-		} else
+		if (!ether_driver_opened) {
 			Delay_usec(20000);
+			continue;
+		}
+
+		// Move all pending packets to the ring, the fd is non-blocking
+		for (;;) {
+			ether_frame *f = ring_reserve();
+			ssize_t length;
+#ifndef SHEEPSHAVER
+			if (udp_tunnel) {
+				socklen_t from_len = sizeof(f->from);
+				length = recvfrom(fd, f->data, 1514, 0, (struct sockaddr *)&f->from, &from_len);
+			} else
+#endif
+#if defined(__linux__)
+			length = read(fd, f->data, net_if_type == NET_IF_ETHERTAP ? 1516 : 1514);
+#else
+			length = read(fd, f->data, 1514);
+#endif
+			if (length < 14)
+				break;
+			f->length = length;
+			ring_commit();
+		}
 	}
 
 	if(readQueue != 0) {
@@ -1141,11 +1592,6 @@ static void *receive_func(void *arg)
 		readQueue = 0;
 	}
 
-	if(amqp_envelope != 0) {
-		free(amqp_envelope);
-		amqp_envelope = 0;
-	}
-
 	return NULL;
 }
 
@@ -1156,42 +1602,27 @@ static void *receive_func(void *arg)
 
 void ether_do_interrupt(void)
 {
-	// Call protocol handler for received packets
+	// Packets committed after this point trigger a new interrupt
+	ring_irq_pending = 0;
+	__sync_synchronize();
+	const uint32 head = ring_head;
+	__sync_synchronize();
+
+	// Call protocol handler for all received packets
 	EthernetPacket ether_packet;
 	uint32 packet = ether_packet.addr();
-	ssize_t length;
-	for (;;) {
+	while (ring_tail != head) {
+		ether_frame *f = &ether_ring[ring_tail & (ETHER_RING_SIZE - 1)];
+		uint32 length = f->length;
+		memcpy(Mac2HostAddr(packet), f->data, length);
 
 #ifndef SHEEPSHAVER
-		if (udp_tunnel) {
-
-			// Read packet from socket
-			struct sockaddr_in from;
-			socklen_t from_len = sizeof(from);
-			length = recvfrom(fd, Mac2HostAddr(packet), 1514, 0, (struct sockaddr *)&from, &from_len);
-			if (length < 14)
-				break;
-			ether_udp_read(packet, length, &from);
-
-		} else
+		if (udp_tunnel)
+			ether_udp_read(packet, length, &f->from);
+		else
 #endif
-		if(net_if_type == NET_IF_AMQP && amqp_envelope->message.body.len <= 1514) {
-			memcpy(Mac2HostAddr(packet), amqp_envelope->message.body.bytes, amqp_envelope->message.body.len);
-			ether_dispatch_packet(packet, amqp_envelope->message.body.len);
-			amqp_destroy_envelope(amqp_envelope);
-			break;
-		} else
 		{
 
-			// Read packet from sheep_net device
-#if defined(__linux__)
-			length = read(fd, Mac2HostAddr(packet), net_if_type == NET_IF_ETHERTAP ? 1516 : 1514);
-#else
-			length = read(fd, Mac2HostAddr(packet), 1514);
-#endif
-			if (length < 14)
-				break;
-
 #if MONITOR
 			bug("Receiving Ethernet packet:\n");
 			for (int i=0; i<length; i++) {
@@ -1212,6 +1643,17 @@ void ether_do_interrupt(void)
 			// Dispatch packet
 			ether_dispatch_packet(p, length);
 		}
+
+		// Release slot to the reception thread
+		__sync_synchronize();
+		ring_tail = ring_tail + 1;
+	}
+
+	// Wake up reception thread if it waits for free slots
+	__sync_synchronize();
+	if (ring_waiting) {
+		ring_waiting = 0;
+		sem_post(&int_ack);
 	}
 }
 
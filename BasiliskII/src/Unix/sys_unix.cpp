@@ -759,13 +759,10 @@ size_t Sys_read(void *arg, void *buffer, loff_t offset, size_t length)
 
 	if (fh->generic_disk)
 		return fh->generic_disk->read(buffer, offset, length);
-	
-	// Seek to position
-	if (lseek(fh->fd, offset + fh->start_byte, SEEK_SET) < 0)
-		return 0;
 
-	// Read data
-	return read(fh->fd, buffer, length);
+	// Read data (positional, no separate seek)
+	ssize_t actual = pread(fh->fd, buffer, length, offset + fh->start_byte);
+	return actual < 0 ? 0 : actual;
 }
 
 
@@ -783,12 +780,9 @@ size_t Sys_write(void *arg, void *buffer, loff_t offset, size_t length)
 	if (fh->generic_disk)
 		return fh->generic_disk->write(buffer, offset, length);
 
-	// Seek to position
-	if (lseek(fh->fd, offset + fh->start_byte, SEEK_SET) < 0)
-		return 0;
-
-	// Write data
-	return write(fh->fd, buffer, length);
+	// Write data (positional, no separate seek)
+	ssize_t actual = pwrite(fh->fd, buffer, length, offset + fh->start_byte);
+	return actual < 0 ? 0 : actual;
 }
 
 
@@ -591,11 +591,16 @@ static void *vm_acquire_framebuffer(uint32 size)
 	// always try to allocate framebuffer at the same address
 	static void *fb = VM_MAP_FAILED;
 	if (fb != VM_MAP_FAILED) {
-		if (vm_acquire_fixed(fb, size) < 0)
+		if (vm_acquire_fixed(fb, size, VM_MAP_DEFAULT | VM_MAP_WRITE_WATCH) < 0 &&
+			vm_acquire_fixed(fb, size) < 0)
 			fb = VM_MAP_FAILED;
 	}
-	if (fb == VM_MAP_FAILED)
-		fb = vm_acquire(size, VM_MAP_DEFAULT | VM_MAP_32BIT);
+	if (fb == VM_MAP_FAILED) {
+		// let the host track writes to the frame buffer if it can
+		fb = vm_acquire(size, VM_MAP_DEFAULT | VM_MAP_32BIT | VM_MAP_WRITE_WATCH);
+		if (fb == VM_MAP_FAILED)
+			fb = vm_acquire(size, VM_MAP_DEFAULT | VM_MAP_32BIT);
+	}
 	return fb;
 }
 
@@ -2618,7 +2623,7 @@ static void video_refresh_dga_vosf(void)
 	static int tick_counter = 0;
 	if (++tick_counter >= frame_skip) {
 		tick_counter = 0;
-		if (mainBuffer.dirty) {
+		if (video_vosf_dirty()) {
 			LOCK_VOSF;
 			update_display_dga_vosf(static_cast<driver_dga *>(drv));
 			UNLOCK_VOSF;
@@ -2636,7 +2641,7 @@ static void video_refresh_window_vosf(void)
 	static int tick_counter = 0;
 	if (++tick_counter >= frame_skip) {
 		tick_counter = 0;
-		if (mainBuffer.dirty) {
+		if (video_vosf_dirty()) {
 			XDisplayLock();
 			LOCK_VOSF;
 			update_display_window_vosf(static_cast<driver_window *>(drv));
@@ -97,6 +97,126 @@ uint32 DiskIconAddr;
 static bool acc_run_called = false;
 
 
+/*
+ *  Asynchronous Prime() support
+ *
+ *  Queued asynchronous requests (PBReadAsync/PBWriteAsync) are handed to
+ *  a worker thread and Prime() returns at once with the request still in
+ *  progress. When the transfer is done, the worker raises INTFLAG_DISK and
+ *  DiskIOInterrupt() fills in the ParamBlock and activates a Deferred Task
+ *  that calls IODone, as the serial drivers do. The Device Manager only
+ *  hands us one queued request at a time, so a single worker suffices.
+ */
+
+#ifdef HAVE_PTHREADS
+#define DISK_ASYNC 1
+#endif
+
+#if DISK_ASYNC
+// Deferred Task used to call IODone
+enum {
+	diskdtCode = 20,	// DT code is stored here
+	diskdtResult = 30,
+	diskdtDCE = 34,
+	SIZEOF_diskdt = 38
+};
+
+struct disk_request {
+	uint32 pb, dce;		// ParamBlock and DCE of request (Mac addresses)
+	void *fh;			// File handle
+	void *buffer;		// Host address of data
+	loff_t offset;		// Offset in file
+	size_t length;		// Bytes to transfer
+	bool write;			// Flag: write request
+	int16 result;		// Result code (set by worker)
+	size_t actual;		// Bytes transferred (set by worker)
+};
+
+static bool async_enabled = false;			// Flag: async mode active
+static uint32 disk_dt = 0;					// Deferred Task (Mac address)
+static disk_request the_request;			// Current request
+static volatile bool request_pending = false;	// Flag: request handed to worker
+static volatile bool request_done = false;		// Flag: worker finished request
+static bool worker_quit = false;			// Flag: worker should exit
+static pthread_t worker_thread;
+static pthread_mutex_t worker_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t worker_wakeup = PTHREAD_COND_INITIALIZER;	// New request or quit
+static pthread_cond_t worker_idle = PTHREAD_COND_INITIALIZER;	// Request done
+
+
+/*
+ *  Worker thread, performs one request at a time
+ */
+
+static void *disk_worker(void *arg)
+{
+	pthread_mutex_lock(&worker_lock);
+	for (;;) {
+		while (!worker_quit && !(request_pending && !request_done))
+			pthread_cond_wait(&worker_wakeup, &worker_lock);
+		if (worker_quit)
+			break;
+		pthread_mutex_unlock(&worker_lock);
+
+		disk_request &req = the_request;
+		if (req.write) {
+			req.actual = Sys_write(req.fh, req.buffer, req.offset, req.length);
+			req.result = req.actual == req.length ? noErr : writErr;
+		} else {
+			req.actual = Sys_read(req.fh, req.buffer, req.offset, req.length);
+			req.result = req.actual == req.length ? noErr : readErr;
+		}
+
+		pthread_mutex_lock(&worker_lock);
+		request_done = true;
+		pthread_cond_broadcast(&worker_idle);
+		SetInterruptFlag(INTFLAG_DISK);
+		TriggerInterrupt();
+	}
+	pthread_mutex_unlock(&worker_lock);
+	return NULL;
+}
+
+
+/*
+ *  Wait until the worker has finished the current request (if any)
+ */
+
+static void wait_request_done(void)
+{
+	if (!request_pending)
+		return;
+	pthread_mutex_lock(&worker_lock);
+	while (!request_done)
+		pthread_cond_wait(&worker_idle, &worker_lock);
+	pthread_mutex_unlock(&worker_lock);
+}
+
+
+/*
+ *  Complete a finished request: update ParamBlock and DCE, and
+ *  activate the Deferred Task to call IODone
+ */
+
+static void complete_request(void)
+{
+	const disk_request &req = the_request;
+	if (req.result == noErr) {
+		WriteMacInt32(req.pb + ioActCount, req.actual);
+		WriteMacInt32(req.dce + dCtlPosition, ReadMacInt32(req.dce + dCtlPosition) + req.actual);
+	}
+	WriteMacInt32(disk_dt + diskdtResult, req.result);
+	WriteMacInt32(disk_dt + diskdtDCE, req.dce);
+	request_pending = request_done = false;
+#ifdef SHEEPSHAVER
+	Enqueue(disk_dt, 0xd92);
+#else
+	EnqueueMac(disk_dt, 0xd92);
+#endif
+}
+#endif
+
+
 /*
  *  Get pointer to drive info or drives.end() if not found
  */
@@ -168,6 +288,15 @@ void DiskInit(void)
 		if (fh)
 			drives.push_back(disk_drive_info(fh, SysIsReadOnly(fh)));
 	}
+
+#if DISK_ASYNC
+	// Start worker thread for asynchronous requests
+	if (PrefsFindBool("diskasync") && !drives.empty()) {
+		worker_quit = false;
+		async_enabled = pthread_create(&worker_thread, NULL, disk_worker, NULL) == 0;
+		D(bug("DiskInit async mode %s\n", async_enabled ? "enabled" : "failed"));
+	}
+#endif
 }
 
 
@@ -177,6 +306,20 @@ void DiskInit(void)
 
 void DiskExit(void)
 {
+#if DISK_ASYNC
+	// Stop worker thread
+	if (async_enabled) {
+		wait_request_done();
+		pthread_mutex_lock(&worker_lock);
+		worker_quit = true;
+		pthread_cond_signal(&worker_wakeup);
+		pthread_mutex_unlock(&worker_lock);
+		pthread_join(worker_thread, NULL);
+		async_enabled = false;
+		request_pending = request_done = false;
+	}
+#endif
+
 	drive_vec::iterator info, end = drives.end();
 	for (info = drives.begin(); info != end; ++info)
 		info->close_fh();
@@ -254,6 +397,30 @@ int16 DiskOpen(uint32 pb, uint32 dce)
 	WriteMacInt32(dce + dCtlPosition, 0);
 	acc_run_called = false;
 
+#if DISK_ASYNC
+	// Allocate Deferred Task structure for asynchronous requests
+	// (a request of the previous session is dropped on reset)
+	if (async_enabled) {
+		wait_request_done();
+		request_pending = request_done = false;
+		M68kRegisters r;
+		r.d[0] = SIZEOF_diskdt;
+		Execute68kTrap(0xa71e, &r);		// NewPtrSysClear()
+		disk_dt = r.a[0];
+		D(bug(" disk_dt %08lx\n", disk_dt));
+		if (disk_dt) {
+			WriteMacInt16(disk_dt + qType, dtQType);
+			WriteMacInt32(disk_dt + dtAddr, disk_dt + diskdtCode);
+			WriteMacInt32(disk_dt + dtParam, disk_dt + diskdtResult);
+															// Deferred function for signalling that Prime is complete (pointer to diskdtResult in a1)
+			WriteMacInt16(disk_dt + diskdtCode, 0x2019);			// move.l	(a1)+,d0	(result)
+			WriteMacInt16(disk_dt + diskdtCode + 2, 0x2251);		// move.l	(a1),a1		(dce)
+			WriteMacInt32(disk_dt + diskdtCode + 4, 0x207808fc);	// move.l	JIODone,a0
+			WriteMacInt16(disk_dt + diskdtCode + 8, 0x4ed0);		// jmp		(a0)
+		}
+	}
+#endif
+
 	// Install drives
 	drive_vec::iterator info, end = drives.end();
 	for (info = drives.begin(); info != end; ++info) {
@@ -329,9 +496,40 @@ int16 DiskPrime(uint32 pb, uint32 dce)
 		position = ((loff_t)ReadMacInt32(pb + ioWPosOffset) << 32) | ReadMacInt32(pb + ioWPosOffset + 4);
 	if ((length & 0x1ff) || (position & 0x1ff))
 		return paramErr;
+	bool write = (ReadMacInt16(pb + ioTrap) & 0xff) != aRdCmd;
+	if (write && info->read_only)
+		return wPrErr;
+
+#if DISK_ASYNC
+	if (async_enabled) {
+
+		// Queued asynchronous request? Then hand it to the worker and
+		// return "in progress", IODone is called by DiskIOInterrupt()
+		uint16 trap = ReadMacInt16(pb + ioTrap);
+		if ((trap & 0x0600) == 0x0400 && disk_dt && !request_pending) {
+			disk_request &req = the_request;
+			req.pb = pb;
+			req.dce = dce;
+			req.fh = info->fh;
+			req.buffer = buffer;
+			req.offset = position + info->start_byte;
+			req.length = length;
+			req.write = write;
+			pthread_mutex_lock(&worker_lock);
+			request_pending = true;
+			request_done = false;
+			pthread_cond_signal(&worker_wakeup);
+			pthread_mutex_unlock(&worker_lock);
+			return 1;
+		}
+
+		// Synchronous or immediate request, don't race with the worker
+		wait_request_done();
+	}
+#endif
 
 	size_t actual = 0;
-	if ((ReadMacInt16(pb + ioTrap) & 0xff) == aRdCmd) {
+	if (!write) {
 
 		// Read
 		actual = Sys_read(info->fh, buffer, position + info->start_byte, length);
@@ -341,8 +539,6 @@ int16 DiskPrime(uint32 pb, uint32 dce)
 	} else {
 
 		// Write
-		if (info->read_only)
-			return wPrErr;
 		actual = Sys_write(info->fh, buffer, position + info->start_byte, length);
 		if (actual != length)
 			return writErr;
@@ -367,6 +563,14 @@ int16 DiskControl(uint32 pb, uint32 dce)
 	// General codes
 	switch (code) {
 		case 1:		// KillIO
+#if DISK_ASYNC
+			// The Device Manager completes the killed request itself, so
+			// wait for the transfer to finish and don't call IODone for it
+			if (async_enabled && request_pending) {
+				wait_request_done();
+				request_pending = request_done = false;
+			}
+#endif
 			return noErr;
 
 		case 65: {	// Periodic action (accRun, "insert" disks on startup)
@@ -399,6 +603,10 @@ int16 DiskControl(uint32 pb, uint32 dce)
 				return offLinErr;
 
 		case 7:		// Eject disk
+#if DISK_ASYNC
+			if (async_enabled)
+				wait_request_done();
+#endif
 			if (ReadMacInt8(info->status + dsDiskInPlace) == 8) {
 				// Fixed disk, re-insert
 				M68kRegisters r;
@@ -469,6 +677,12 @@ int16 DiskStatus(uint32 pb, uint32 dce)
 					WriteMacInt32(pb + csParam + 4, EMULATOR_ID_4);
 					break;
 				case FOURCC('s','y','n','c'):	// Only synchronous operation?
+#if DISK_ASYNC
+					if (async_enabled) {
+						WriteMacInt32(pb + csParam + 4, 0);
+						break;
+					}
+#endif
 					WriteMacInt32(pb + csParam + 4, 0x01000000);
 					break;
 				case FOURCC('b','o','o','t'):	// Boot ID
@@ -544,3 +758,18 @@ void DiskInterrupt(void)
 
 	mount_mountable_volumes();
 }
+
+
+/*
+ *  Disk I/O interrupt - asynchronous Prime completed, activate Deferred Task to call IODone
+ */
+
+void DiskIOInterrupt(void)
+{
+	D(bug("DiskIOInterrupt\n"));
+
+#if DISK_ASYNC
+	if (async_enabled && request_pending && request_done)
+		complete_request();
+#endif
+}
@@ -486,6 +486,11 @@ void EmulOp(uint16 opcode, M68kRegisters *r)
 				EtherInterrupt();
 			}
 
+			if (InterruptFlags & INTFLAG_DISK) {
+				ClearInterruptFlag(INTFLAG_DISK);
+				DiskIOInterrupt();
+			}
+
 			if (InterruptFlags & INTFLAG_AUDIO) {
 				ClearInterruptFlag(INTFLAG_AUDIO);
 				AudioInterrupt();
@@ -42,6 +42,16 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <time.h>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#ifndef NO_STD_NAMESPACE
+using std::vector;
+using std::string;
+#endif
 
 #ifndef WIN32
 #include <unistd.h>
@@ -155,6 +165,9 @@ const uint8 ExtFSIcon[256] = {
 // These objects are used to map CNIDs to path names
 struct FSItem {
 	FSItem *next;			// Pointer to next FSItem in list
+	FSItem *id_next;		// Pointer to next FSItem in CNID hash chain
+	FSItem *name_next;		// Pointer to next FSItem in host name hash chain
+	FSItem *guest_next;		// Pointer to next FSItem in guest name hash chain
 	uint32 id;				// CNID of this file/dir
 	uint32 parent_id;		// CNID of parent file/dir
 	FSItem *parent;			// Pointer to parent
@@ -162,12 +175,28 @@ struct FSItem {
 	char guest_name[32];	// Object name (C string) - Guest OS
 	time_t mtime;			// Modification time for get_cat_info caching
 	int cache_dircount;		// Cached number of files in directory
+	uint32 last_used;		// fs_use_clock at last lookup
+	int children;			// Number of FSItems with this parent
+	bool is_file;			// Flag: last seen as a plain file
+	bool pinned;			// Flag: CNID was given to an FCB, never evict
 };
 
 static FSItem *first_fs_item, *last_fs_item;
 
 static uint32 next_cnid = fsUsrCNID;	// Next available CNID
 
+// Hash tables indexing the FSItems by CNID, by (parent, host name) and
+// by (parent, guest name), all have 1 << fs_hash_bits buckets
+static FSItem **id_hash, **name_hash, **guest_hash;
+static int fs_hash_bits;
+static uint32 fs_item_count;			// Number of FSItems
+
+// Plain file FSItems that have not been looked up for a while are
+// evicted when there are more than FS_ITEMS_MAX of them (soft limit)
+const uint32 FS_ITEMS_MAX = 65536;
+static uint32 fs_use_clock;				// Incremented on every lookup
+static uint32 fs_evict_count;			// Item count triggering the next eviction pass
+
 
 /*
  *  Get object creation time
@@ -207,17 +236,165 @@ static uint32 get_creation_time(const char *path)
 #endif
 
 
+/*
+ *  FSItem hash tables
+ */
+
+static inline uint32 id_hash_index(uint32 cnid)
+{
+	return (cnid * 0x9e3779b1) >> (32 - fs_hash_bits);
+}
+
+static uint32 name_hash_index(const FSItem *parent, const char *name)
+{
+	// FNV-1a over parent pointer and name
+	uint32 h = 2166136261u;
+	uintptr pv = (uintptr)parent;
+	for (unsigned i=0; i<sizeof(pv); i++) {
+		h = (h ^ (pv & 0xff)) * 16777619u;
+		pv >>= 8;
+	}
+	while (*name)
+		h = (h ^ (uint8)*name++) * 16777619u;
+	return h >> (32 - fs_hash_bits);
+}
+
+static void add_fsitem_id(FSItem *p)
+{
+	FSItem **bucket = &id_hash[id_hash_index(p->id)];
+	p->id_next = *bucket;
+	*bucket = p;
+}
+
+static void remove_fsitem_id(FSItem *p)
+{
+	FSItem **q = &id_hash[id_hash_index(p->id)];
+	while (*q != p)
+		q = &(*q)->id_next;
+	*q = p->id_next;
+}
+
+static void add_fsitem_names(FSItem *p)
+{
+	FSItem **bucket = &name_hash[name_hash_index(p->parent, p->name)];
+	p->name_next = *bucket;
+	*bucket = p;
+	bucket = &guest_hash[name_hash_index(p->parent, p->guest_name)];
+	p->guest_next = *bucket;
+	*bucket = p;
+}
+
+static void remove_fsitem_names(FSItem *p)
+{
+	FSItem **q = &name_hash[name_hash_index(p->parent, p->name)];
+	while (*q != p)
+		q = &(*q)->name_next;
+	*q = p->name_next;
+	q = &guest_hash[name_hash_index(p->parent, p->guest_name)];
+	while (*q != p)
+		q = &(*q)->guest_next;
+	*q = p->guest_next;
+}
+
+// (Re)allocate hash tables with 1 << bits buckets and insert all FSItems
+static void rehash_fsitems(int bits)
+{
+	delete[] id_hash;
+	delete[] name_hash;
+	delete[] guest_hash;
+	fs_hash_bits = bits;
+	uint32 size = 1 << bits;
+	id_hash = new FSItem *[size];
+	name_hash = new FSItem *[size];
+	guest_hash = new FSItem *[size];
+	memset(id_hash, 0, size * sizeof(FSItem *));
+	memset(name_hash, 0, size * sizeof(FSItem *));
+	memset(guest_hash, 0, size * sizeof(FSItem *));
+	for (FSItem *p = first_fs_item; p; p = p->next) {
+		add_fsitem_id(p);
+		if (p->parent)
+			add_fsitem_names(p);
+	}
+}
+
+
+/*
+ *  Add FSItem to list and hash tables
+ */
+
+static void link_fsitem(FSItem *p)
+{
+	p->next = NULL;
+	if (last_fs_item)
+		last_fs_item->next = p;
+	else
+		first_fs_item = p;
+	last_fs_item = p;
+	p->last_used = fs_use_clock;
+	p->children = 0;
+	p->is_file = false;
+	p->pinned = false;
+	fs_item_count++;
+
+	if (fs_item_count > (1u << fs_hash_bits))
+		rehash_fsitems(fs_hash_bits + 1);
+	else {
+		add_fsitem_id(p);
+		if (p->parent)
+			add_fsitem_names(p);
+	}
+	if (p->parent)
+		p->parent->children++;
+}
+
+
+/*
+ *  Evict plain file FSItems that were not looked up during the last
+ *  FS_ITEMS_MAX/2 lookups, until the item count is back to 3/4 of the
+ *  limit. Directories, items with children and items whose CNID was
+ *  handed to an FCB are kept, as the guest may still refer to them.
+ */
+
+static void evict_fsitems(void)
+{
+	D(bug("evicting FSItems, %d items\n", fs_item_count));
+	FSItem *prev = first_fs_item, *p = prev->next;
+	while (p && fs_item_count > FS_ITEMS_MAX / 4 * 3) {
+		FSItem *next = p->next;
+		if (p->is_file && !p->pinned && p->children == 0 && fs_use_clock - p->last_used > FS_ITEMS_MAX / 2) {
+			prev->next = next;
+			if (p == last_fs_item)
+				last_fs_item = prev;
+			remove_fsitem_id(p);
+			remove_fsitem_names(p);
+			p->parent->children--;
+			fs_item_count--;
+			delete[] p->name;
+			delete p;
+		} else
+			prev = p;
+		p = next;
+	}
+	fs_evict_count = fs_item_count + FS_ITEMS_MAX / 4;
+	if (fs_evict_count < FS_ITEMS_MAX)
+		fs_evict_count = FS_ITEMS_MAX;
+	D(bug(" %d items left\n", fs_item_count));
+}
+
+
 /*
  *  Find FSItem for given CNID
  */
 
 static FSItem *find_fsitem_by_id(uint32 cnid)
 {
-	FSItem *p = first_fs_item;
+	FSItem *p = id_hash[id_hash_index(cnid)];
 	while (p) {
-		if (p->id == cnid)
+		if (p->id == cnid) {
+			p->last_used = ++fs_use_clock;
 			return p;
-		p = p->next;
+		}
+		p = p->id_next;
 	}
 	return NULL;
 }
@@ -229,9 +406,6 @@ static FSItem *find_fsitem_by_id(uint32 cnid)
 static FSItem *create_fsitem(const char *name, const char *guest_name, FSItem *parent)
 {
 	FSItem *p = new FSItem;
-	last_fs_item->next = p;
-	p->next = NULL;
-	last_fs_item = p;
 	p->id = next_cnid++;
 	p->parent_id = parent->id;
 	p->parent = parent;
@@ -240,6 +414,11 @@ static FSItem *create_fsitem(const char *name, const char *guest_name, FSItem *p
 	strncpy(p->guest_name, guest_name, 31);
 	p->guest_name[31] = 0;
 	p->mtime = 0;
+	++fs_use_clock;
+	link_fsitem(p);
+
+	if (fs_item_count > fs_evict_count)
+		evict_fsitems();
 	return p;
 }
 
@@ -249,11 +428,13 @@ static FSItem *create_fsitem(const char *name, const char *guest_name, FSItem *p
 
 static FSItem *find_fsitem(const char *name, FSItem *parent)
 {
-	FSItem *p = first_fs_item;
+	FSItem *p = name_hash[name_hash_index(parent, name)];
 	while (p) {
-		if (p->parent == parent && !strcmp(p->name, name))
+		if (p->parent == parent && !strcmp(p->name, name)) {
+			p->last_used = ++fs_use_clock;
 			return p;
-		p = p->next;
+		}
+		p = p->name_next;
 	}
 
 	// Not found, construct new FSItem
@@ -266,11 +447,13 @@ static FSItem *find_fsitem(const char *name, FSItem *parent)
 
 static FSItem *find_fsitem_guest(const char *guest_name, FSItem *parent)
 {
-	FSItem *p = first_fs_item;
+	FSItem *p = guest_hash[name_hash_index(parent, guest_name)];
 	while (p) {
-		if (p->parent == parent && !strcmp(p->guest_name, guest_name))
+		if (p->parent == parent && !strcmp(p->guest_name, guest_name)) {
+			p->last_used = ++fs_use_clock;
 			return p;
-		p = p->next;
+		}
+		p = p->guest_next;
 	}
 
 	// Not found, construct new FSItem
@@ -319,6 +502,104 @@ static void swap_parent_ids(uint32 parent1, uint32 parent2)
 }
 
 
+/*
+ *  Exchange CNIDs of two FSItems (the ID of a renamed/moved file/dir has to stay the same)
+ */
+
+static void swap_fsitem_ids(FSItem *p1, FSItem *p2)
+{
+	swap_parent_ids(p1->id, p2->id);
+	remove_fsitem_id(p1);
+	remove_fsitem_id(p2);
+	uint32 t = p1->id;
+	p1->id = p2->id;
+	p2->id = t;
+	add_fsitem_id(p1);
+	add_fsitem_id(p2);
+	p1->pinned = p2->pinned = p1->pinned || p2->pinned;
+}
+
+
+/*
+ *  Directory snapshots for enumeration by index (ioFDirIndex > 0)
+ *
+ *  The Finder enumerates a directory with index 1..N. Instead of reading
+ *  the directory up to the Nth entry on every call, we keep the sorted
+ *  entry names of the last few enumerated directories. A snapshot is
+ *  valid as long as the directory's modification time is unchanged and
+ *  it was taken at least a second after that time (otherwise a change in
+ *  the same second would go unnoticed). Our own create/delete/rename/move
+ *  calls drop all snapshots.
+ */
+
+struct dir_snapshot {
+	dir_snapshot() : dir(NULL), mtime(0), taken(0), last_used(0) {}
+
+	FSItem *dir;			// Directory, NULL = unused slot
+	time_t mtime;			// Modification time of directory
+	time_t taken;			// Time when snapshot was taken
+	uint32 last_used;		// fs_use_clock at last access
+	vector<string> names;	// Sorted entry names (host encoding)
+};
+
+const int NUM_DIR_SNAPSHOTS = 4;
+static dir_snapshot dir_snapshots[NUM_DIR_SNAPSHOTS];
+
+static void invalidate_dir_snapshots(void)
+{
+	for (int i=0; i<NUM_DIR_SNAPSHOTS; i++) {
+		dir_snapshots[i].dir = NULL;
+		dir_snapshots[i].names.clear();
+	}
+}
+
+// Get snapshot of directory dir, whose path must be in full_path (NULL = error)
+static const dir_snapshot *get_dir_snapshot(FSItem *dir)
+{
+	struct stat st;
+	if (stat(full_path, &st) < 0)
+		return NULL;
+
+	// Look for valid snapshot
+	dir_snapshot *snap = &dir_snapshots[0];
+	for (int i=0; i<NUM_DIR_SNAPSHOTS; i++) {
+		dir_snapshot *s = &dir_snapshots[i];
+		if (s->dir == dir) {
+			snap = s;
+			if (s->mtime == st.st_mtime && s->taken > s->mtime) {
+				s->last_used = fs_use_clock;
+				return s;
+			}
+			break;
+		}
+		if (s->last_used < snap->last_used)
+			snap = s;
+	}
+
+	// Not found or stale, read directory into least recently used slot
+	D(bug("  taking snapshot of %s\n", full_path));
+	snap->dir = NULL;
+	snap->names.clear();
+	time_t taken = time(NULL);
+	DIR *d = opendir(full_path);
+	if (d == NULL)
+		return NULL;
+	struct dirent *de;
+	while ((de = readdir(d)) != NULL) {
+		if (de->d_name[0] == '.')
+			continue;	// Suppress names beginning with '.' (MacOS could interpret these as driver names)
+		snap->names.push_back(de->d_name);
+	}
+	closedir(d);
+	std::sort(snap->names.begin(), snap->names.end());
+	snap->dir = dir;
+	snap->mtime = st.st_mtime;
+	snap->taken = taken;
+	snap->last_used = fs_use_clock;
+	return snap;
+}
+
+
 /*
  *  String handling functions
  */
@@ -409,22 +690,26 @@ void ExtFSInit(void)
 	cstr2pstr(FS_NAME, GetString(STR_EXTFS_NAME));
 	cstr2pstr(VOLUME_NAME, GetString(STR_EXTFS_VOLUME_NAME));
 
+	// Set up FSItem hash tables
+	first_fs_item = last_fs_item = NULL;
+	fs_item_count = 0;
+	fs_use_clock = 0;
+	fs_evict_count = FS_ITEMS_MAX;
+	rehash_fsitems(10);
+
 	// Create root's parent FSItem
 	FSItem *p = new FSItem;
-	first_fs_item = last_fs_item = p;
-	p->next = NULL;
 	p->id = ROOT_PARENT_ID;
 	p->parent_id = 0;
 	p->parent = NULL;
 	p->name = new char[1];
 	p->name[0] = 0;
 	p->guest_name[0] = 0;
+	p->mtime = 0;
+	link_fsitem(p);
 
 	// Create root FSItem
 	p = new FSItem;
-	last_fs_item->next = p;
-	p->next = NULL;
-	last_fs_item = p;
 	p->id = ROOT_ID;
 	p->parent_id = ROOT_PARENT_ID;
 	p->parent = first_fs_item;
@@ -433,6 +718,8 @@ void ExtFSInit(void)
 	strcpy(p->name, volume_name);
 	strncpy(p->guest_name, host_encoding_to_macroman(p->name), 32);
 	p->guest_name[31] = 0;
+	p->mtime = 0;
+	link_fsitem(p);
 
 	// Find path for root
 	if ((RootPath = PrefsFindString("extfs")) != NULL) {
@@ -460,6 +747,12 @@ void ExtFSExit(void)
 		p = next;
 	}
 	first_fs_item = last_fs_item = NULL;
+	fs_item_count = 0;
+	invalidate_dir_snapshots();
+	delete[] id_hash;
+	delete[] name_hash;
+	delete[] guest_hash;
+	id_hash = name_hash = guest_hash = NULL;
 
 	// System specific deinitialization
 	extfs_exit();
@@ -1271,27 +1564,18 @@ static int16 fs_get_file_info(uint32 pb, bool hfs, uint32 dirID)
 			return dirNFErr;
 		get_path_for_fsitem(p);
 
-		// Look for nth item in directory and add name to path
-		DIR *d = opendir(full_path);
-		if (d == NULL)
+		// Look up nth item in directory snapshot and add name to path
+		const dir_snapshot *snap = get_dir_snapshot(p);
+		if (snap == NULL)
 			return dirNFErr;
-		struct dirent *de = NULL;
-		for (int i=0; i<dir_index; i++) {
-read_next_de:
-			de = readdir(d);
-			if (de == NULL) {
-				closedir(d);
-				return fnfErr;
-			}
-			if (de->d_name[0] == '.')
-				goto read_next_de;	// Suppress names beginning with '.' (MacOS could interpret these as driver names)
-			//!! suppress directories
-		}
-		add_path_comp(de->d_name);
+		if (dir_index > (int)snap->names.size())
+			return fnfErr;
+		//!! suppress directories
+		const char *name = snap->names[dir_index - 1].c_str();
+		add_path_comp(name);
 
 		// Get FSItem for queried item
-		fs_item = find_fsitem(de->d_name, p);
-		closedir(d);
+		fs_item = find_fsitem(name, p);
 	}
 
 	// Get stats
@@ -1300,6 +1584,7 @@ read_next_de:
 		return fnfErr;
 	if (S_ISDIR(st.st_mode))
 		return fnfErr;
+	fs_item->is_file = true;
 
 	// Fill in struct from fs_item and stats
 	if (ReadMacInt32(pb + ioNamePtr))
@@ -1395,26 +1680,17 @@ static int16 fs_get_cat_info(uint32 pb)
 			return dirNFErr;
 		get_path_for_fsitem(p);
 
-		// Look for nth item in directory and add name to path
-		DIR *d = opendir(full_path);
-		if (d == NULL)
+		// Look up nth item in directory snapshot and add name to path
+		const dir_snapshot *snap = get_dir_snapshot(p);
+		if (snap == NULL)
 			return dirNFErr;
-		struct dirent *de = NULL;
-		for (int i=0; i<dir_index; i++) {
-read_next_de:
-			de = readdir(d);
-			if (de == NULL) {
-				closedir(d);
-				return fnfErr;
-			}
-			if (de->d_name[0] == '.')
-				goto read_next_de;	// Suppress names beginning with '.' (MacOS could interpret these as driver names)
-		}
-		add_path_comp(de->d_name);
+		if (dir_index > (int)snap->names.size())
+			return fnfErr;
+		const char *name = snap->names[dir_index - 1].c_str();
+		add_path_comp(name);
 
 		// Get FSItem for queried item
-		fs_item = find_fsitem(de->d_name, p);
-		closedir(d);
+		fs_item = find_fsitem(name, p);
 	}
 	D(bug("  path %s\n", full_path));
 
@@ -1422,6 +1698,7 @@ read_next_de:
 	struct stat st;
 	if (stat(full_path, &st) < 0)
 		return errno2oserr();
+	fs_item->is_file = !S_ISDIR(st.st_mode);
 	if (dir_index == -1 && !S_ISDIR(st.st_mode))
 		return dirNFErr;
 
@@ -1587,6 +1864,7 @@ static int16 fs_open(uint32 pb, uint32 dirID, uint32 vcb, bool resource_fork)
 
 	// Initialize FCB, fd is stored in fcbCatPos
 	WriteMacInt32(fcb + fcbFlNm, fs_item->id);
+	fs_item->pinned = true;
 	WriteMacInt8(fcb + fcbFlags, ((flag == O_WRONLY || flag == O_RDWR) ? fcbWriteMask : 0) | (resource_fork ? fcbResourceMask : 0) | (write_ok ? 0 : fcbFileLockedMask));
 	uint32 file_size = (uint32) st.st_size;
 	WriteMacInt32(fcb + fcbEOF, file_size);
@@ -1959,6 +2237,7 @@ static int16 fs_create(uint32 pb, uint32 dirID)
 		return errno2oserr();
 	else {
 		close(fd);
+		invalidate_dir_snapshots();
 		return noErr;
 	}
 }
@@ -1982,6 +2261,8 @@ static int16 fs_dir_create(uint32 pb)
 	if (mkdir(full_path, 0777) < 0)
 		return errno2oserr();
 	else {
+		invalidate_dir_snapshots();
+		fs_item->is_file = false;
 		WriteMacInt32(pb + ioDirID, fs_item->id);
 		return noErr;
 	}
@@ -2001,8 +2282,10 @@ static int16 fs_delete(uint32 pb, uint32 dirID)
 	// Delete file
 	if (!extfs_remove(full_path))
 		return errno2oserr();
-	else
+	else {
+		invalidate_dir_snapshots();
 		return noErr;
+	}
 }
 
 // Rename file/directory
@@ -2038,10 +2321,8 @@ static int16 fs_rename(uint32 pb, uint32 dirID)
 		return errno2oserr();
 	else {
 		// The ID of the old file/dir has to stay the same, so we swap the IDs of the FSItems
-		swap_parent_ids(fs_item->id, new_item->id);
-		uint32 t = fs_item->id;
-		fs_item->id = new_item->id;
-		new_item->id = t;
+		invalidate_dir_snapshots();
+		swap_fsitem_ids(fs_item, new_item);
 		return noErr;
 	}
 }
@@ -2082,13 +2363,10 @@ static int16 fs_cat_move(uint32 pb)
 		return errno2oserr();
 	else {
 		// The ID of the old file/dir has to stay the same, so we swap the IDs of the FSItems
+		invalidate_dir_snapshots();
 		FSItem *new_item = find_fsitem(fs_item->name, new_dir_item);
-		if (new_item) {
-			swap_parent_ids(fs_item->id, new_item->id);
-			uint32 t = fs_item->id;
-			fs_item->id = new_item->id;
-			new_item->id = t;
-		}
+		if (new_item)
+			swap_fsitem_ids(fs_item, new_item);
 		return noErr;
 	}
 }
@@ -67,7 +67,8 @@ enum {
 	INTFLAG_AUDIO = 16,	// Audio block read
 	INTFLAG_TIMER = 32,	// Time Manager
 	INTFLAG_ADB = 64,	// ADB
-	INTFLAG_NMI = 128	// NMI
+	INTFLAG_NMI = 128,	// NMI
+	INTFLAG_DISK = 256	// Disk driver
 };
 
 extern uint32 InterruptFlags;									// Currently pending interrupts
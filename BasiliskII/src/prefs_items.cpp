@@ -53,10 +53,12 @@ prefs_desc common_prefs_items[] = {
 	{"bootdriver", TYPE_INT32, false, "boot driver number"},
 	{"ramsize", TYPE_INT32, false,    "size of Mac RAM in bytes"},
 	{"frameskip", TYPE_INT32, false,  "number of frames to skip in refreshed video modes"},
+	{"vosfthreads", TYPE_INT32, false, "number of threads converting the frame buffer (0 = auto)"},
 	{"modelid", TYPE_INT32, false,    "Mac Model ID (Gestalt Model ID minus 6)"},
 	{"cpu", TYPE_INT32, false,        "CPU type (0 = 68000, 1 = 68010 etc.)"},
 	{"fpu", TYPE_BOOLEAN, false,      "enable FPU emulation"},
 	{"nocdrom", TYPE_BOOLEAN, false,  "don't install CD-ROM driver"},
+	{"diskasync", TYPE_BOOLEAN, false, "complete asynchronous disk requests in a background thread"},
 	{"nosound", TYPE_BOOLEAN, false,  "don't enable sound output"},
 	{"noclipconversion", TYPE_BOOLEAN, false, "don't convert clipboard contents"},
 	{"nogui", TYPE_BOOLEAN, false,    "disable GUI"},
@@ -85,11 +87,13 @@ void AddPrefsDefaults(void)
 	PrefsAddInt32("bootdrive", 0);
 	PrefsAddInt32("ramsize", 8 * 1024 * 1024);
 	PrefsAddInt32("frameskip", 6);
+	PrefsAddInt32("vosfthreads", 0);
 	PrefsAddInt32("modelid", 5);	// Mac IIci
 	PrefsAddInt32("cpu", 3);		// 68030
 	PrefsAddInt32("displaycolordepth", 0);
 	PrefsAddBool("fpu", false);
 	PrefsAddBool("nocdrom", false);
+	PrefsAddBool("diskasync", false);
 	PrefsAddBool("nosound", false);
 	PrefsAddBool("noclipconversion", false);
 	PrefsAddBool("nogui", false);
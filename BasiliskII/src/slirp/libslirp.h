@@ -25,6 +25,9 @@ void slirp_input(const uint8 *pkt, int pkt_len);
 /* you must provide the following functions: */
 int slirp_can_output(void);
 void slirp_output(const uint8 *pkt, int pkt_len);
+#ifndef _WIN32
+int slirp_closesocket(int s);
+#endif
 
 int slirp_redir(int is_udp, int host_port, 
                 struct in_addr guest_addr, int guest_port);
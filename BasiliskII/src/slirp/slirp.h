@@ -45,7 +45,7 @@ typedef unsigned long ioctlsockopt_t;
 # define WSAECONNREFUSED ECONNREFUSED
 typedef int ioctlsockopt_t;
 # define ioctlsocket ioctl
-# define closesocket(s) close(s)
+# define closesocket(s) slirp_closesocket(s)
 # define O_BINARY 0
 #endif
 
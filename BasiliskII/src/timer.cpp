@@ -26,6 +26,9 @@
 
 #include <stdio.h>
 
+#include <map>
+#include <vector>
+
 #include "sysdeps.h"
 #include "cpu_emulation.h"
 #include "main.h"
@@ -35,6 +38,9 @@
 #define DEBUG 0
 #include "debug.h"
 
+using std::map;
+using std::vector;
+
 
 // Set this to 1 to enable TMQueue management (doesn't work)
 #define TM_QUEUE 0
@@ -49,41 +55,39 @@ enum {	// TMTask struct
 };
 
 
-// Array of additional info for each installed TMTask
+// Additional info for each installed TMTask
 struct TMDesc {
 	uint32 task;		// Mac address of associated TMTask
 	tm_time_t wakeup;	// Time this task is scheduled for execution
-	bool in_use;		// Flag: descriptor in use
+	int active_index;	// Position in tm_active, -1 if not scheduled
 };
 
-const int NUM_DESCS = 64;		// Maximum number of descriptors
-static TMDesc desc[NUM_DESCS];
+static map<uint32, TMDesc *> tm_descs;	// Installed tasks, by TMTask address
+static vector<TMDesc *> tm_active;		// Scheduled tasks, binary min-heap ordered by wakeup time
 
 
 /*
- *  Allocate descriptor for given TMTask in list
+ *  Allocate descriptor for given TMTask
  */
 
-static int alloc_desc(uint32 tm)
+static TMDesc *alloc_desc(uint32 tm)
 {
-	// Search for first free descriptor
-	for (int i=0; i<NUM_DESCS; i++)
-		if (!desc[i].in_use) {
-			desc[i].task = tm;
-			desc[i].in_use = true;
-			return i;
-		}
-	return -1;
+	TMDesc *desc = new TMDesc;
+	desc->task = tm;
+	desc->active_index = -1;
+	tm_descs[tm] = desc;
+	return desc;
 }
 
 
 /*
- *  Free descriptor in list
+ *  Free descriptor
  */
 
-inline static void free_desc(int i)
+inline static void free_desc(TMDesc *desc)
 {
-	desc[i].in_use = false;
+	tm_descs.erase(desc->task);
+	delete desc;
 }
 
 
@@ -91,12 +95,72 @@ inline static void free_desc(int i)
  *  Find descriptor associated with given TMTask
  */
 
-inline static int find_desc(uint32 tm)
+inline static TMDesc *find_desc(uint32 tm)
 {
-	for (int i=0; i<NUM_DESCS; i++)
-		if (desc[i].in_use && desc[i].task == tm)
-			return i;
-	return -1;
+	map<uint32, TMDesc *>::const_iterator i = tm_descs.find(tm);
+	return i != tm_descs.end() ? i->second : NULL;
+}
+
+
+/*
+ *  Heap of scheduled tasks
+ */
+
+inline static void set_active(int i, TMDesc *desc)
+{
+	tm_active[i] = desc;
+	desc->active_index = i;
+}
+
+// Move descriptor at position i up or down to its place in the heap
+static void sift_active(int i)
+{
+	TMDesc *desc = tm_active[i];
+	const int n = tm_active.size();
+	while (i > 0) {
+		const int parent = (i - 1) / 2;
+		if (timer_cmp_time(tm_active[parent]->wakeup, desc->wakeup) <= 0)
+			break;
+		set_active(i, tm_active[parent]);
+		i = parent;
+	}
+	for (;;) {
+		int child = 2 * i + 1;
+		if (child >= n)
+			break;
+		if (child + 1 < n && timer_cmp_time(tm_active[child + 1]->wakeup, tm_active[child]->wakeup) < 0)
+			child++;
+		if (timer_cmp_time(desc->wakeup, tm_active[child]->wakeup) <= 0)
+			break;
+		set_active(i, tm_active[child]);
+		i = child;
+	}
+	set_active(i, desc);
+}
+
+// Schedule task, or reschedule it if its wakeup time changed
+static void activate_desc(TMDesc *desc)
+{
+	if (desc->active_index < 0) {
+		tm_active.push_back(desc);
+		desc->active_index = tm_active.size() - 1;
+	}
+	sift_active(desc->active_index);
+}
+
+// Unschedule task
+static void deactivate_desc(TMDesc *desc)
+{
+	const int i = desc->active_index;
+	if (i < 0)
+		return;
+	desc->active_index = -1;
+	TMDesc *last = tm_active.back();
+	tm_active.pop_back();
+	if (last != desc) {
+		set_active(i, last);
+		sift_active(i);
+	}
 }
 
 
@@ -139,9 +203,7 @@ static void dequeue_tm(uint32 tm)
 
 void TimerInit(void)
 {
-	// Mark all descriptors as inactive
-	for (int i=0; i<NUM_DESCS; i++)
-		free_desc(i);
+	TimerReset();
 }
 
 
@@ -160,9 +222,11 @@ void TimerExit(void)
 
 void TimerReset(void)
 {
-	// Mark all descriptors as inactive
-	for (int i=0; i<NUM_DESCS; i++)
-		free_desc(i);
+	// Free all descriptors
+	for (map<uint32, TMDesc *>::iterator i = tm_descs.begin(); i != tm_descs.end(); ++i)
+		delete i->second;
+	tm_descs.clear();
+	tm_active.clear();
 }
 
 
@@ -174,13 +238,10 @@ int16 InsTime(uint32 tm, uint16 trap)
 {
 	D(bug("InsTime %08lx, trap %04x\n", tm, trap));
 	WriteMacInt16(tm + qType, ReadMacInt16(tm + qType) & 0x1fff | (trap << 4) & 0x6000);
-	if (find_desc(tm) >= 0)
+	if (find_desc(tm))
 		printf("WARNING: InsTime(): Task re-inserted\n");
-	else {
-		int i = alloc_desc(tm);
-		if (i < 0)
-			printf("FATAL: InsTime(): No free Time Manager descriptor\n");
-	}
+	else
+		alloc_desc(tm);
 	return 0;
 }
 
@@ -194,8 +255,8 @@ int16 RmvTime(uint32 tm)
 	D(bug("RmvTime %08lx\n", tm));
 
 	// Find descriptor
-	int i = find_desc(tm);
-	if (i < 0) {
+	TMDesc *desc = find_desc(tm);
+	if (!desc) {
 		printf("WARNING: RmvTime(%08x): Descriptor not found\n", tm);
 		return 0;
 	}
@@ -210,14 +271,15 @@ int16 RmvTime(uint32 tm)
 		// Compute remaining time
 		tm_time_t remaining, current;
 		timer_current_time(current);
-		timer_sub_time(remaining, desc[i].wakeup, current);
+		timer_sub_time(remaining, desc->wakeup, current);
 		WriteMacInt32(tm + tmCount, timer_host2mac_time(remaining));
 	} else
 		WriteMacInt32(tm + tmCount, 0);
 	D(bug(" tmCount %d\n", ReadMacInt32(tm + tmCount)));
 
 	// Free descriptor
-	free_desc(i);
+	deactivate_desc(desc);
+	free_desc(desc);
 	return 0;
 }
 
@@ -231,8 +293,8 @@ int16 PrimeTime(uint32 tm, int32 time)
 	D(bug("PrimeTime %08x, time %d\n", tm, time));
 
 	// Find descriptor
-	int i = find_desc(tm);
-	if (i < 0) {
+	TMDesc *desc = find_desc(tm);
+	if (!desc) {
 		printf("FATAL: PrimeTime(): Descriptor not found\n");
 		return 0;
 	}
@@ -254,15 +316,15 @@ int16 PrimeTime(uint32 tm, int32 time)
 
 			// Yes, calculate wakeup time relative to last scheduled time
 			tm_time_t wakeup;
-			timer_add_time(wakeup, desc[i].wakeup, delay);
-			desc[i].wakeup = wakeup;
+			timer_add_time(wakeup, desc->wakeup, delay);
+			desc->wakeup = wakeup;
 
 		} else {
 
 			// No, calculate wakeup time relative to current time
 			tm_time_t now;
 			timer_current_time(now);
-			timer_add_time(desc[i].wakeup, now, delay);
+			timer_add_time(desc->wakeup, now, delay);
 		}
 
 		// Set tmWakeUp to indicate that task was scheduled
@@ -273,13 +335,14 @@ int16 PrimeTime(uint32 tm, int32 time)
 		// Not extended task, calculate wakeup time relative to current time
 		tm_time_t delay;
 		timer_mac2host_time(delay, time);
-		timer_current_time(desc[i].wakeup);
-		timer_add_time(desc[i].wakeup, desc[i].wakeup, delay);
+		timer_current_time(desc->wakeup);
+		timer_add_time(desc->wakeup, desc->wakeup, delay);
 	}
 
 	// Make task active and enqueue it in the Time Manager queue
 	WriteMacInt16(tm + qType, ReadMacInt16(tm + qType) | 0x8000);
 	enqueue_tm(tm);
+	activate_desc(desc);
 	return 0;
 }
 
@@ -290,27 +353,36 @@ int16 PrimeTime(uint32 tm, int32 time)
 
 void TimerInterrupt(void)
 {
-	// Look for active TMTasks that have expired
+	// Take active TMTasks that have expired off the schedule. Tasks primed
+	// again by their timer function will only be called on the next interrupt
 	tm_time_t now;
 	timer_current_time(now);
-	for (int i=0; i<NUM_DESCS; i++)
-		if (desc[i].in_use) {
-			uint32 tm = desc[i].task;
-			if ((ReadMacInt16(tm + qType) & 0x8000) && timer_cmp_time(desc[i].wakeup, now) < 0) {
-
-				// Found one, mark as inactive and remove it from the Time Manager queue
-				WriteMacInt16(tm + qType, ReadMacInt16(tm + qType) & 0x7fff);
-				dequeue_tm(tm);
-
-				// Call timer function
-				uint32 addr = ReadMacInt32(tm + tmAddr);
-				if (addr) {
-					D(bug("Calling TimeTask %08lx, addr %08lx\n", tm, addr));
-					M68kRegisters r;
-					r.a[0] = addr;
-					r.a[1] = tm;
-					Execute68k(addr, &r);
-				}
+	vector<uint32> expired;
+	while (!tm_active.empty() && timer_cmp_time(tm_active[0]->wakeup, now) < 0) {
+		expired.push_back(tm_active[0]->task);
+		deactivate_desc(tm_active[0]);
+	}
+
+	for (vector<uint32>::const_iterator i = expired.begin(); i != expired.end(); ++i) {
+		uint32 tm = *i;
+
+		// Skip tasks that were removed or primed again by an earlier timer function
+		TMDesc *desc = find_desc(tm);
+		if (desc && desc->active_index < 0 && (ReadMacInt16(tm + qType) & 0x8000)) {
+
+			// Mark as inactive and remove it from the Time Manager queue
+			WriteMacInt16(tm + qType, ReadMacInt16(tm + qType) & 0x7fff);
+			dequeue_tm(tm);
+
+			// Call timer function
+			uint32 addr = ReadMacInt32(tm + tmAddr);
+			if (addr) {
+				D(bug("Calling TimeTask %08lx, addr %08lx\n", tm, addr));
+				M68kRegisters r;
+				r.a[0] = addr;
+				r.a[1] = tm;
+				Execute68k(addr, &r);
 			}
 		}
+	}
 }
@@ -87,7 +87,7 @@ union cacheline {
 #endif
 
 /* Does flush_icache_range() only check for blocks falling in the requested range? */
-#define LAZY_FLUSH_ICACHE_RANGE 0
+#define LAZY_FLUSH_ICACHE_RANGE 1
 
 #define USE_F_ALIAS 1
 #define USE_OFFSET 1
@@ -107,6 +107,8 @@ union cacheline {
 #define MAX_CHECKSUM_LEN 2048 /* The maximum size we calculate checksums
 				 for. Anything larger will be flushed
 				 unconditionally even with SOFT_FLUSH */
+#define CODE_PAGE_BITS 12 /* Granularity of the RAM page to blocks map
+			     used by flush_icache_range() */
 #define MAX_HOLD_BI 3  /* One for the current block, and up to two
 			  for jump targets */
 
@@ -544,6 +546,14 @@ typedef struct checksum_info_t {
   struct checksum_info_t *next;
 } checksum_info;
 
+typedef struct page_link_t {
+  struct blockinfo_t* bi;
+  struct page_link_t* next;         /* Next block on the same page */
+  struct page_link_t** prev_p;
+  struct page_link_t* next_in_block; /* Next page of the same block */
+  uae_u32 page;
+} page_link;
+
 typedef struct blockinfo_t {
     uae_s32 count;
     cpuop_func* direct_handler_to_use;
@@ -552,6 +562,8 @@ typedef struct blockinfo_t {
 
     cpuop_func* handler; 
     cpuop_func* direct_handler;
+    /* Like handler, entered from the second way of the tag lookup */
+    cpuop_func* victim_handler;
 
     cpuop_func* direct_pen;
     cpuop_func* direct_pcc;
@@ -562,6 +574,7 @@ typedef struct blockinfo_t {
     uae_u32 c2;
 #if USE_CHECKSUM_INFO
     checksum_info *csi;
+    page_link *pages;
 #else
     uae_u32 len;
     uae_u32 min_pcp; 
@@ -56,6 +56,9 @@
 #include <stdlib.h>
 #include <fcntl.h>
 #include <errno.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "cpu_emulation.h"
 #include "main.h"
@@ -219,6 +222,9 @@ int segvcount=0;
 int soft_flush_count=0;
 int hard_flush_count=0;
 int checksum_count=0;
+static uae_u32 rom_checksum_ranges=0;
+static uae_u32 range_flush_count=0;
+static uae_u32 range_flush_blocks=0;
 static uae_u8* current_compile_p=NULL;
 static uae_u8* max_compile_start;
 static uae_u8* compiled_code=NULL;
@@ -233,6 +239,7 @@ static void* popall_execute_normal=NULL;
 static void* popall_cache_miss=NULL;
 static void* popall_recompile_block=NULL;
 static void* popall_check_checksum=NULL;
+static void* cache_victim_lookup=NULL;
 
 /* The 68k only ever executes from even addresses. So right now, we
  * waste half the entries in this array
@@ -240,6 +247,16 @@ static void* popall_check_checksum=NULL;
  * lists that we maintain for each hash result.
  */
 cacheline cache_tags[TAGSIZE];
+
+/* Second way of the tag lookup. When the block in cache_tags does not
+ * match regs.pc_p, its handler jumps through this array to the
+ * victim_handler of the next block on the same hash chain, so that two
+ * hot blocks sharing a cacheline don't bounce through cache_miss() on
+ * every computed jump. Indexed by cacheline(x)/2.
+ */
+static cpuop_func* cache_victims[TAGSIZE/2];
+static uae_u32 victim_hit_count=0;
+static uae_u32 cache_miss_count=0;
 int letit=0;
 blockinfo* hold_bi[MAX_HOLD_BI];
 blockinfo* active;
@@ -344,6 +361,26 @@ static __inline__ blockinfo* get_blockinfo_addr(void* addr)
  * All sorts of list related functions for all of the lists        *
  *******************************************************************/
 
+/* Recompute the handlers that the dispatchers jump to for the first
+   two blocks on a hash chain */
+static __inline__ void update_cl_handlers(uae_u32 cl)
+{
+    blockinfo* bi=cache_tags[cl+1].bi;
+    blockinfo* vbi=bi ? bi->next_same_cl : NULL;
+
+    if (bi)
+	cache_tags[cl].handler=bi->handler_to_use;
+    else
+	cache_tags[cl].handler=(cpuop_func *)popall_execute_normal;
+
+    if (vbi && vbi->victim_handler && vbi->handler_to_use==vbi->handler)
+	cache_victims[cl>>1]=vbi->victim_handler;
+    else if (vbi)
+	cache_victims[cl>>1]=vbi->handler_to_use;
+    else
+	cache_victims[cl>>1]=(cpuop_func *)popall_cache_miss;
+}
+
 static __inline__ void remove_from_cl_list(blockinfo* bi)
 {
     uae_u32 cl=cacheline(bi->pc_p);
@@ -352,10 +389,7 @@ static __inline__ void remove_from_cl_list(blockinfo* bi)
 	*(bi->prev_same_cl_p)=bi->next_same_cl;
     if (bi->next_same_cl)
 	bi->next_same_cl->prev_same_cl_p=bi->prev_same_cl_p;
-    if (cache_tags[cl+1].bi)
-	cache_tags[cl].handler=cache_tags[cl+1].bi->handler_to_use;
-    else
-	cache_tags[cl].handler=(cpuop_func *)popall_execute_normal;
+    update_cl_handlers(cl);
 }
 
 static __inline__ void remove_from_list(blockinfo* bi)
@@ -383,7 +417,7 @@ static __inline__ void add_to_cl_list(blockinfo* bi)
     cache_tags[cl+1].bi=bi;
     bi->prev_same_cl_p=&(cache_tags[cl+1].bi);
 	
-    cache_tags[cl].handler=bi->handler_to_use;
+    update_cl_handlers(cl);
 }
 
 static __inline__ void raise_in_cl_list(blockinfo* bi)
@@ -467,6 +501,7 @@ static __inline__ void invalidate_block(blockinfo* bi)
     bi->count=optcount[0]-1;
     bi->handler=NULL;
     bi->handler_to_use=(cpuop_func *)popall_execute_normal;
+    bi->victim_handler=NULL;
     bi->direct_handler=NULL;
     set_dhtu(bi,bi->direct_pen);
     bi->needed_flags=0xff;
@@ -505,8 +540,8 @@ static __inline__ void block_need_recompile(blockinfo * bi)
   
   bi->handler_to_use = (cpuop_func *)popall_execute_normal;
   bi->handler = (cpuop_func *)popall_execute_normal;
-  if (bi == cache_tags[cl + 1].bi)
-	cache_tags[cl].handler = (cpuop_func *)popall_execute_normal;
+  bi->victim_handler = NULL;
+  update_cl_handlers(cl);
   bi->status = BI_NEED_RECOMP;
 }
 
@@ -659,9 +694,11 @@ public:
 #if USE_SEPARATE_BIA
 static LazyBlockAllocator<blockinfo> BlockInfoAllocator;
 static LazyBlockAllocator<checksum_info> ChecksumInfoAllocator;
+static LazyBlockAllocator<page_link> PageLinkAllocator;
 #else
 static HardBlockAllocator<blockinfo> BlockInfoAllocator;
 static HardBlockAllocator<checksum_info> ChecksumInfoAllocator;
+static HardBlockAllocator<page_link> PageLinkAllocator;
 #endif
 
 static __inline__ checksum_info *alloc_checksum_info(void)
@@ -686,11 +723,64 @@ static __inline__ void free_checksum_info_chain(checksum_info *csi)
 	}
 }
 
+#if USE_CHECKSUM_INFO
+/* For each page of RAM, the list of blocks that have code from it */
+static page_link **code_pages = NULL;
+
+static void add_to_code_pages(blockinfo *bi)
+{
+	if (!code_pages)
+		return;
+	for (checksum_info *csi = bi->csi; csi; csi = csi->next) {
+		uintptr start = (uintptr)csi->start_p - (uintptr)RAMBaseHost;
+		if (start >= RAMSize)
+			continue;
+		uintptr end = start + csi->length - 1;
+		if (end >= RAMSize)
+			end = RAMSize - 1;
+		for (uae_u32 page = start >> CODE_PAGE_BITS; page <= (end >> CODE_PAGE_BITS); page++) {
+			page_link *pl;
+			for (pl = bi->pages; pl; pl = pl->next_in_block) {
+				if (pl->page == page)
+					break;
+			}
+			if (pl)
+				continue;
+			pl = PageLinkAllocator.acquire();
+			pl->bi = bi;
+			pl->page = page;
+			pl->next_in_block = bi->pages;
+			bi->pages = pl;
+			pl->next = code_pages[page];
+			if (pl->next)
+				pl->next->prev_p = &pl->next;
+			pl->prev_p = &code_pages[page];
+			code_pages[page] = pl;
+		}
+	}
+}
+
+static void remove_from_code_pages(blockinfo *bi)
+{
+	page_link *pl = bi->pages;
+	while (pl) {
+		page_link *next = pl->next_in_block;
+		*(pl->prev_p) = pl->next;
+		if (pl->next)
+			pl->next->prev_p = pl->prev_p;
+		PageLinkAllocator.release(pl);
+		pl = next;
+	}
+	bi->pages = NULL;
+}
+#endif
+
 static __inline__ blockinfo *alloc_blockinfo(void)
 {
 	blockinfo *bi = BlockInfoAllocator.acquire();
 #if USE_CHECKSUM_INFO
 	bi->csi = NULL;
+	bi->pages = NULL;
 #endif
 	return bi;
 }
@@ -698,6 +788,7 @@ static __inline__ blockinfo *alloc_blockinfo(void)
 static __inline__ void free_blockinfo(blockinfo *bi)
 {
 #if USE_CHECKSUM_INFO
+	remove_from_code_pages(bi);
 	free_checksum_info_chain(bi->csi);
 	bi->csi = NULL;
 #endif
@@ -5082,6 +5173,14 @@ void compiler_exit(void)
 		vm_release(popallspace, POPALLSPACE_SIZE);
 		popallspace = 0;
 	}
+
+#if USE_CHECKSUM_INFO
+	// Deallocate the RAM page to blocks map
+	if (code_pages) {
+		free(code_pages);
+		code_pages = NULL;
+	}
+#endif
 	
 #if PROFILE_COMPILE_TIME
 	write_log("### Compile Block statistics\n");
@@ -5090,6 +5189,11 @@ void compiler_exit(void)
 	write_log("Total emulation time   : %.1f sec\n", double(emul_time)/double(CLOCKS_PER_SEC));
 	write_log("Total compilation time : %.1f sec (%.1f%%)\n", double(compile_time)/double(CLOCKS_PER_SEC),
 		100.0*double(compile_time)/double(emul_time));
+	write_log("Cache tag victim hits  : %u\n", victim_hit_count);
+	write_log("Cache tag misses       : %u\n", cache_miss_count);
+	write_log("Block checksums        : %d\n", checksum_count);
+	write_log("ROM ranges not checked : %u\n", rom_checksum_ranges);
+	write_log("Range flushes          : %u (%u blocks)\n", range_flush_count, range_flush_blocks);
 	write_log("\n");
 #endif
 
@@ -5762,6 +5866,42 @@ void alloc_cache(void)
 
 extern void op_illg_1 (uae_u32 opcode) REGPARAM;
 
+/* Sum and xor of the 32-bit words covering len bytes at pos */
+static __inline__ void checksum_range(uae_u32* pos, uae_s32 len, uae_u32* c1, uae_u32* c2)
+{
+	uae_u32 k1 = *c1;
+	uae_u32 k2 = *c2;
+
+#ifdef __SSE2__
+	if (len >= 32) {
+		__m128i s = _mm_setzero_si128();
+		__m128i x = _mm_setzero_si128();
+		do {
+			__m128i v = _mm_loadu_si128((__m128i *)pos);
+			s = _mm_add_epi32(s, v);
+			x = _mm_xor_si128(x, v);
+			pos += 4;
+			len -= 16;
+		} while (len >= 16);
+		s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+		s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+		x = _mm_xor_si128(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2)));
+		x = _mm_xor_si128(x, _mm_shuffle_epi32(x, _MM_SHUFFLE(2, 3, 0, 1)));
+		k1 += _mm_cvtsi128_si32(s);
+		k2 ^= _mm_cvtsi128_si32(x);
+	}
+#endif
+	while (len > 0) {
+		k1 += *pos;
+		k2 ^= *pos;
+		pos++;
+		len -= 4;
+	}
+
+	*c1 = k1;
+	*c2 = k2;
+}
+
 static void calc_checksum(blockinfo* bi, uae_u32* c1, uae_u32* c2)
 {
     uae_u32 k1 = 0;
@@ -5783,14 +5923,8 @@ static void calc_checksum(blockinfo* bi, uae_u32* c1, uae_u32* c2)
 		tmp &= ~((uintptr)3);
 		pos = (uae_u32 *)tmp;
 
-		if (len >= 0 && len <= MAX_CHECKSUM_LEN) {
-			while (len > 0) {
-				k1 += *pos;
-				k2 ^= *pos;
-				pos++;
-				len -= 4;
-			}
-		}
+		if (len >= 0 && len <= MAX_CHECKSUM_LEN)
+			checksum_range(pos, len, &k1, &k2);
 
 #if USE_CHECKSUM_INFO
 		csi = csi->next;
@@ -5863,6 +5997,7 @@ static void cache_miss(void)
     uae_u32     cl=cacheline(regs.pc_p);
     blockinfo*  bi2=get_blockinfo(cl);
 
+    cache_miss_count++;
     if (!bi) {
 	execute_normal(); /* Compile this block now */
 	return;
@@ -6097,6 +6232,17 @@ static __inline__ void create_popalls(void)
   }
   raw_jmp((uintptr)check_checksum);
 
+  /* Not a popall: the first way of the tag lookup missed, try the
+     second one. Nothing is live at a block's non-direct handler. Since
+     cachelines are even, scaling by half a pointer indexes
+     cache_victims[cl/2]. */
+  align_target(align_jumps);
+  cache_victim_lookup=get_target();
+  r=REG_PC_TMP;
+  raw_mov_l_rm(r,(uintptr)&regs.pc_p);
+  raw_and_l_ri(r,TAGMASK);
+  raw_jmp_m_indexed((uintptr)cache_victims,r,SIZEOF_VOID_P/2);
+
   // no need to further write into popallspace
   vm_protect(popallspace, POPALLSPACE_SIZE, VM_PAGE_READ | VM_PAGE_EXECUTE);
 }
@@ -6326,9 +6472,15 @@ void build_comp(void)
     alloc_cache();
     reset_lists();
 
+#if USE_CHECKSUM_INFO
+    if (!code_pages)
+	code_pages=(page_link **)calloc((RAMSize>>CODE_PAGE_BITS)+1,sizeof(page_link *));
+#endif
+
     for (i=0;i<TAGSIZE;i+=2) {
 	cache_tags[i].handler=(cpuop_func *)popall_execute_normal;
 	cache_tags[i+1].bi=NULL;
+	cache_victims[i>>1]=(cpuop_func *)popall_cache_miss;
     }
     
 #if 0
@@ -6367,6 +6519,7 @@ static void flush_icache_hard(int n)
     while(bi) {
 	cache_tags[cacheline(bi->pc_p)].handler=(cpuop_func *)popall_execute_normal;
 	cache_tags[cacheline(bi->pc_p)+1].bi=NULL;
+	cache_victims[cacheline(bi->pc_p)>>1]=(cpuop_func *)popall_cache_miss;
 	dbi=bi; bi=bi->next;
 	free_blockinfo(dbi);
     }
@@ -6374,6 +6527,7 @@ static void flush_icache_hard(int n)
     while(bi) {
 	cache_tags[cacheline(bi->pc_p)].handler=(cpuop_func *)popall_execute_normal;
 	cache_tags[cacheline(bi->pc_p)+1].bi=NULL;
+	cache_victims[cacheline(bi->pc_p)>>1]=(cpuop_func *)popall_cache_miss;
 	dbi=bi; bi=bi->next;
 	free_blockinfo(dbi);
     }
@@ -6404,16 +6558,14 @@ static inline void flush_icache_lazy(int n)
 	    uae_u32 cl=cacheline(bi->pc_p);
 		if (bi->status==BI_INVALID ||
 			bi->status==BI_NEED_RECOMP) { 
-		if (bi==cache_tags[cl+1].bi) 
-		    cache_tags[cl].handler=(cpuop_func *)popall_execute_normal;
 		bi->handler_to_use=(cpuop_func *)popall_execute_normal;
+		update_cl_handlers(cl);
 		set_dhtu(bi,bi->direct_pen);
 	    bi->status=BI_INVALID;
 	    }
 	    else {
-		if (bi==cache_tags[cl+1].bi) 
-		    cache_tags[cl].handler=(cpuop_func *)popall_check_checksum;
 		bi->handler_to_use=(cpuop_func *)popall_check_checksum;
+		update_cl_handlers(cl);
 		set_dhtu(bi,bi->direct_pcc);
 		bi->status=BI_NEED_CHECK;
 	    }
@@ -6435,45 +6587,49 @@ void flush_icache_range(uae_u8 *start_p, uae_u32 length)
 	if (!active)
 		return;
 
-#if LAZY_FLUSH_ICACHE_RANGE
-	blockinfo *bi = active;
-	while (bi) {
-#if USE_CHECKSUM_INFO
-		bool candidate = false;
-		for (checksum_info *csi = bi->csi; csi; csi = csi->next) {
-			if (((start_p - csi->start_p) < csi->length) ||
-				((csi->start_p - start_p) < length)) {
-				candidate = true;
-				break;
-			}
-		}
-#else
-		// Assume system is consistent and would invalidate the right range
-		const bool candidate = (bi->pc_p - start_p) < length;
-#endif
-		blockinfo *dbi = bi;
-		bi = bi->next;
-		if (candidate) {
-			uae_u32 cl = cacheline(dbi->pc_p);
-			if (dbi->status == BI_INVALID || dbi->status == BI_NEED_RECOMP) {
-				if (dbi == cache_tags[cl+1].bi) 
-					cache_tags[cl].handler = (cpuop_func *)popall_execute_normal;
-				dbi->handler_to_use = (cpuop_func *)popall_execute_normal;
-				set_dhtu(dbi, dbi->direct_pen);
-				dbi->status = BI_INVALID;
-			}
-			else {
-				if (dbi == cache_tags[cl+1].bi) 
-					cache_tags[cl].handler = (cpuop_func *)popall_check_checksum;
-				dbi->handler_to_use = (cpuop_func *)popall_check_checksum;
-				set_dhtu(dbi, dbi->direct_pcc);
-				dbi->status = BI_NEED_CHECK;
+#if LAZY_FLUSH_ICACHE_RANGE && USE_CHECKSUM_INFO
+	/* Only RAM is tracked, anything else gets a full flush */
+	uintptr start = (uintptr)start_p - (uintptr)RAMBaseHost;
+	if (code_pages && length > 0 && start < RAMSize && length <= RAMSize - start) {
+		range_flush_count++;
+		uae_u32 last_page = (start + length - 1) >> CODE_PAGE_BITS;
+		for (uae_u32 page = start >> CODE_PAGE_BITS; page <= last_page; page++) {
+			page_link *pl = code_pages[page];
+			while (pl) {
+				blockinfo *bi = pl->bi;
+				pl = pl->next;
+				if (bi->status == BI_NEED_CHECK)
+					continue;
+				bool candidate = false;
+				for (checksum_info *csi = bi->csi; csi; csi = csi->next) {
+					if ((uintptr)csi->start_p < (uintptr)start_p + length &&
+						(uintptr)start_p < (uintptr)csi->start_p + csi->length) {
+						candidate = true;
+						break;
+					}
+				}
+				if (!candidate)
+					continue;
+				range_flush_blocks++;
+				uae_u32 cl = cacheline(bi->pc_p);
+				if (bi->status == BI_INVALID || bi->status == BI_NEED_RECOMP) {
+					bi->handler_to_use = (cpuop_func *)popall_execute_normal;
+					update_cl_handlers(cl);
+					set_dhtu(bi, bi->direct_pen);
+					bi->status = BI_INVALID;
+				}
+				else {
+					bi->handler_to_use = (cpuop_func *)popall_check_checksum;
+					update_cl_handlers(cl);
+					set_dhtu(bi, bi->direct_pcc);
+					bi->status = BI_NEED_CHECK;
+				}
+				remove_from_list(bi);
+				add_to_dormant(bi);
 			}
-			remove_from_list(dbi);
-			add_to_dormant(dbi);
 		}
+		return;
 	}
-	return;
 #endif
 	flush_icache(-1);
 }
@@ -6656,6 +6812,7 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 	bi->optlevel=optlev;
 	bi->pc_p=(uae_u8*)pc_hist[0].location;
 #if USE_CHECKSUM_INFO
+	remove_from_code_pages(bi);
 	free_checksum_info_chain(bi->csi);
 	bi->csi = NULL;
 #endif
@@ -6697,6 +6854,23 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 	csi->length = max_pcp - min_pcp + LONGEST_68K_INST;
 	csi->next = bi->csi;
 	bi->csi = csi;
+
+	/* ROM is never written to, so only the ranges in RAM need to be
+	   checksummed when the block is revalidated after a flush */
+	if (!trace_in_rom) {
+		checksum_info **csip = &bi->csi;
+		while ((csi = *csip) != NULL) {
+			if (isinrom((uintptr)csi->start_p) && isinrom((uintptr)csi->start_p + csi->length - 1)) {
+				*csip = csi->next;
+				free_checksum_info(csi);
+				rom_checksum_ranges++;
+			}
+			else
+				csip = &csi->next;
+		}
+		if (bi->csi == NULL)
+			trace_in_rom = true;
+	}
 #endif
 
 	bi->needed_flags=liveflags[0];
@@ -6978,6 +7152,7 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 	else {
 	    calc_checksum(bi,&(bi->c1),&(bi->c2));
 		add_to_active(bi);
+		add_to_code_pages(bi);
 	}
 #else
 	if (next_pc_p+extra_len>=max_pcp && 
@@ -7025,7 +7200,8 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 	bi->handler=
 	    bi->handler_to_use=(cpuop_func *)get_target();
 	raw_cmp_l_mi((uintptr)&regs.pc_p,(uintptr)pc_hist[0].location);
-	raw_jnz((uintptr)popall_cache_miss);
+	raw_jnz((uintptr)cache_victim_lookup);
+	uae_u8* handler_body=get_target();
 	comp_pc_p=(uae_u8*)pc_hist[0].location;
 
 	bi->status=BI_FINALIZING;
@@ -7035,6 +7211,13 @@ static void compile_block(cpu_history* pc_hist, int blocklen)
 
 	raw_jmp((uintptr)bi->direct_handler);
 
+	/* The handler used when we sit in the second way of the tag */
+	bi->victim_handler=(cpuop_func *)get_target();
+	raw_cmp_l_mi((uintptr)&regs.pc_p,(uintptr)pc_hist[0].location);
+	raw_jnz((uintptr)popall_cache_miss);
+	raw_add_l_mi((uintptr)&victim_hit_count,1);
+	raw_jmp((uintptr)handler_body);
+
 	current_compile_p=get_target();
 	raise_in_cl_list(bi);
 	
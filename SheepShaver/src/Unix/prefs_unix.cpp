@@ -37,10 +37,14 @@ prefs_desc platform_prefs_items[] = {
 	{"mousewheellines", TYPE_INT32, false, "number of lines to scroll in mouse wheel mode 1"},
 	{"dsp", TYPE_STRING, false,            "audio output (dsp) device name"},
 	{"mixer", TYPE_STRING, false,          "audio mixer device name"},
+	{"audiolatency", TYPE_INT32, false,    "target audio latency in milliseconds (0 = one buffer)"},
 #ifdef HAVE_SIGSEGV_SKIP_INSTRUCTION
 	{"ignoresegv", TYPE_BOOLEAN, false,    "ignore illegal memory accesses"},
 #endif
 	{"idlewait", TYPE_BOOLEAN, false,      "sleep when idle"},
+	{"amqptransient", TYPE_BOOLEAN, false, "publish AMQP Ethernet packets as transient messages"},
+	{"amqpconfirm", TYPE_BOOLEAN, false,   "wait for AMQP publisher confirms"},
+	{"amqprouting", TYPE_BOOLEAN, false,   "route AMQP Ethernet packets by destination on a topic exchange"},
 	{NULL, TYPE_END, false, NULL} // End of list
 };
 
@@ -112,7 +112,9 @@
 #define PPC_DECODE_CACHE 1
 #define PPC_FLIGHT_RECORDER 1
 #define PPC_PROFILE_COMPILE_TIME 0
+#ifndef PPC_PROFILE_GENERIC_CALLS
 #define PPC_PROFILE_GENERIC_CALLS 0
+#endif
 #define PPC_PROFILE_REGS_USE 0
 #define KPX_MAX_CPUS 1
 #if ENABLE_DYNGEN
@@ -422,6 +424,9 @@ typedef struct timeval tm_time_t;
 #if defined(HAVE_PTHREADS) && defined(HAVE_CLOCK_NANOSLEEP)
 #define PRECISE_TIMING 1
 #define PRECISE_TIMING_POSIX 1
+#ifdef HAVE_SYS_TIMERFD_H
+#define PRECISE_TIMING_TIMERFD 1
+#endif
 #elif defined(HAVE_PTHREADS) && defined(__MACH__)
 #define PRECISE_TIMING 1
 #define PRECISE_TIMING_MACH 1
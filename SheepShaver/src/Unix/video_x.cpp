@@ -584,7 +584,7 @@ static bool open_window(int width, int height)
 	// Allocate memory for frame buffer (SIZE is extended to page-boundary)
 	the_host_buffer = the_buffer_copy;
 	the_buffer_size = page_extend((aligned_height + 2) * img->bytes_per_line);
-	the_buffer = (uint8 *)vm_acquire(the_buffer_size);
+	the_buffer = (uint8 *)vosf_acquire_buffer(the_buffer_size);
 	the_buffer_copy = (uint8 *)malloc(the_buffer_size);
 	D(bug("the_buffer = %p, the_buffer_copy = %p, the_host_buffer = %p\n", the_buffer, the_buffer_copy, the_host_buffer));
 #else
@@ -771,7 +771,7 @@ static bool open_fbdev_dga(int width, int height)
 	the_host_buffer = the_buffer;
 	the_buffer_size = page_extend((height + 2) * bytes_per_row);
 	the_buffer_copy = (uint8 *)malloc(the_buffer_size);
-	the_buffer = (uint8 *)vm_acquire(the_buffer_size);
+	the_buffer = (uint8 *)vosf_acquire_buffer(the_buffer_size);
 	D(bug("the_buffer = %p, the_buffer_copy = %p, the_host_buffer = %p\n", the_buffer, the_buffer_copy, the_host_buffer));
 #endif
 
@@ -862,7 +862,7 @@ static bool open_xf86_dga(int width, int height)
 	  the_host_buffer = the_buffer;
 	  the_buffer_size = page_extend((height + 2) * bytes_per_row);
 	  the_buffer_copy = (uint8 *)malloc(the_buffer_size);
-	  the_buffer = (uint8 *)vm_acquire(the_buffer_size);
+	  the_buffer = (uint8 *)vosf_acquire_buffer(the_buffer_size);
 	  D(bug("the_buffer = %p, the_buffer_copy = %p, the_host_buffer = %p\n", the_buffer, the_buffer_copy, the_host_buffer));
 	}
 #else
@@ -2497,7 +2497,7 @@ static void *redraw_func(void *arg)
 #ifdef ENABLE_VOSF
 					if (use_vosf) {
 						XDisplayLock();
-						if (mainBuffer.dirty) {
+						if (video_vosf_dirty()) {
 							LOCK_VOSF;
 							update_display_window_vosf();
 							UNLOCK_VOSF;
@@ -2533,7 +2533,7 @@ static void *redraw_func(void *arg)
 				// Update display (VOSF variant)
 				if (++tick_counter >= frame_skip) {
 					tick_counter = 0;
-					if (mainBuffer.dirty) {
+					if (video_vosf_dirty()) {
 						LOCK_VOSF;
 						update_display_dga_vosf();
 						UNLOCK_VOSF;
@@ -72,7 +72,9 @@
 #define PPC_DECODE_CACHE 1
 #define PPC_FLIGHT_RECORDER 1
 #define PPC_PROFILE_COMPILE_TIME 0
+#ifndef PPC_PROFILE_GENERIC_CALLS
 #define PPC_PROFILE_GENERIC_CALLS 0
+#endif
 #define KPX_MAX_CPUS 1
 #if ENABLE_DYNGEN
 #define PPC_ENABLE_JIT 1
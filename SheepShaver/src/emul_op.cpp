@@ -328,6 +328,10 @@ void EmulOp(M68kRegisters *r, uint32 pc, int selector)
 					ClearInterruptFlag(INTFLAG_ETHER);
 					ExecuteNative(NATIVE_ETHER_IRQ);
 				}
+				if (InterruptFlags & INTFLAG_DISK) {
+					ClearInterruptFlag(INTFLAG_DISK);
+					DiskIOInterrupt();
+				}
 				if (InterruptFlags & INTFLAG_TIMER) {
 					ClearInterruptFlag(INTFLAG_TIMER);
 					TimerInterrupt();
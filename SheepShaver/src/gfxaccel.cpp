@@ -20,6 +20,10 @@
 
 #include "sysdeps.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "prefs.h"
 #include "video.h"
 #include "video_defs.h"
@@ -318,6 +322,160 @@ bool NQD_fillrect_hook(uint32 p)
  *	Isomorphic rectangle blitting
  */
 
+/*
+  BitBlt transfer modes:
+  0 : srcCopy
+  1 : srcOr
+  2 : srcXor
+  3 : srcBic
+  4 : notSrcCopy
+  5 : notSrcOr
+  6 : notSrcXor
+  7 : notSrcBic
+  32 : blend
+  33 : addPin
+  34 : addOver
+  35 : subPin
+  36 : transparent
+  37 : adMax
+  38 : subOver
+  39 : adMin
+  50 : hilite
+*/
+
+// Boolean transfer modes, applied to pixel values
+template< int mode >
+static inline uint8 do_bitblt_op(uint8 src, uint8 dst)
+{
+	switch (mode) {
+	case 0: return src;
+	case 1: return dst | src;
+	case 2: return dst ^ src;
+	case 3: return dst & ~src;
+	case 4: return ~src;
+	case 5: return dst | ~src;
+	case 6: return dst ^ ~src;
+	case 7: return dst & src;
+	}
+	return dst;
+}
+
+#ifdef __SSE2__
+template< int mode >
+static inline __m128i do_bitblt_op(__m128i src, __m128i dst)
+{
+	const __m128i ones = _mm_set1_epi32(-1);
+	switch (mode) {
+	case 0: return src;
+	case 1: return _mm_or_si128(dst, src);
+	case 2: return _mm_xor_si128(dst, src);
+	case 3: return _mm_andnot_si128(src, dst);
+	case 4: return _mm_xor_si128(src, ones);
+	case 5: return _mm_or_si128(dst, _mm_xor_si128(src, ones));
+	case 6: return _mm_xor_si128(dst, _mm_xor_si128(src, ones));
+	case 7: return _mm_and_si128(dst, src);
+	}
+	return dst;
+}
+#endif
+
+// Combine length bytes of source into destination, the first and last
+// bytes only where first_mask and last_mask are set
+template< int mode >
+static void do_bitblt_row(const uint8 *src, uint8 *dst, uint32 length, uint8 first_mask, uint8 last_mask)
+{
+	if (length == 1)
+		first_mask &= last_mask;
+	if (first_mask != 0xff) {
+		*dst = (*dst & ~first_mask) | (do_bitblt_op<mode>(*src, *dst) & first_mask);
+		src++; dst++;
+		if (--length == 0)
+			return;
+	}
+	uint32 n = length - (last_mask != 0xff);
+#ifdef __SSE2__
+	for (; n >= 16; n -= 16) {
+		__m128i s = _mm_loadu_si128((const __m128i *)src);
+		__m128i d = _mm_loadu_si128((const __m128i *)dst);
+		_mm_storeu_si128((__m128i *)dst, do_bitblt_op<mode>(s, d));
+		src += 16; dst += 16;
+	}
+#endif
+	for (; n > 0; n--) {
+		*dst = do_bitblt_op<mode>(*src, *dst);
+		src++; dst++;
+	}
+	if (last_mask != 0xff)
+		*dst = (*dst & ~last_mask) | (do_bitblt_op<mode>(*src, *dst) & last_mask);
+}
+
+// Temporary row of do_bitblt(), kept from one blit to the next
+static uint8 *bitblt_row = NULL;
+static uint32 bitblt_row_size = 0;
+
+static uint8 *get_bitblt_row(uint32 size)
+{
+	if (size > bitblt_row_size) {
+		delete[] bitblt_row;
+		bitblt_row = new uint8[size];
+		bitblt_row_size = size;
+	}
+	return bitblt_row;
+}
+
+// Blit a rectangle of pixels of any depth. Positions are given in bits
+// from the start of the row, pixels are stored MSB first
+template< int mode >
+static void do_bitblt(uint8 *src, int32 src_row_bytes, uint32 src_bit,
+					  uint8 *dst, int32 dst_row_bytes, uint32 dst_bit,
+					  uint32 bits, int height)
+{
+	src += src_bit >> 3; src_bit &= 7;
+	dst += dst_bit >> 3; dst_bit &= 7;
+	const uint32 length = (dst_bit + bits + 7) >> 3;
+	const uint8 first_mask = 0xff >> dst_bit;
+	const uint8 last_mask = 0xff << ((8 - ((dst_bit + bits) & 7)) & 7);
+
+	// Sources that are not aligned like the destination or that overlap
+	// it on the same row are first shifted into a temporary row
+	uint8 *tmp = NULL;
+	const bool overlap = (dst + length > src && src + length + 1 > dst);
+	if (src_bit != dst_bit || overlap)
+		tmp = get_bitblt_row(length + 1);
+	const uint32 src_length = (src_bit + bits + 7) >> 3;
+
+	for (int i = 0; i < height; i++) {
+		const uint8 *s = src;
+		if (tmp) {
+			if (src_bit == dst_bit)
+				memcpy(tmp, src, length);
+			else if (src_bit > dst_bit) {
+				const int shift = src_bit - dst_bit;
+				const uint32 n = src_length - 1 < length ? src_length - 1 : length;
+				uint32 j;
+				for (j = 0; j < n; j++)
+					tmp[j] = (src[j] << shift) | (src[j + 1] >> (8 - shift));
+				if (j < length)
+					tmp[j] = src[j] << shift;
+			}
+			else {
+				const int shift = dst_bit - src_bit;
+				const uint32 n = src_length < length ? src_length : length;
+				tmp[0] = src[0] >> shift;
+				uint32 j;
+				for (j = 1; j < n; j++)
+					tmp[j] = (src[j] >> shift) | (src[j - 1] << (8 - shift));
+				if (j < length)
+					tmp[j] = src[j - 1] << (8 - shift);
+			}
+			s = tmp;
+		}
+		do_bitblt_row<mode>(s, dst, length, first_mask, last_mask);
+		src += src_row_bytes;
+		dst += dst_row_bytes;
+	}
+}
+
 void NQD_bitblt(uint32 p)
 {
 	D(bug("accl_bitblt %08x\n", p));
@@ -332,67 +490,73 @@ void NQD_bitblt(uint32 p)
 	D(bug(" src addr %08x, dest addr %08x\n", ReadMacInt32(p + acclSrcBaseAddr), ReadMacInt32(p + acclDestBaseAddr)));
 	D(bug(" src X %d, src Y %d, dest X %d, dest Y %d\n", src_X, src_Y, dest_X, dest_Y));
 	D(bug(" width %d, height %d\n", width, height));
+	if (width <= 0 || height <= 0)
+		return;
 
 	// And perform the blit
-	const int bpp = bytes_per_pixel(ReadMacInt32(p + acclSrcPixelSize));
-	width *= bpp;
-	if ((int32)ReadMacInt32(p + acclSrcRowBytes) > 0) {
-		const int src_row_bytes = (int32)ReadMacInt32(p + acclSrcRowBytes);
-		const int dst_row_bytes = (int32)ReadMacInt32(p + acclDestRowBytes);
-		uint8 *src = Mac2HostAddr(ReadMacInt32(p + acclSrcBaseAddr) + (src_Y * src_row_bytes) + (src_X * bpp));
-		uint8 *dst = Mac2HostAddr(ReadMacInt32(p + acclDestBaseAddr) + (dest_Y * dst_row_bytes) + (dest_X * bpp));
+	const int depth = ReadMacInt32(p + acclSrcPixelSize);
+	const int mode = ReadMacInt32(p + acclTransferMode);
+	const uint32 src_bit = src_X * depth;
+	const uint32 dst_bit = dest_X * depth;
+	const uint32 bits = width * depth;
+	int32 src_row_bytes = (int32)ReadMacInt32(p + acclSrcRowBytes);
+	int32 dst_row_bytes = (int32)ReadMacInt32(p + acclDestRowBytes);
+	uint8 *src, *dst;
+	if (src_row_bytes > 0) {
+		src = Mac2HostAddr(ReadMacInt32(p + acclSrcBaseAddr) + (src_Y * src_row_bytes));
+		dst = Mac2HostAddr(ReadMacInt32(p + acclDestBaseAddr) + (dest_Y * dst_row_bytes));
+	}
+	else {
+		src_row_bytes = -src_row_bytes;
+		dst_row_bytes = -dst_row_bytes;
+		src = Mac2HostAddr(ReadMacInt32(p + acclSrcBaseAddr) + ((src_Y + height - 1) * src_row_bytes));
+		dst = Mac2HostAddr(ReadMacInt32(p + acclDestBaseAddr) + ((dest_Y + height - 1) * dst_row_bytes));
+		src_row_bytes = -src_row_bytes;
+		dst_row_bytes = -dst_row_bytes;
+	}
+
+	if (mode == 0 && ((src_bit | dst_bit | bits) & 7) == 0) {
+		src += src_bit >> 3;
+		dst += dst_bit >> 3;
 		for (int i = 0; i < height; i++) {
-			memmove(dst, src, width);
+			memmove(dst, src, bits >> 3);
 			src += src_row_bytes;
 			dst += dst_row_bytes;
 		}
+		return;
 	}
-	else {
-		const int src_row_bytes = -(int32)ReadMacInt32(p + acclSrcRowBytes);
-		const int dst_row_bytes = -(int32)ReadMacInt32(p + acclDestRowBytes);
-		uint8 *src = Mac2HostAddr(ReadMacInt32(p + acclSrcBaseAddr) + ((src_Y + height - 1) * src_row_bytes) + (src_X * bpp));
-		uint8 *dst = Mac2HostAddr(ReadMacInt32(p + acclDestBaseAddr) + ((dest_Y + height - 1) * dst_row_bytes) + (dest_X * bpp));
-		for (int i = height - 1; i >= 0; i--) {
-			memmove(dst, src, width);
-			src -= src_row_bytes;
-			dst -= dst_row_bytes;
-		}
+
+	switch (mode) {
+#define DO_BITBLT(MODE) \
+	case MODE: do_bitblt<MODE>(src, src_row_bytes, src_bit, dst, dst_row_bytes, dst_bit, bits, height); break
+	DO_BITBLT(0);
+	DO_BITBLT(1);
+	DO_BITBLT(2);
+	DO_BITBLT(3);
+	DO_BITBLT(4);
+	DO_BITBLT(5);
+	DO_BITBLT(6);
+	DO_BITBLT(7);
+#undef DO_BITBLT
 	}
 }
 
-/*
-  BitBlt transfer modes:
-  0 : srcCopy
-  1 : srcOr
-  2 : srcXor
-  3 : srcBic
-  4 : notSrcCopy
-  5 : notSrcOr
-  6 : notSrcXor
-  7 : notSrcBic
-  32 : blend
-  33 : addPin
-  34 : addOver
-  35 : subPin
-  36 : transparent
-  37 : adMax
-  38 : subOver
-  39 : adMin
-  50 : hilite
-*/
-
 bool NQD_bitblt_hook(uint32 p)
 {
 	D(bug("accl_draw_hook %08x\n", p));
 	NQD_set_dirty_area(p);
 
 	// Check if we can accelerate this bitblt
+	const uint32 depth = ReadMacInt32(p + acclSrcPixelSize);
+	const uint32 transfer_mode = ReadMacInt32(p + acclTransferMode);
 	if (ReadMacInt32(p + 0x018) + ReadMacInt32(p + 0x128) == 0 &&
 		ReadMacInt32(p + 0x130) == 0 &&
-		ReadMacInt32(p + acclSrcPixelSize) >= 8 &&
-		ReadMacInt32(p + acclSrcPixelSize) == ReadMacInt32(p + acclDestPixelSize) &&
+		(depth == 1 || depth == 2 || depth == 4 || depth == 8 || depth == 16 || depth == 32) &&
+		depth == ReadMacInt32(p + acclDestPixelSize) &&
 		(int32)(ReadMacInt32(p + acclSrcRowBytes) ^ ReadMacInt32(p + acclDestRowBytes)) >= 0 &&	// same sign?
-		ReadMacInt32(p + acclTransferMode) == 0 &&												// srcCopy?
+		(transfer_mode == 0 ||																	// srcCopy?
+		 (transfer_mode < 8 && depth <= 8 &&													// boolean mode on indexed
+		  ReadMacInt32(p + acclForePen) == 0xffffffff && ReadMacInt32(p + acclBackPen) == 0)) &&	// pixels, not colorized?
 		(int32)ReadMacInt32(p + 0x15c) > 0) {
 
 		// Yes, set function pointer
@@ -459,3 +623,255 @@ void VideoInstallAccel(void)
 		}
 	}
 }
+
+
+/*
+ *  Test program checking accelerated bitblts against a per-bit reference
+ *  and against fixed QuickDraw results
+ */
+
+#ifdef TEST_GFXACCEL
+// Glue the test program does not use
+uint32 screen_base = 0;
+uintptr SheepMem::data = 0;
+uintptr SheepMem::proc = 0;
+bool PrefsFindBool(const char *name) { return false; }
+uint32 NativeTVECT(int selector) { return 0; }
+void NQDMisc(uint32 arg1, uintptr arg2) { }
+void video_set_dirty_area(int x, int y, int w, int h) { }
+
+// Parameter block of the blits, it must be addressable from the Mac side
+static accl_params test_params;
+
+// Set up test_params for a bitblt of width x height pixels, returns its address
+static uint32 test_setup_bitblt(int mode, int depth, uint8 *src, int32 src_row_bytes, int src_x, int src_y,
+								uint8 *dst, int32 dst_row_bytes, int dst_x, int dst_y, int width, int height)
+{
+	const uint32 p = Host2MacAddr((uint8 *)&test_params);
+	memset(&test_params, 0, sizeof(test_params));
+	WriteMacInt32(p + acclTransferMode, mode);
+	WriteMacInt32(p + acclForePen, 0xffffffff);
+	WriteMacInt32(p + acclBackPen, 0);
+	WriteMacInt32(p + acclSrcBaseAddr, Host2MacAddr(src));
+	WriteMacInt32(p + acclSrcRowBytes, src_row_bytes);
+	WriteMacInt32(p + acclSrcPixelSize, depth);
+	WriteMacInt32(p + acclDestBaseAddr, Host2MacAddr(dst));
+	WriteMacInt32(p + acclDestRowBytes, dst_row_bytes);
+	WriteMacInt32(p + acclDestPixelSize, depth);
+	WriteMacInt16(p + acclSrcRect + 0, src_y);
+	WriteMacInt16(p + acclSrcRect + 2, src_x);
+	WriteMacInt16(p + acclSrcRect + 4, src_y + height);
+	WriteMacInt16(p + acclSrcRect + 6, src_x + width);
+	WriteMacInt16(p + acclDestRect + 0, dst_y);
+	WriteMacInt16(p + acclDestRect + 2, dst_x);
+	WriteMacInt16(p + acclDestRect + 4, dst_y + height);
+	WriteMacInt16(p + acclDestRect + 6, dst_x + width);
+	WriteMacInt32(p + 0x15c, 1);
+	return p;
+}
+
+// Boolean transfer modes, applied to a single bit (notSrc modes are
+// the src modes with an inverted source)
+static int test_bitblt_op(int mode, int src, int dst)
+{
+	if (mode >= 4)
+		src ^= 1;
+	switch (mode & 3) {
+	case 0: return src;
+	case 1: return dst | src;
+	case 2: return dst ^ src;
+	case 3: return dst & (src ^ 1);
+	}
+	return dst;
+}
+
+static inline int test_get_bit(const uint8 *row, uint32 bit)
+{
+	return (row[bit >> 3] >> (7 - (bit & 7))) & 1;
+}
+
+static inline void test_set_bit(uint8 *row, uint32 bit, int value)
+{
+	const uint8 mask = 0x80 >> (bit & 7);
+	row[bit >> 3] = value ? (row[bit >> 3] | mask) : (row[bit >> 3] & ~mask);
+}
+
+static bool test_bitblt(int mode, int depth, bool same_buffer)
+{
+	const int32 row_bytes = 96;
+	const int max_height = 8;
+	const uint32 buffer_size = row_bytes * max_height;
+	static uint8 src[buffer_size], dst[buffer_size], dst_ref[buffer_size], src_row[row_bytes];
+	const uint32 row_pixels = row_bytes * 8 / depth;
+	for (int n = 0; n < 2000; n++) {
+		// Random rectangles, including empty edges and whole rows
+		const uint32 width = 1 + rand() % row_pixels;
+		const uint32 src_x = rand() % (row_pixels - width + 1);
+		const uint32 dst_x = rand() % (row_pixels - width + 1);
+		const int height = 1 + rand() % max_height;
+		for (uint32 i = 0; i < buffer_size; i++)
+			src[i] = dst[i] = rand();
+		uint8 *s = same_buffer ? dst : src;
+
+		// Reference, rows are blitted in order and may overlap themselves
+		memcpy(dst_ref, dst, buffer_size);
+		const uint8 *s_ref = same_buffer ? dst_ref : src;
+		for (int y = 0; y < height; y++) {
+			memcpy(src_row, s_ref + y * row_bytes, row_bytes);
+			uint8 *d = dst_ref + y * row_bytes;
+			for (uint32 i = 0; i < width * depth; i++) {
+				const uint32 dst_bit = dst_x * depth + i;
+				test_set_bit(d, dst_bit, test_bitblt_op(mode, test_get_bit(src_row, src_x * depth + i), test_get_bit(d, dst_bit)));
+			}
+		}
+
+		NQD_bitblt(test_setup_bitblt(mode, depth, s, row_bytes, src_x, 0, dst, row_bytes, dst_x, 0, width, height));
+		if (memcmp(dst_ref, dst, buffer_size) != 0) {
+			printf("mode %d, %d bpp%s: mismatch for %dx%d pixels (source x %d, destination x %d)\n",
+				   mode, depth, same_buffer ? ", same buffer" : "", width, height, src_x, dst_x);
+			return false;
+		}
+	}
+	return true;
+}
+
+// Fixed blits of indexed pixels drawn with a black foreground and a white
+// background, i.e. where the boolean modes combine pixel values bit per
+// bit as in the Inside Macintosh truth tables. Results are 4-byte rows,
+// with a guard byte after each of them
+struct test_bitblt_result {
+	int mode, depth;
+	int src_x, dst_x, width;
+	uint8 src[4], dst[4], result[4];
+};
+
+static const test_bitblt_result test_bitblt_results[] = {
+	{ 0, 1,  0,  4,  8, { 0xf0, 0xf0, 0x00, 0x00 }, { 0x00, 0x00, 0x00, 0x00 }, { 0x0f, 0x00, 0x00, 0x00 } },	// srcCopy
+	{ 1, 1,  0,  0,  8, { 0xf0, 0x00, 0x00, 0x00 }, { 0x0f, 0x00, 0x00, 0x00 }, { 0xff, 0x00, 0x00, 0x00 } },	// srcOr
+	{ 2, 1,  0,  0, 16, { 0xff, 0x0f, 0x00, 0x00 }, { 0xaa, 0xaa, 0xaa, 0xaa }, { 0x55, 0xa5, 0xaa, 0xaa } },	// srcXor
+	{ 3, 1,  0,  0,  8, { 0xf0, 0x00, 0x00, 0x00 }, { 0xff, 0xff, 0x00, 0x00 }, { 0x0f, 0xff, 0x00, 0x00 } },	// srcBic
+	{ 4, 2,  0,  0,  4, { 0x1b, 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00, 0x00 }, { 0xe4, 0x00, 0x00, 0x00 } },	// notSrcCopy
+	{ 5, 4,  0,  0,  2, { 0xf0, 0x00, 0x00, 0x00 }, { 0x00, 0x00, 0x00, 0x00 }, { 0x0f, 0x00, 0x00, 0x00 } },	// notSrcOr
+	{ 6, 8,  0,  0,  2, { 0x0f, 0x00, 0x00, 0x00 }, { 0xff, 0xff, 0x00, 0x00 }, { 0x0f, 0x00, 0x00, 0x00 } },	// notSrcXor
+	{ 7, 8,  0,  0,  1, { 0x3c, 0x00, 0x00, 0x00 }, { 0xf0, 0xf0, 0x00, 0x00 }, { 0x30, 0xf0, 0x00, 0x00 } },	// notSrcBic
+	{ 0, 1,  3, 13, 10, { 0x1f, 0xf8, 0x00, 0x00 }, { 0x00, 0x00, 0x00, 0x00 }, { 0x00, 0x07, 0xfe, 0x00 } },	// unaligned edges
+	{ 2, 1,  9,  1, 14, { 0x00, 0x7f, 0xff, 0x00 }, { 0xff, 0xff, 0xff, 0xff }, { 0x80, 0x01, 0xff, 0xff } },
+	{ 1, 2,  1,  2,  3, { 0x15, 0x00, 0x00, 0x00 }, { 0x80, 0x00, 0x00, 0x00 }, { 0x85, 0x40, 0x00, 0x00 } },
+	{ 3, 4,  1,  2,  3, { 0x0f, 0xff, 0x00, 0x00 }, { 0xff, 0xff, 0xff, 0x00 }, { 0xff, 0x00, 0x0f, 0x00 } },
+};
+
+static bool test_bitblt_fixed(void)
+{
+	static uint8 src[5], dst[5];
+	bool ok = true;
+	for (uint32 i = 0; i < sizeof(test_bitblt_results)/sizeof(test_bitblt_results[0]); i++) {
+		const test_bitblt_result &r = test_bitblt_results[i];
+		memcpy(src, r.src, 4);
+		memcpy(dst, r.dst, 4);
+		src[4] = dst[4] = 0x5a;
+		const uint32 p = test_setup_bitblt(r.mode, r.depth, src, 4, r.src_x, 0, dst, 4, r.dst_x, 0, r.width, 1);
+		if (!NQD_bitblt_hook(p)) {
+			printf("mode %d, %d bpp: not accelerated\n", r.mode, r.depth);
+			ok = false;
+			continue;
+		}
+		NQD_bitblt(p);
+		if (memcmp(dst, r.result, 4) != 0 || dst[4] != 0x5a) {
+			printf("mode %d, %d bpp: got %02x %02x %02x %02x (%02x), expected %02x %02x %02x %02x\n",
+				   r.mode, r.depth, dst[0], dst[1], dst[2], dst[3], dst[4],
+				   r.result[0], r.result[1], r.result[2], r.result[3]);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+// Scrolling: overlapping srcCopy blits within the same buffer
+static bool test_bitblt_scroll(void)
+{
+	static uint8 buf[3 * 8];
+	bool ok = true;
+
+	// Move pixels 0-2 of a 16-bit row one pixel right
+	static const uint8 row_before[8] = { 0x00, 0x01, 0x00, 0x02, 0x00, 0x03, 0x00, 0x04 };
+	static const uint8 row_after[8]  = { 0x00, 0x01, 0x00, 0x01, 0x00, 0x02, 0x00, 0x03 };
+	memcpy(buf, row_before, 8);
+	NQD_bitblt(test_setup_bitblt(0, 16, buf, 8, 0, 0, buf, 8, 1, 0, 3, 1));
+	if (memcmp(buf, row_after, 8) != 0) {
+		printf("srcCopy, 16 bpp: horizontal scroll mismatch\n");
+		ok = false;
+	}
+
+	// Move rows 0-1 one row down, rows are then blitted from the bottom
+	for (int i = 0; i < 3 * 8; i++)
+		buf[i] = i / 8;
+	NQD_bitblt(test_setup_bitblt(0, 32, buf, -8, 0, 0, buf, -8, 0, 1, 2, 2));
+	for (int i = 0; i < 3 * 8; i++) {
+		if (buf[i] != (i < 8 ? 0 : i / 8 - 1)) {
+			printf("srcCopy, 32 bpp: vertical scroll mismatch\n");
+			ok = false;
+			break;
+		}
+	}
+	return ok;
+}
+
+// Only boolean modes on black and white indexed pixels and srcCopy are accelerated
+static bool test_bitblt_hook(void)
+{
+	static uint8 src[4], dst[4];
+	struct {
+		int mode, depth;
+		uint32 fore_pen, back_pen;
+		bool accelerated;
+	} cases[] = {
+		{  0, 32, 0x00000000, 0x00ffffff, true  },	// srcCopy, colorized
+		{  1,  8, 0xffffffff, 0x00000000, true  },	// srcOr
+		{  1,  8, 0x000000c0, 0x00000000, false },	// srcOr, colorized
+		{  2, 16, 0xffffffff, 0x00000000, false },	// srcXor, direct pixels
+		{ 32,  8, 0xffffffff, 0x00000000, false },	// blend
+		{ 33, 32, 0xffffffff, 0x00000000, false },	// addPin
+		{ 36,  8, 0xffffffff, 0x00000000, false },	// transparent
+		{ 50,  8, 0xffffffff, 0x00000000, false },	// hilite
+	};
+	bool ok = true;
+	for (uint32 i = 0; i < sizeof(cases)/sizeof(cases[0]); i++) {
+		const uint32 p = test_setup_bitblt(cases[i].mode, cases[i].depth, src, 4, 0, 0, dst, 4, 0, 0, 1, 1);
+		WriteMacInt32(p + acclForePen, cases[i].fore_pen);
+		WriteMacInt32(p + acclBackPen, cases[i].back_pen);
+		if (NQD_bitblt_hook(p) != cases[i].accelerated) {
+			printf("mode %d, %d bpp, pens %08x/%08x: %s\n", cases[i].mode, cases[i].depth,
+				   cases[i].fore_pen, cases[i].back_pen, cases[i].accelerated ? "not accelerated" : "accelerated");
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+int main(void)
+{
+	static const int depths[] = { 1, 2, 4, 8, 16, 32 };
+	const int depths_count = sizeof(depths)/sizeof(depths[0]);
+	int n_errors = 0;
+	for (int mode = 0; mode < 8; mode++) {
+		for (int i = 0; i < depths_count; i++) {
+			if (!test_bitblt(mode, depths[i], false))
+				n_errors++;
+			if (!test_bitblt(mode, depths[i], true))
+				n_errors++;
+		}
+	}
+	printf("%d bitblt cases checked, %d errors\n", 8 * depths_count * 2, n_errors);
+
+	int n_fixed_errors = 0;
+	if (!test_bitblt_fixed())
+		n_fixed_errors++;
+	if (!test_bitblt_scroll())
+		n_fixed_errors++;
+	if (!test_bitblt_hook())
+		n_fixed_errors++;
+	printf("Fixed bitblt results and hook checked, %d errors\n", n_fixed_errors);
+	n_errors += n_fixed_errors;
+	return n_errors != 0;
+}
+#endif
@@ -183,8 +183,15 @@ sheepshaver_cpu::sheepshaver_cpu()
 	init_decoder();
 
 #if PPC_ENABLE_JIT
-	if (PrefsFindBool("jit"))
+	if (PrefsFindBool("jit")) {
 		enable_jit();
+		set_jit_threshold(PrefsFindInt32("jitthreshold"));
+#if DYNGEN_DIRECT_BLOCK_CHAINING
+		const char *jit_cache = PrefsFindString("jitcache");
+		if (jit_cache && *jit_cache)
+			load_translation_cache(jit_cache);
+#endif
+	}
 #endif
 }
 
@@ -884,6 +891,13 @@ void exit_emul_ppc(void)
 	printf("\n");
 #endif
 
+#if PPC_ENABLE_JIT && DYNGEN_DIRECT_BLOCK_CHAINING
+	// Keep translated ROM code for next run
+	const char *jit_cache = PrefsFindString("jitcache");
+	if (jit_cache && *jit_cache)
+		ppc_cpu->save_translation_cache(jit_cache);
+#endif
+
 	delete ppc_cpu;
 	ppc_cpu = NULL;
 }
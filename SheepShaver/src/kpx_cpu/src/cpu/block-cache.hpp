@@ -31,6 +31,20 @@ private:
 	static const uint32 HASH_SIZE = 1 << HASH_BITS;
 	static const uint32 HASH_MASK = HASH_SIZE - 1;
 
+	// Reverse map from guest pages to active blocks
+	static const uint32 PAGE_BITS = 12;
+	static const uint32 PAGE_HASH_BITS = 15;
+	static const uint32 PAGE_HASH_SIZE = 1 << PAGE_HASH_BITS;
+	static const uint32 PAGE_HASH_MASK = PAGE_HASH_SIZE - 1;
+
+	struct entry;
+	struct page_link
+	{
+		entry *					owner;
+		page_link *				next;
+		page_link **			prev_p;
+	};
+
 	struct entry
 		: public block_info
 	{
@@ -38,10 +52,12 @@ private:
 		entry **				prev_same_cl_p;
 		entry *					next;
 		entry **				prev_p;
+		page_link				page_links[2];		// Blocks are indexed by pages of min_pc and max_pc
 	};
 
 	block_allocator<entry>		allocator;
 	entry *						cache_tags[HASH_SIZE];
+	page_link *					page_tags[PAGE_HASH_SIZE];
 	entry *						active;
 	entry *						dormant;
 
@@ -49,6 +65,14 @@ private:
 		return (addr >> 2) & HASH_MASK;
 	}
 
+	uint32 pageline(uintptr page) const {
+		return page & PAGE_HASH_MASK;
+	}
+
+	void add_to_page_list(entry *bce);
+	void remove_from_page_list(entry *bce);
+	void clear_block(entry *bce);
+
 public:
 
 	block_cache();
@@ -60,6 +84,10 @@ public:
 	void initialize();
 	void clear();
 	void clear_range(uintptr start, uintptr end);
+	template< class predicate >
+	void clear_if(predicate pred);
+	template< class function >
+	void for_each(function & func);
 	block_info *fast_find(uintptr pc);
 	block_info *find(uintptr pc);
 
@@ -92,6 +120,8 @@ void block_cache< block_info, block_allocator >::initialize()
 {
 	for (int i = 0; i < HASH_SIZE; i++)
 		cache_tags[i] = NULL;
+	for (uint32 i = 0; i < PAGE_HASH_SIZE; i++)
+		page_tags[i] = NULL;
 }
 
 template< class block_info, template<class T> class block_allocator >
@@ -116,49 +146,113 @@ void block_cache< block_info, block_allocator >::clear()
 	dormant = NULL;
 }
 
+template< class block_info, template<class T> class block_allocator >
+inline void block_cache< block_info, block_allocator >::clear_block(entry *bce)
+{
+	bce->invalidate();
+	remove_from_cl_list(bce);
+	remove_from_list(bce);
+	delete_blockinfo(bce);
+}
+
 template< class block_info, template<class T> class block_allocator >
 void block_cache< block_info, block_allocator >::clear_range(uintptr start, uintptr end)
 {
-	if (!active)
+	if (!active || start >= end)
 		return;
 
-	entry *p, *q;
-	if (cacheline(start) < cacheline(end - 1)) {
-		// Optimize for short ranges flush
-		const int end_cl = cacheline(end - 1);
-		for (int cl = cacheline(start); cl <= end_cl; cl++) {
-			p = cache_tags[cl];
+	const uintptr start_page = start >> PAGE_BITS;
+	const uintptr end_page = (end - 1) >> PAGE_BITS;
+	if (end_page - start_page < PAGE_HASH_SIZE) {
+		// Only visit blocks indexed by pages overlapping the range.
+		// A block is linked at most once per bucket, so removing the
+		// current block never unlinks the next one in the same bucket
+		for (uintptr page = start_page; page <= end_page; page++) {
+			page_link *p = page_tags[pageline(page)];
 			while (p) {
-				q = p;
-				p = p->next_same_cl;
-				if (q->intersect(start, end)) {
-					q->invalidate();
-					remove_from_cl_list(q);
-					remove_from_list(q);
-					delete_blockinfo(q);
-				}
+				entry *q = p->owner;
+				p = p->next;
+				if (q->intersect(start, end))
+					clear_block(q);
 			}
 		}
 	}
 	else {
-		p = active;
+		// Range covers the whole page index, walk all active blocks
+		entry *p = active;
 		while (p) {
-			q = p;
+			entry *q = p;
 			p = p->next;
-			if (q->intersect(start, end)) {
-				q->invalidate();
-				remove_from_cl_list(q);
-				remove_from_list(q);
-				delete_blockinfo(q);
-			}
+			if (q->intersect(start, end))
+				clear_block(q);
 		}
 	}
 }
 
+template< class block_info, template<class T> class block_allocator >
+template< class predicate >
+void block_cache< block_info, block_allocator >::clear_if(predicate pred)
+{
+	for (int i = 0; i < 2; i++) {
+		entry *p = (i == 0) ? active : dormant;
+		while (p) {
+			entry *q = p;
+			p = p->next;
+			if (pred(q))
+				clear_block(q);
+		}
+	}
+}
+
+template< class block_info, template<class T> class block_allocator >
+template< class function >
+void block_cache< block_info, block_allocator >::for_each(function & func)
+{
+	for (int i = 0; i < 2; i++) {
+		for (entry *p = (i == 0) ? active : dormant; p != NULL; p = p->next)
+			func(p);
+	}
+}
+
+template< class block_info, template<class T> class block_allocator >
+void block_cache< block_info, block_allocator >::add_to_page_list(entry *bce)
+{
+	const uint32 cl[2] = { pageline(bce->min_pc >> PAGE_BITS), pageline(bce->max_pc >> PAGE_BITS) };
+	for (int i = 0; i < 2; i++) {
+		page_link *pl = &bce->page_links[i];
+		if (i > 0 && cl[i] == cl[0]) {
+			pl->prev_p = NULL;
+			break;
+		}
+		pl->owner = bce;
+		pl->next = page_tags[cl[i]];
+		if (pl->next)
+			pl->next->prev_p = &pl->next;
+		page_tags[cl[i]] = pl;
+		pl->prev_p = &page_tags[cl[i]];
+	}
+}
+
+template< class block_info, template<class T> class block_allocator >
+void block_cache< block_info, block_allocator >::remove_from_page_list(entry *bce)
+{
+	for (int i = 0; i < 2; i++) {
+		page_link *pl = &bce->page_links[i];
+		if (pl->prev_p == NULL)
+			continue;
+		*pl->prev_p = pl->next;
+		if (pl->next)
+			pl->next->prev_p = pl->prev_p;
+		pl->prev_p = NULL;
+	}
+}
+
 template< class block_info, template<class T> class block_allocator >
 inline block_info *block_cache< block_info, block_allocator >::new_blockinfo()
 {
 	entry * bce = allocator.acquire();
+	bce->page_links[0].prev_p = NULL;
+	bce->page_links[1].prev_p = NULL;
 	return bce;
 }
 
@@ -239,6 +333,7 @@ void block_cache< block_info, block_allocator >::remove_from_list(block_info *bi
 		*bce->prev_p = bce->next;
 	if (bce->next)
 		bce->next->prev_p = bce->prev_p;
+	remove_from_page_list(bce);
 }
 
 template< class block_info, template<class T> class block_allocator >
@@ -252,6 +347,7 @@ void block_cache< block_info, block_allocator >::add_to_active_list(block_info *
 	
 	active = bce;
 	bce->prev_p = &active;
+	add_to_page_list(bce);
 }
 
 template< class block_info, template<class T> class block_allocator >
@@ -181,3 +181,26 @@ basic_dyngen::gen_align(int align)
 #endif
 	return code_ptr();
 }
+
+// Run every basic code generator and hash the opcodes they emit
+class basic_dyngen_ops_hasher
+	: public dyngen_ops_hasher
+{
+#	define DEFINE_GEN(NAME,RET,ARGS) RET NAME(long param1 = 0, long param2 = 0, long param3 = 0)
+#	include "basic-dyngen-ops.hpp"
+
+public:
+	basic_dyngen_ops_hasher(uint64 seed)
+		: dyngen_ops_hasher(seed)
+	{
+#	undef DYNGEN_IMPL
+#	define DEFINE_GEN(NAME,RET,ARGS) NAME();
+#	include "basic-dyngen-ops.hpp"
+	}
+};
+
+uint64
+basic_dyngen::ops_hash()
+{
+	return basic_dyngen_ops_hasher(UVAL64(0xcbf29ce484222325)).value();
+}
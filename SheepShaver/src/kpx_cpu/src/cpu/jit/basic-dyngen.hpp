@@ -104,6 +104,10 @@ public:
 	// Execute compiled function at ENTRY_POINT
 	void execute(uint8 *entry_point);
 
+	// Address that returns from generated code to execute()
+	uint8 *exec_return_addr() const
+		{ return execute_func + op_exec_return_offset; }
+
 	// Return from compiled code
 	void gen_exec_return();
 
@@ -236,6 +240,56 @@ public:
 	// Address of jump offset to patch for direct chaining
 	static const int MAX_JUMPS = 2;
 	uint8 *jmp_addr[MAX_JUMPS];
+
+	// Hash of the code of all synthetic opcodes
+	static uint64 ops_hash();
+};
+
+// Base of the classes that run every code generator of a dyngen ops
+// header into a scratch buffer, so as to hash the opcode code bytes
+class dyngen_ops_hasher
+{
+	uint64 hash;
+	uint8 code_buf[1024];
+
+	void update(const void *data, uint32 size)
+	{
+		const uint8 *p = (const uint8 *)data;
+		while (size-- > 0) {
+			hash ^= *p++;
+			hash *= UVAL64(0x100000001b3);
+		}
+	}
+
+protected:
+
+	// Code generator interface used by the dyngen ops headers
+	uint8 *jmp_addr[basic_dyngen::MAX_JUMPS];
+	uint8 *code_ptr()
+		{ return code_buf; }
+	void inc_code_ptr(int offset)
+		{ }
+	void copy_block(const uint8 *block, uint32 size)
+	{
+		assert(size <= sizeof(code_buf));
+		update(&size, sizeof(size));
+		update(block, size);
+		memcpy(code_buf, block, size);
+	}
+	uint8 *copy_data(const uint8 *block, uint32 size)
+	{
+		update(block, size);
+		return code_buf;
+	}
+
+	dyngen_ops_hasher(uint64 seed)
+		: hash(seed)
+		{ }
+
+public:
+
+	uint64 value() const
+		{ return hash; }
 };
 
 inline bool
@@ -277,7 +331,7 @@ basic_dyngen::execute(uint8 *entry_point)
 inline void
 basic_dyngen::gen_exec_return()
 {
-	gen_jmp(execute_func + op_exec_return_offset);
+	gen_jmp(exec_return_addr());
 }
 
 inline bool
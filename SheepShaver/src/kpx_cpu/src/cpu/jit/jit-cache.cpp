@@ -35,8 +35,15 @@ const int JIT_CACHE_SIZE = 8 * 1024;
 #endif
 const int JIT_CACHE_SIZE_GUARD = 4096;
 
+// Number of translation cache regions
+const int JIT_CACHE_REGIONS = 8;
+
 basic_jit_cache::basic_jit_cache()
-	: cache_size(0), tcode_start(NULL), code_start(NULL), code_p(NULL), code_end(NULL), data(NULL)
+	: cache_size(0), tcode_start(NULL), code_start(NULL), code_p(NULL), code_end(NULL),
+	  region_size(0), region_count(0), region_index(0), region_end(NULL),
+	  pin_start(NULL), pin_p(NULL), pin_end(NULL), pin_data_p(NULL), pin_data_end(NULL),
+	  pin_full(false), pin_rewrite(false), saved_code_p(NULL), saved_region_end(NULL),
+	  data(NULL)
 {
 }
 
@@ -79,8 +86,123 @@ basic_jit_cache::init_translation_cache(uint32 size)
 	
 	D(bug("basic_jit_cache: Translation cache: %d KB at %p\n", cache_size / 1024, tcode_start));
 	code_start = tcode_start;
-	code_p = code_start;
-	code_end = code_p + size;
+	code_end = code_start + size;
+	init_cache_regions();
+	return true;
+}
+
+void
+basic_jit_cache::init_cache_regions()
+{
+	// Each region but the last one keeps its own guard area so that
+	// a block overflowing its region never spills into the next one
+	region_count = JIT_CACHE_REGIONS;
+	region_size = ((code_end - code_start) / region_count) & -16;
+	if (region_size < 4 * JIT_CACHE_SIZE_GUARD) {
+		region_count = 1;
+		region_size = code_end - code_start;
+	}
+	D(bug("basic_jit_cache: %d regions of %d KB\n", region_count, region_size / 1024));
+	set_cache_region(0);
+}
+
+void
+basic_jit_cache::set_cache_region(uint32 index)
+{
+	region_index = index;
+	code_p = code_start + index * region_size;
+	if (index == region_count - 1)
+		region_end = code_end;
+	else
+		region_end = code_p + region_size - JIT_CACHE_SIZE_GUARD;
+}
+
+bool
+basic_jit_cache::next_cache_region(uint8 * & start, uint8 * & end)
+{
+	if (region_count <= 1)
+		return false;
+
+	set_cache_region((region_index + 1) % region_count);
+	start = code_p;
+	if (region_index == region_count - 1)
+		end = tcode_start + cache_size;
+	else
+		end = code_p + region_size;
+	D(bug("basic_jit_cache: Recycle region %d [%p - %p]\n", region_index, start, end));
+	return true;
+}
+
+bool
+basic_jit_cache::init_pinned_area(uint32 code_size, uint32 data_size)
+{
+	code_size = (code_size + 15) & -16;
+	data_size = (data_size + 15) & -16;
+	if (pin_start || code_p != code_start)
+		return false;
+	if (code_size < 4 * JIT_CACHE_SIZE_GUARD || code_size + data_size + 16 > (uint32)(code_end - code_start) / 2)
+		return false;
+
+	pin_start = pin_p = (uint8 *)(((uintptr)code_start + 15) & -16);
+	pin_end = pin_data_p = pin_start + code_size;
+	pin_data_end = pin_end + data_size;
+	pin_full = false;
+	D(bug("basic_jit_cache: Pinned area: %d KB code, %d KB data at %p\n", code_size / 1024, data_size / 1024, pin_start));
+
+	code_start = pin_data_end;
+	init_cache_regions();
+	return true;
+}
+
+bool
+basic_jit_cache::enter_pinned_area(uint8 *ptr)
+{
+	if (pin_start == NULL || saved_code_p != NULL)
+		return false;
+	if (ptr) {
+		if (ptr < pin_start || ptr >= pin_p)
+			return false;
+		pin_rewrite = true;
+	}
+	else {
+		if (pin_full)
+			return false;
+		ptr = pin_p;
+		pin_rewrite = false;
+	}
+	saved_code_p = code_p;
+	saved_region_end = region_end;
+	code_p = ptr;
+	region_end = pin_end - JIT_CACHE_SIZE_GUARD;
+	return true;
+}
+
+void
+basic_jit_cache::leave_pinned_area(bool full)
+{
+	assert(saved_code_p != NULL);
+	if (full)
+		pin_full = true;
+	else if (!pin_rewrite)
+		pin_p = code_p;
+	code_p = saved_code_p;
+	region_end = saved_region_end;
+	saved_code_p = NULL;
+	saved_region_end = NULL;
+}
+
+bool
+basic_jit_cache::restore_pinned_area(const uint8 *code, uint32 code_size, const uint8 *data, uint32 data_size)
+{
+	if (pin_start == NULL || pin_p != pin_start || pin_data_p != pin_end)
+		return false;
+	if (code_size > (uint32)(pin_end - JIT_CACHE_SIZE_GUARD - pin_start) || data_size > (uint32)(pin_data_end - pin_end))
+		return false;
+
+	memcpy(pin_start, code, code_size);
+	pin_p = pin_start + code_size;
+	memcpy(pin_end, data, data_size);
+	pin_data_p = pin_end + data_size;
 	return true;
 }
 
@@ -92,6 +214,8 @@ basic_jit_cache::kill_translation_cache()
 		vm_release(tcode_start, cache_size);
 		cache_size = 0;
 		tcode_start = NULL;
+		pin_start = pin_p = pin_end = NULL;
+		pin_data_p = pin_data_end = NULL;
 	}
 }
 
@@ -103,6 +227,31 @@ basic_jit_cache::initialize(void)
 	return tcode_start && cache_size;
 }
 
+bool
+basic_jit_cache::move_translation_cache(uint8 *addr)
+{
+	if (tcode_start == NULL || addr == tcode_start)
+		return tcode_start != NULL;
+
+	if (vm_acquire_at(addr, cache_size, VM_MAP_PRIVATE | VM_MAP_32BIT) < 0)
+		return false;
+	if (vm_protect(addr, cache_size,
+				   VM_PAGE_READ | VM_PAGE_WRITE | VM_PAGE_EXECUTE) < 0) {
+		vm_release(addr, cache_size);
+		return false;
+	}
+
+	D(bug("basic_jit_cache: Move translation cache from %p to %p\n", tcode_start, addr));
+	const uint32 size = code_end - tcode_start;
+	vm_release(tcode_start, cache_size);
+	tcode_start = code_start = addr;
+	code_end = code_start + size;
+	pin_start = pin_p = pin_end = NULL;
+	pin_data_p = pin_data_end = NULL;
+	init_cache_regions();
+	return true;
+}
+
 void
 basic_jit_cache::set_cache_size(uint32 size)
 {
@@ -117,6 +266,15 @@ basic_jit_cache::copy_data(const uint8 *block, uint32 size)
 	const int ALIGN = 16;
 	uint8 *ptr;
 
+	// Use the data pool of the pinned area first
+	if (pin_data_p && (pin_data_p + size) <= pin_data_end) {
+		ptr = pin_data_p;
+		memcpy(ptr, block, size);
+		pin_data_p += (size + ALIGN - 1) & -ALIGN;
+		D(bug("basic_jit_cache: DATA %p, %d bytes [pinned]\n", ptr, size));
+		return ptr;
+	}
+
 	if (data && (data->offs + size) < data->size)
 		ptr = (uint8 *)data + data->offs;
 	else {
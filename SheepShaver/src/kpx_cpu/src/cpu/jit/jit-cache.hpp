@@ -37,6 +37,25 @@ class basic_jit_cache
 	uint8 *code_p;
 	uint8 *code_end;
 
+	// Translation cache regions, recycled in FIFO order when full
+	uint32 region_size;
+	uint32 region_count;
+	uint32 region_index;
+	uint8 *region_end;
+	void init_cache_regions();
+	void set_cache_region(uint32 index);
+
+	// Pinned code area, never recycled, and its embedded data pool
+	uint8 *pin_start;
+	uint8 *pin_p;
+	uint8 *pin_end;
+	uint8 *pin_data_p;
+	uint8 *pin_data_end;
+	bool pin_full;
+	bool pin_rewrite;
+	uint8 *saved_code_p;
+	uint8 *saved_region_end;
+
 	// Data pool (32-bit addressable)
 	struct data_chunk_t {
 		uint32 size;
@@ -69,10 +88,48 @@ public:
 	bool initialize(void);
 	void set_cache_size(uint32 size);
 
+	// Move the translation cache to ADDR if that region is free. All
+	// code is discarded, the code generator must be initialized again
+	bool move_translation_cache(uint8 *addr);
+
 	// Invalidate translation cache
 	void invalidate_cache();
 	bool full_translation_cache() const
-		{ return code_p >= code_end; }
+		{ return code_p >= region_end; }
+
+	// Move code generation to the start of the next, i.e. oldest,
+	// translation cache region. Returns FALSE if the cache is made of
+	// a single region and must be invalidated as a whole. Otherwise,
+	// [START, END[ is the range of code the caller has to evict
+	bool next_cache_region(uint8 * & start, uint8 * & end);
+
+	// Carve a pinned area of CODE_SIZE bytes, followed by a data pool
+	// of DATA_SIZE bytes, out of the translation cache. Code emitted
+	// there is never recycled and the data pool is used first by
+	// copy_data(), so that both keep their addresses for the lifetime
+	// of the cache. This must be done before any code is generated
+	bool init_pinned_area(uint32 code_size, uint32 data_size);
+	bool has_pinned_area() const	{ return pin_start != NULL; }
+
+	// Redirect code generation to the pinned area, at its current
+	// position or at PTR to rewrite code emitted there before.
+	// Returns FALSE if there is no pinned area or if it is full
+	bool enter_pinned_area(uint8 *ptr = NULL);
+	void leave_pinned_area(bool full = false);
+
+	// Pinned area contents, e.g. to save or restore them from disk
+	uint8 *cache_start() const		{ return tcode_start; }
+	uint32 cache_bytes() const		{ return cache_size; }
+	uint8 *pinned_code() const		{ return pin_start; }
+	uint32 pinned_code_size() const	{ return pin_p - pin_start; }
+	uint8 *pinned_data() const		{ return pin_end; }
+	uint32 pinned_data_size() const	{ return pin_data_p - pin_end; }
+	bool in_pinned_area(const uint8 *ptr) const
+		{ return ptr >= pin_start && ptr < pin_end; }
+	bool restore_pinned_area(const uint8 *code, uint32 code_size, const uint8 *data, uint32 data_size);
+
+	// Returns TRUE if some data had to be allocated out of the cache
+	bool data_pool_overflow() const	{ return data != NULL; }
 
 	// Emit code to translation cache
 	template< typename T >
@@ -94,12 +151,16 @@ basic_jit_cache::set_code_start(uint8 *ptr)
 {
 	assert(ptr >= tcode_start && ptr < code_end);
 	code_start = ptr;
+	init_cache_regions();
 }
 
 inline void
 basic_jit_cache::invalidate_cache()
 {
-	code_p = code_start;
+	set_cache_region(0);
+	pin_p = pin_start;
+	pin_data_p = pin_end;
+	pin_full = false;
 }
 
 template< class T >
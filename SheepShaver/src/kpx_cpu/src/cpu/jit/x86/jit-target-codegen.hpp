@@ -498,10 +498,6 @@ public:
 	DEFINE_OP_PS(rsqrt, RSQRT);
 	DEFINE_OP_SS(sqrt, SQRT);
 	DEFINE_OP_PS(sqrt, SQRT);
-	DEFINE_OP_SS(comi, COMI);
-	DEFINE_OP_SD(comi, COMI);
-	DEFINE_OP_SS(ucomi, UCOMI);
-	DEFINE_OP_SD(ucomi, UCOMI);
 
 #undef DEFINE_OP
 #undef DEFINE_OP_S
@@ -525,6 +521,7 @@ public:
 	DEFINE_OP(movapd, MOVAPD);
 	DEFINE_OP(movdqa, MOVDQA);
 	DEFINE_OP(movdqu, MOVDQU);
+	DEFINE_OP(movsd, MOVSD);
 
 #undef DEFINE_OP
 
@@ -537,6 +534,13 @@ public:
 		{ GEN_CODE(OP##mr(mem.MD, mem.MB, mem.MI, mem.MS, d)); }
 
 	DEFINE_OP(movd_lx, MOVDXD);
+	DEFINE_OP(comiss, COMISS);
+	DEFINE_OP(comisd, COMISD);
+	DEFINE_OP(ucomiss, UCOMISS);
+	DEFINE_OP(ucomisd, UCOMISD);
+	DEFINE_OP(cvtsd2ss, CVTSD2SS);
+	DEFINE_OP(cvtss2sd, CVTSS2SD);
+	DEFINE_OP(cvttsd2si_32, CVTTSD2SIL);
 
 #undef DEFINE_OP
 
@@ -43,6 +43,8 @@ struct powerpc_block_info
 #endif
 #if PPC_ENABLE_JIT
 	uint8 *				entry_point;
+	uint8 *				exit_addr;						// Address of exit code that references this block, if any
+	bool				persistent;						// Translated code can be saved to disk
 #if DYNGEN_DIRECT_BLOCK_CHAINING
 	struct link_info {
 		uint8 *			jmp_resolve_addr;				// Address of default code to resolve target addr
@@ -68,6 +70,8 @@ powerpc_block_info::init(uintptr start_pc)
 	di = NULL;
 #endif
 #if PPC_ENABLE_JIT
+	exit_addr = NULL;
+	persistent = false;
 #if DYNGEN_DIRECT_BLOCK_CHAINING
 	for (int i = 0; i < MAX_TARGETS; i++)
 		li[i].jmp_pc = INVALID_PC;
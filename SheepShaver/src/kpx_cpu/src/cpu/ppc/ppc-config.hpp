@@ -130,6 +130,9 @@
  *	PPC_PROFILE_GENERIC_CALLS
  *
  *		Define to enable some generic handler invocation statistics.
+ *		Instructions the JIT does not translate natively are ranked
+ *		by number of calls when the last CPU is destroyed, e.g. build
+ *		with CPPFLAGS=-DPPC_PROFILE_GENERIC_CALLS=1 and quit normally.
  **/
 
 #ifndef PPC_PROFILE_GENERIC_CALLS
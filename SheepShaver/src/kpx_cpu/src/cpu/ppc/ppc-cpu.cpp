@@ -47,9 +47,9 @@ const int generic_calls_top_ten = 20;
 
 int generic_calls_compare(const void *e1, const void *e2)
 {
-	const int id1 = *(const int *)e1;
-	const int id2 = *(const int *)e2;
-	return powerpc_cpu::generic_calls_count[id2] - powerpc_cpu::generic_calls_count[id1];
+	const uint32 count1 = powerpc_cpu::generic_calls_count[*(const int *)e1];
+	const uint32 count2 = powerpc_cpu::generic_calls_count[*(const int *)e2];
+	return (count1 < count2) - (count1 > count2);
 }
 #endif
 
@@ -299,6 +299,14 @@ void powerpc_cpu::initialize()
 	compile_count = 0;
 	compile_time = 0;
 	emul_start_time = clock();
+#if PPC_ENABLE_JIT
+	memset(evicted_map, 0, sizeof(evicted_map));
+	evict_count = 0;
+	recompile_count = 0;
+	tier_count = 0;
+	tier_up_count = 0;
+	cached_block_count = 0;
+#endif
 #endif
 }
 
@@ -365,6 +373,11 @@ powerpc_cpu::powerpc_cpu(task_struct *parent_task)
 {
 #if PPC_ENABLE_JIT
 	use_jit = false;
+	jit_threshold = 0;
+#if DYNGEN_DIRECT_BLOCK_CHAINING
+	chain_resolve_addr = NULL;
+	pin_rom_code = false;
+#endif
 #endif
 	++ppc_refcount;
 	initialize();
@@ -394,6 +407,17 @@ powerpc_cpu::~powerpc_cpu()
 		printf("Total %s time : %.1f sec (%.1f%%)\n", type,
 			   double(compile_time) / double(CLOCKS_PER_SEC),
 			   100.0 * double(compile_time) / double(emul_time));
+#if PPC_ENABLE_JIT
+		if (use_jit) {
+			printf("Total translation cache evictions : %d\n", evict_count);
+			printf("Total block recompile count : %d\n", recompile_count);
+			if (cached_block_count)
+				printf("Total blocks loaded from disk : %d\n", cached_block_count);
+			if (tier_count)
+				printf("Total block tier-up count : %d/%d (%.1f%%)\n", tier_up_count, tier_count,
+					   100.0 * double(tier_up_count) / double(tier_count));
+		}
+#endif
 		printf("\n");
 	}
 #endif
@@ -406,14 +430,22 @@ powerpc_cpu::~powerpc_cpu()
 			total_generic_calls_count += generic_calls_count[i];
 		}
 		qsort(generic_calls_ids, PPC_I(MAX), sizeof(int), generic_calls_compare);
-		printf("Rank      Count Ratio Name\n");
+		printf("\n### Statistics for generic calls (%llu)\n", total_generic_calls_count);
+		printf("Rank      Count Ratio  [Cumul] Name\n");
+		uint64 cum_generic_calls_count = 0;
 		for (int i = 0; i < generic_calls_top_ten; i++) {
 			uint32 mnemo = generic_calls_ids[i];
 			uint32 count = generic_calls_count[mnemo];
+			if (count == 0)
+				break;
+			cum_generic_calls_count += count;
 			const instr_info_t *ii = powerpc_ii_table;
 			while (ii->mnemo != mnemo)
 				ii++;
-			printf("%03d: %10lu %2.1f%% %s\n", i, count, 100.0*double(count)/double(total_generic_calls_count), ii->name);
+			printf("%03d: %10u %5.1f%% [%5.1f%%] %s\n", i, count,
+				   100.0*double(count)/double(total_generic_calls_count),
+				   100.0*double(cum_generic_calls_count)/double(total_generic_calls_count),
+				   ii->name);
 		}
 	}
 #endif
@@ -551,15 +583,145 @@ void *powerpc_cpu::compile_chain_block(block_info *sbi)
 
 	const uint32 tpc = sbi->li[n].jmp_pc;
 	block_info *tbi = my_block_cache.find(tpc);
-	if (tbi == NULL)
+	if (tbi == NULL) {
+		// We return to the resolver code of SBI, make sure its
+		// translation cache region is not recycled meanwhile
+		chain_resolve_addr = sbi->li[n].jmp_resolve_addr;
 		tbi = compile_block(tpc);
+		chain_resolve_addr = NULL;
+	}
 	assert(tbi && tbi->pc == tpc);
 
+#if PPC_DECODE_CACHE
+	// Don't link to a cold block, it is not translated yet
+	if (tbi->di != NULL)
+		return tbi->entry_point;
+#endif
+
+	// Record the link so that it can be undone if TBI goes away
 	dg_set_jmp_target(sbi->li[n].jmp_addr, tbi->entry_point);
+	sbi->remove_dep(&sbi->dep[n]);
+	sbi->create_jmpdep(tbi, n);
 	return tbi->entry_point;
 }
 #endif
 
+#if PPC_DECODE_CACHE
+powerpc_cpu::block_info *powerpc_cpu::predecode_block(uint32 entry)
+{
+#if PPC_EXECUTE_DUMP_STATE
+	const bool dump_state = true;
+#endif
+#if PPC_PROFILE_COMPILE_TIME
+#if PPC_ENABLE_JIT
+	if (use_jit)
+		tier_count++;
+	else
+#endif
+	compile_count++;
+	clock_t start_time;
+	start_time = clock();
+#endif
+	block_info *bi = my_block_cache.new_blockinfo();
+	bi->init(entry);
+	bi->count = 0;
+#if PPC_ENABLE_JIT
+	// Get out of compiled code if it jumps here
+	bi->entry_point = use_jit ? codegen.exec_return_addr() : NULL;
+#endif
+
+	// Predecode a new block
+	block_info::decode_info *di;
+	const instr_info_t *ii;
+	uint32 dpc;
+	di = bi->di = decode_cache_p;
+	dpc = entry - 4;
+	do {
+		uint32 opcode = vm_read_memory_4(dpc += 4);
+		ii = decode(opcode);
+#if PPC_EXECUTE_DUMP_STATE
+		if (dump_state) {
+			di->opcode = opcode;
+			di->execute = nv_mem_fun(&powerpc_cpu::dump_instruction);
+			di++;
+		}
+#endif
+#if PPC_FLIGHT_RECORDER
+		if (is_logging()) {
+			di->opcode = opcode;
+			di->execute = nv_mem_fun(&powerpc_cpu::record_step);
+			di++;
+		}
+#endif
+		di->opcode = opcode;
+		di->execute = ii->execute;
+		di++;
+#if PPC_EXECUTE_DUMP_STATE
+		if (dump_state) {
+			di->opcode = 0;
+			di->execute = nv_mem_fun(&powerpc_cpu::fake_dump_registers);
+			di++;
+		}
+#endif
+		if (di >= decode_cache_end_p) {
+			// Invalidate cache and move current code to start
+			invalidate_decode_cache();
+			const int blocklen = di - bi->di;
+			memmove(decode_cache_p, bi->di, blocklen * sizeof(*di));
+			bi->di = decode_cache_p;
+			di = bi->di + blocklen;
+		}
+	} while ((ii->cflow & CFLOW_END_BLOCK) == 0);
+	bi->end_pc = dpc;
+	bi->min_pc = entry;
+	bi->max_pc = dpc;
+	bi->size = di - bi->di;
+	my_block_cache.add_to_cl_list(bi);
+	my_block_cache.add_to_active_list(bi);
+	decode_cache_p += bi->size;
+#if PPC_PROFILE_COMPILE_TIME
+	compile_time += (clock() - start_time);
+#endif
+	return bi;
+}
+
+inline void powerpc_cpu::execute_predecoded_block(block_info *bi)
+{
+	const int r = bi->size % 4;
+	block_info::decode_info *di = bi->di + r;
+	int n = (bi->size + 3) / 4;
+	switch (r) {
+	case 0: do {
+			di += 4;
+			di[-4].execute(this, di[-4].opcode);
+	case 3: di[-3].execute(this, di[-3].opcode);
+	case 2: di[-2].execute(this, di[-2].opcode);
+	case 1: di[-1].execute(this, di[-1].opcode);
+		} while (--n > 0);
+	}
+}
+
+struct predecoded_block_predicate
+{
+	bool operator()(powerpc_block_info *bi) const
+		{ return bi->di != NULL; }
+};
+
+void powerpc_cpu::invalidate_decode_cache()
+{
+#if PPC_ENABLE_JIT
+	if (use_jit) {
+		// Translated code is still valid, only drop cold blocks
+		D(bug("Invalidate predecoded blocks\n"));
+		my_block_cache.clear_if(predecoded_block_predicate());
+		decode_cache_p = decode_cache;
+		return;
+	}
+#endif
+	invalidate_cache();
+}
+#endif
+
 void powerpc_cpu::execute(uint32 entry)
 {
 	bool invalidated_cache = false;
@@ -572,10 +734,38 @@ void powerpc_cpu::execute(uint32 entry)
 	if (execute_depth == 1 || (PPC_ENABLE_JIT && PPC_REENTRANT_JIT)) {
 #if PPC_ENABLE_JIT
 		if (use_jit) {
-			block_info *bi = my_block_cache.find(pc());
-			if (bi == NULL)
-				bi = compile_block(pc());
 			for (;;) {
+				block_info *bi = my_block_cache.find(pc());
+#if PPC_DECODE_CACHE
+				if (jit_threshold > 0 && (bi == NULL || bi->di != NULL)) {
+					// Run cold blocks from the predecode cache
+					if (bi == NULL)
+						bi = predecode_block(pc());
+					if (++bi->count < jit_threshold) {
+						execute_predecoded_block(bi);
+						if (!spcflags().empty()) {
+							if (!check_spcflags())
+								goto return_site;
+							if (spcflags().test(SPCFLAG_JIT_EXEC_RETURN)) {
+								spcflags().clear(SPCFLAG_JIT_EXEC_RETURN);
+								invalidated_cache = true;
+							}
+						}
+						continue;
+					}
+
+					// The block is hot enough, translate it
+#if PPC_PROFILE_COMPILE_TIME
+					tier_up_count++;
+#endif
+					my_block_cache.remove_from_lists(bi);
+					my_block_cache.delete_blockinfo(bi);
+					bi = NULL;
+				}
+#endif
+				if (bi == NULL)
+					bi = compile_block(pc());
+
 				// Execute all cached blocks
 				for (;;) {
 					codegen.execute(bi->entry_point);
@@ -597,10 +787,11 @@ void powerpc_cpu::execute(uint32 entry)
 					// get here if the fast cache lookup failed too.
 					if ((bi = my_block_cache.find(pc())) == NULL)
 						break;
+#if PPC_DECODE_CACHE
+					if (bi->di != NULL)
+						break;
+#endif
 				}
-
-				// Compile new block
-				bi = compile_block(pc());
 			}
 		}
 #endif
@@ -609,82 +800,12 @@ void powerpc_cpu::execute(uint32 entry)
 		if (bi != NULL)
 			goto pdi_execute;
 		for (;;) {
-#if PPC_PROFILE_COMPILE_TIME
-			compile_count++;
-			clock_t start_time;
-			start_time = clock();
-#endif
-			bi = my_block_cache.new_blockinfo();
-			bi->init(pc());
-
-			// Predecode a new block
-			block_info::decode_info *di;
-			const instr_info_t *ii;
-			uint32 dpc;
-			di = bi->di = decode_cache_p;
-			dpc = pc() - 4;
-			do {
-				uint32 opcode = vm_read_memory_4(dpc += 4);
-				ii = decode(opcode);
-#if PPC_EXECUTE_DUMP_STATE
-				if (dump_state) {
-					di->opcode = opcode;
-					di->execute = nv_mem_fun(&powerpc_cpu::dump_instruction);
-					di++;
-				}
-#endif
-#if PPC_FLIGHT_RECORDER
-				if (is_logging()) {
-					di->opcode = opcode;
-					di->execute = nv_mem_fun(&powerpc_cpu::record_step);
-					di++;
-				}
-#endif
-				di->opcode = opcode;
-				di->execute = ii->execute;
-				di++;
-#if PPC_EXECUTE_DUMP_STATE
-				if (dump_state) {
-					di->opcode = 0;
-					di->execute = nv_mem_fun(&powerpc_cpu::fake_dump_registers);
-					di++;
-				}
-#endif
-				if (di >= decode_cache_end_p) {
-					// Invalidate cache and move current code to start
-					invalidate_cache();
-					const int blocklen = di - bi->di;
-					memmove(decode_cache_p, bi->di, blocklen * sizeof(*di));
-					bi->di = decode_cache_p;
-					di = bi->di + blocklen;
-				}
-			} while ((ii->cflow & CFLOW_END_BLOCK) == 0);
-			bi->end_pc = dpc;
-			bi->min_pc = dpc;
-			bi->max_pc = entry;
-			bi->size = di - bi->di;
-			my_block_cache.add_to_cl_list(bi);
-			my_block_cache.add_to_active_list(bi);
-			decode_cache_p += bi->size;
-#if PPC_PROFILE_COMPILE_TIME
-			compile_time += (clock() - start_time);
-#endif
+			bi = predecode_block(pc());
 
 			// Execute all cached blocks
 		  pdi_execute:
 			for (;;) {
-				const int r = bi->size % 4;
-				di = bi->di + r;
-				int n = (bi->size + 3) / 4;
-				switch (r) {
-				case 0: do {
-						di += 4;
-						di[-4].execute(this, di[-4].opcode);
-				case 3: di[-3].execute(this, di[-3].opcode);
-				case 2: di[-2].execute(this, di[-2].opcode);
-				case 1: di[-1].execute(this, di[-1].opcode);
-					} while (--n > 0);
-				}
+				execute_predecoded_block(bi);
 
 				if (!spcflags().empty()) {
 					if (!check_spcflags())
@@ -786,6 +907,54 @@ void powerpc_cpu::invalidate_cache()
 #endif
 }
 
+#if PPC_ENABLE_JIT
+struct powerpc_cpu::code_range_predicate
+{
+	powerpc_cpu * cpu;
+	uint8 * start;
+	uint8 * end;
+
+	code_range_predicate(powerpc_cpu *cpu_, uint8 *start_, uint8 *end_)
+		: cpu(cpu_), start(start_), end(end_)
+		{ }
+
+	bool operator()(block_info *bi) const
+	{
+#if PPC_DECODE_CACHE
+		if (bi->di != NULL)
+			return false;
+#endif
+		if (bi->entry_point < start || bi->entry_point >= end)
+			return false;
+#if PPC_PROFILE_COMPILE_TIME
+		const uint32 h = (bi->pc >> 2) & ((1 << EVICTED_MAP_BITS) - 1);
+		cpu->evicted_map[h / 32] |= 1 << (h % 32);
+#endif
+		return true;
+	}
+};
+
+void powerpc_cpu::evict_cache_region()
+{
+	uint8 *start, *end;
+	if (!codegen.next_cache_region(start, end)) {
+		invalidate_cache();
+		return;
+	}
+#if DYNGEN_DIRECT_BLOCK_CHAINING
+	// Skip the region we have to return into from compile_chain_block()
+	if (chain_resolve_addr >= start && chain_resolve_addr < end)
+		codegen.next_cache_region(start, end);
+#endif
+	D(bug("Evict translation cache region [%p - %p]\n", start, end));
+#if PPC_PROFILE_COMPILE_TIME
+	evict_count++;
+#endif
+	my_block_cache.clear_if(code_range_predicate(this, start, end));
+	spcflags().set(SPCFLAG_JIT_EXEC_RETURN);
+}
+#endif
+
 void powerpc_block_info::invalidate()
 {
 #if PPC_DECODE_CACHE
@@ -794,6 +963,16 @@ void powerpc_block_info::invalidate()
 		return;
 #endif
 #if DYNGEN_DIRECT_BLOCK_CHAINING
+	// Restore the resolvers of the blocks chained to this one
+	while (deplist) {
+		dependency *d = deplist;
+		powerpc_block_info *sbi = static_cast<powerpc_block_info *>(d->source);
+		link_info * const sli = &sbi->li[d - sbi->dep];
+		dg_set_jmp_target(sli->jmp_addr, sli->jmp_resolve_addr);
+		remove_dep(d);
+	}
+	remove_deps();
+
 	for (int i = 0; i < MAX_TARGETS; i++) {
 		link_info * const tli = &li[i];
 		uint32 tpc = tli->jmp_pc;
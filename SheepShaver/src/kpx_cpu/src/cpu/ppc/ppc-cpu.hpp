@@ -205,6 +205,16 @@ private:
 	uint32 compile_count;
 	clock_t compile_time;
 	clock_t emul_start_time;
+#if PPC_ENABLE_JIT
+	// Hashed set of entry points of evicted blocks
+	static const uint32 EVICTED_MAP_BITS = 20;
+	uint32 evicted_map[(1 << EVICTED_MAP_BITS) / 32];
+	uint32 evict_count;
+	uint32 recompile_count;
+	uint32 tier_count;
+	uint32 tier_up_count;
+	uint32 cached_block_count;
+#endif
 #endif
 
 	// Compile blocks statistics
@@ -333,8 +343,10 @@ protected:
 	virtual int compile1(codegen_context_t & cg_context) { return COMPILE_FAILURE; }
 
 	bool use_jit;
+	int32 jit_threshold;
 public:
 	void enable_jit(uint32 cache_size = 0);
+	void set_jit_threshold(int32 threshold) { jit_threshold = threshold; }
 #endif
 
 private:
@@ -362,6 +374,9 @@ private:
 	block_info::decode_info * decode_cache;
 	block_info::decode_info * decode_cache_p;
 	block_info::decode_info * decode_cache_end_p;
+	block_info *predecode_block(uint32 entry);
+	void execute_predecoded_block(block_info *bi);
+	void invalidate_decode_cache();
 #endif
 
 #if PPC_ENABLE_JIT
@@ -371,8 +386,27 @@ private:
 	friend class powerpc_jit;
 	powerpc_jit codegen;
 	block_info *compile_block(uint32 entry);
+	void gen_block_exit(block_info *bi);
 #if DYNGEN_DIRECT_BLOCK_CHAINING
 	void *compile_chain_block(block_info *sbi);
+	uint8 *chain_resolve_addr;
+#endif
+
+	// Translation cache eviction
+	struct code_range_predicate;
+	void evict_cache_region();
+
+#if DYNGEN_DIRECT_BLOCK_CHAINING
+	void gen_chain_resolver(block_info *bi, int n);
+
+	// On-disk translation cache of ROM code
+	bool pin_rom_code;
+	struct translation_cache_writer;
+	uint64 translation_cache_key();
+public:
+	bool load_translation_cache(const char *path);
+	bool save_translation_cache(const char *path);
+private:
 #endif
 #endif
 
@@ -311,3 +311,26 @@ void powerpc_dyngen::gen_store_vect_VS_T0(int vS)
 	gen_load_ad_VD_VR(vS);
 	gen_op_store_vect_VD_T0();
 }
+
+// Run every PowerPC code generator and hash the opcodes they emit
+class powerpc_dyngen_ops_hasher
+	: public dyngen_ops_hasher
+{
+#	define DEFINE_GEN(NAME,RET,ARGS) RET NAME(long param1 = 0, long param2 = 0, long param3 = 0)
+#	include "ppc-dyngen-ops.hpp"
+
+public:
+	powerpc_dyngen_ops_hasher(uint64 seed)
+		: dyngen_ops_hasher(seed)
+	{
+#	undef DYNGEN_IMPL
+#	define DEFINE_GEN(NAME,RET,ARGS) NAME();
+#	include "ppc-dyngen-ops.hpp"
+	}
+};
+
+uint64
+powerpc_dyngen::ops_hash()
+{
+	return powerpc_dyngen_ops_hasher(basic_dyngen::ops_hash()).value();
+}
@@ -57,6 +57,9 @@ public:
 	// Default constructor
 	powerpc_dyngen(dyngen_cpu_base cpu);
 
+	// Hash of the code of all synthetic opcodes, basic ones included
+	static uint64 ops_hash();
+
 	// Generate prologue
 	uint8 *gen_start(uint32 pc);
 
@@ -1475,13 +1475,15 @@ void powerpc_cpu::execute_vector_merge(uint32 opcode)
 {
 	typename VA::type const & vA = VA::const_ref(this, opcode);
 	typename VB::type const & vB = VB::const_ref(this, opcode);
-	typename VD::type & vD = VD::ref(this, opcode);
+	typename VD::type vT;
 	const int n_elements = 16 / VD::element_size;
 
+	// NOTE: vD may be vA or vB, so build the result aside
 	for (int i = 0; i < n_elements; i += 2) {
-		VD::set_element(vD, i    , VA::get_element(vA, (i / 2) + LO * (n_elements / 2)));
-		VD::set_element(vD, i + 1, VB::get_element(vB, (i / 2) + LO * (n_elements / 2)));
+		VD::set_element(vT, i    , VA::get_element(vA, (i / 2) + LO * (n_elements / 2)));
+		VD::set_element(vT, i + 1, VB::get_element(vB, (i / 2) + LO * (n_elements / 2)));
 	}
+	VD::ref(this, opcode) = vT;
 
 	increment_pc(4);
 }
@@ -1502,10 +1504,11 @@ void powerpc_cpu::execute_vector_pack(uint32 opcode)
 {
 	typename VA::type const & vA = VA::const_ref(this, opcode);
 	typename VB::type const & vB = VB::const_ref(this, opcode);
-	typename VD::type & vD = VD::ref(this, opcode);
+	typename VD::type vT;
 	const int n_elements = 16 / VD::element_size;
 	const int n_pivot = n_elements / 2;
 
+	// NOTE: vD may be vA or vB, so build the result aside
 	for (int i = 0; i < n_elements; i++) {
 		typename VD::element_type d;
 		if (i < n_pivot)
@@ -1514,8 +1517,9 @@ void powerpc_cpu::execute_vector_pack(uint32 opcode)
 			d = VB::get_element(vB, i - n_pivot);
 		if (VD::saturate(d))
 			vscr().set_sat(1);
-		VD::set_element(vD, i, d);
+		VD::set_element(vT, i, d);
 	}
+	VD::ref(this, opcode) = vT;
 
 	increment_pc(4);
 }
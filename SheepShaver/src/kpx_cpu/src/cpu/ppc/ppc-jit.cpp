@@ -205,7 +205,20 @@ bool powerpc_jit::initialize(void)
 			DEFINE_OP(VSPLTW,	vspltw),
 			DEFINE_OP(VSPLTISB,	vspltisb),
 			DEFINE_OP(VSPLTISH,	vspltish),
-			DEFINE_OP(VSPLTISW,	vspltisw)
+			DEFINE_OP(VSPLTISW,	vspltisw),
+			DEFINE_OP(VPKUHUM,	vpkuhum),
+			DEFINE_OP(VPKUWUM,	vpkuwum),
+			DEFINE_OP(VMULESH,	vmulesh),
+			DEFINE_OP(VMULOSH,	vmulosh),
+#undef DEFINE_OP
+#define DEFINE_OP(MNEMO, GEN_OP, SSE_OP) \
+			{ PPC_I(MNEMO), (gen_handler_t)&powerpc_jit::gen_sse2_##GEN_OP, X86_SSE_##SSE_OP }
+			DEFINE_OP(VMRGHB,	vmrg, PUNPCKLBW),
+			DEFINE_OP(VMRGHH,	vmrg, PUNPCKLWD),
+			DEFINE_OP(VMRGHW,	vmrg, PUNPCKLDQ),
+			DEFINE_OP(VMRGLB,	vmrg, PUNPCKHBW),
+			DEFINE_OP(VMRGLH,	vmrg, PUNPCKHWD),
+			DEFINE_OP(VMRGLW,	vmrg, PUNPCKHDQ)
 #undef DEFINE_OP
 		};
 
@@ -214,6 +227,22 @@ bool powerpc_jit::initialize(void)
 				jit_info[sse2_vector[i].mnemo] = &sse2_vector[i];
 		}
 
+		// SSE2 scalar floating-point handlers
+		static const jit_info_t sse2_fp[] = {
+#define DEFINE_OP(MNEMO, GEN_OP) \
+			{ PPC_I(MNEMO), (gen_handler_t)&powerpc_jit::gen_sse2_##GEN_OP, }
+			DEFINE_OP(FCMPO,	fcmp),
+			DEFINE_OP(FCMPU,	fcmp),
+			DEFINE_OP(FRSP,		frsp),
+			DEFINE_OP(FCTIWZ,	fctiwz)
+#undef DEFINE_OP
+		};
+
+		if (cpuinfo_check_sse2()) {
+			for (uint32 i = 0; i < sizeof(sse2_fp) / sizeof(sse2_fp[0]); i++)
+				jit_info[sse2_fp[i].mnemo] = &sse2_fp[i];
+		}
+
 		// SSSE3 optimized handlers
 		static const jit_info_t ssse3_vector[] = {
 #define DEFINE_OP(MNEMO, GEN_OP) \
@@ -257,6 +286,16 @@ bool powerpc_jit::gen_vector_compare(int mnemo, int vD, int vA, int vB, bool Rc)
 	return (this->*((bool (powerpc_jit::*)(int, int, int, int, bool))jit_info[mnemo]->handler))(mnemo, vD, vA, vB, Rc);
 }
 
+bool powerpc_jit::gen_fp_compare(int mnemo, int crfD, int frA, int frB)
+{
+	return (this->*((bool (powerpc_jit::*)(int, int, int, int))jit_info[mnemo]->handler))(mnemo, crfD, frA, frB);
+}
+
+bool powerpc_jit::gen_fp_convert(int mnemo, int frD, int frB)
+{
+	return (this->*((bool (powerpc_jit::*)(int, int, int))jit_info[mnemo]->handler))(mnemo, frD, frB);
+}
+
 
 bool powerpc_jit::gen_not_available(int mnemo)
 {
@@ -354,8 +393,10 @@ static uint8 dummy_ppc_context[sizeof(powerpc_cpu)];
 #endif
 #define xPPC_FIELD(M)	(((uintptr)&xPPC_CONTEXT->M) - (uintptr)xPPC_CONTEXT)
 #define xPPC_GPR(N)		xPPC_FIELD(gpr(N))
+#define xPPC_FPR(N)		xPPC_FIELD(fpr(N))
 #define xPPC_VR(N)		xPPC_FIELD(vr(N))
 #define xPPC_CR			xPPC_FIELD(cr())
+#define xPPC_FPSCR		xPPC_FIELD(fpscr())
 #define xPPC_VSCR		xPPC_FIELD(vscr())
 
 #if defined(__i386__) || defined(__x86_64__)
@@ -837,6 +878,173 @@ bool powerpc_jit::gen_sse2_vspltw(int mnemo, int vD, int UIMM, int vB)
 	return true;
 }
 
+/*
+ *	Vector merge, pack and multiply instructions
+ *
+ *  Byte and half-word elements are stored in reverse order within
+ *  each host word, see ev_mixed. Interleaving or packing host
+ *  elements directly thus needs a final fixup of that order.
+ */
+
+// vmrghb, vmrghh, vmrghw, vmrglb, vmrglh, vmrglw
+bool powerpc_jit::gen_sse2_vmrg(int mnemo, int vD, int vA, int vB)
+{
+	const int insn = jit_info[mnemo]->o.value;
+	if (mnemo == PPC_I(VMRGHW) || mnemo == PPC_I(VMRGLW)) {
+		gen_movdqa(x86_memory_operand(xPPC_VR(vA), REG_CPU_ID), REG_V0_ID);
+		gen_insn(X86_INSN_SSE_PI, insn, x86_memory_operand(xPPC_VR(vB), REG_CPU_ID), REG_V0_ID);
+	}
+	else {
+		// vB elements come first in host order, then swap words per quad-word
+		gen_movdqa(x86_memory_operand(xPPC_VR(vB), REG_CPU_ID), REG_V0_ID);
+		gen_insn(X86_INSN_SSE_PI, insn, x86_memory_operand(xPPC_VR(vA), REG_CPU_ID), REG_V0_ID);
+		gen_pshufd(x86_immediate_operand(0xb1), REG_V0_ID, REG_V0_ID);
+	}
+	gen_movdqa(REG_V0_ID, x86_memory_operand(xPPC_VR(vD), REG_CPU_ID));
+	return true;
+}
+
+// vpkuhum
+bool powerpc_jit::gen_sse2_vpkuhum(int mnemo, int vD, int vA, int vB)
+{
+	gen_movdqa(x86_memory_operand(xPPC_VR(vA), REG_CPU_ID), REG_V0_ID);
+	gen_movdqa(x86_memory_operand(xPPC_VR(vB), REG_CPU_ID), REG_V1_ID);
+	gen_psllw(x86_immediate_operand(8), REG_V0_ID);
+	gen_psllw(x86_immediate_operand(8), REG_V1_ID);
+	gen_psrlw(x86_immediate_operand(8), REG_V0_ID);
+	gen_psrlw(x86_immediate_operand(8), REG_V1_ID);
+	gen_packuswb(REG_V1_ID, REG_V0_ID);
+	gen_pshuflhw(x86_immediate_operand(0xb1), REG_V0_ID, REG_V0_ID);
+	gen_pshufhw(x86_immediate_operand(0xb1), REG_V0_ID, REG_V0_ID);
+	gen_movdqa(REG_V0_ID, x86_memory_operand(xPPC_VR(vD), REG_CPU_ID));
+	return true;
+}
+
+// vpkuwum
+bool powerpc_jit::gen_sse2_vpkuwum(int mnemo, int vD, int vA, int vB)
+{
+	// NOTE: sign-extend the low half-words so that PACKSSDW never saturates
+	gen_movdqa(x86_memory_operand(xPPC_VR(vA), REG_CPU_ID), REG_V0_ID);
+	gen_movdqa(x86_memory_operand(xPPC_VR(vB), REG_CPU_ID), REG_V1_ID);
+	gen_pslld(x86_immediate_operand(16), REG_V0_ID);
+	gen_pslld(x86_immediate_operand(16), REG_V1_ID);
+	gen_psrad(x86_immediate_operand(16), REG_V0_ID);
+	gen_psrad(x86_immediate_operand(16), REG_V1_ID);
+	gen_packssdw(REG_V1_ID, REG_V0_ID);
+	gen_pshuflhw(x86_immediate_operand(0xb1), REG_V0_ID, REG_V0_ID);
+	gen_pshufhw(x86_immediate_operand(0xb1), REG_V0_ID, REG_V0_ID);
+	gen_movdqa(REG_V0_ID, x86_memory_operand(xPPC_VR(vD), REG_CPU_ID));
+	return true;
+}
+
+// vmulesh
+bool powerpc_jit::gen_sse2_vmulesh(int mnemo, int vD, int vA, int vB)
+{
+	// Even half-words are the high halves of host words
+	gen_movdqa(x86_memory_operand(xPPC_VR(vA), REG_CPU_ID), REG_V0_ID);
+	gen_movdqa(x86_memory_operand(xPPC_VR(vB), REG_CPU_ID), REG_V1_ID);
+	gen_psrld(x86_immediate_operand(16), REG_V0_ID);
+	gen_psrld(x86_immediate_operand(16), REG_V1_ID);
+	gen_pmaddwd(REG_V1_ID, REG_V0_ID);
+	gen_movdqa(REG_V0_ID, x86_memory_operand(xPPC_VR(vD), REG_CPU_ID));
+	return true;
+}
+
+// vmulosh
+bool powerpc_jit::gen_sse2_vmulosh(int mnemo, int vD, int vA, int vB)
+{
+	// Odd half-words are the low halves of host words
+	gen_movdqa(x86_memory_operand(xPPC_VR(vA), REG_CPU_ID), REG_V0_ID);
+	gen_pslld(x86_immediate_operand(16), REG_V0_ID);
+	gen_psrld(x86_immediate_operand(16), REG_V0_ID);
+	gen_pmaddwd(x86_memory_operand(xPPC_VR(vB), REG_CPU_ID), REG_V0_ID);
+	gen_movdqa(REG_V0_ID, x86_memory_operand(xPPC_VR(vD), REG_CPU_ID));
+	return true;
+}
+
+/*
+ *	Floating-point instructions
+ *
+ *  Those are only used when FPU exceptions are not emulated, in
+ *  which case FPSCR[FPRF] is not updated either, like for the
+ *  other native FPU operations.
+ */
+
+uintptr powerpc_jit::gen_sse2_fp_bounds(void)
+{
+	// Bounds of FCTIWZ inputs that fit into a signed 32-bit integer
+	static uintptr fp_bounds = 0;
+	if (fp_bounds == 0) {
+		static const double value[2] = {
+			2147483648.0, -2147483648.0
+		};
+		fp_bounds = (uintptr)copy_data((const uint8 *)value, sizeof(value));
+		assert(fp_bounds <= 0xffffffff);
+	}
+	return fp_bounds;
+}
+
+// fcmpo, fcmpu
+bool powerpc_jit::gen_sse2_fcmp(int mnemo, int crfD, int frA, int frB)
+{
+	// NOTE: %ecx & %edx are caller saved registers and not static allocated at this time
+	assert(REG_T0_ID != (int)X86_ECX && REG_T0_ID != (int)X86_EDX);
+	const int sh = 28 - 4 * crfD;
+	gen_movsd(x86_memory_operand(xPPC_FPR(frA), REG_CPU_ID), REG_V0_ID);
+	gen_mov_32(x86_immediate_operand(2), REG_T0_ID);					// c = EQ
+	gen_mov_32(x86_immediate_operand(8), X86_ECX);
+	gen_mov_32(x86_immediate_operand(4), X86_EDX);
+	gen_ucomisd(x86_memory_operand(xPPC_FPR(frB), REG_CPU_ID), REG_V0_ID);
+	gen_cmov_32(X86_CC_B, X86_ECX, REG_T0_ID);						// c = LT
+	gen_cmov_32(X86_CC_A, X86_EDX, REG_T0_ID);						// c = GT
+	gen_mov_32(x86_immediate_operand(1), X86_ECX);
+	gen_cmov_32(X86_CC_P, X86_ECX, REG_T0_ID);						// c = UN
+	gen_mov_32(REG_T0_ID, X86_EDX);
+	gen_mov_32(x86_memory_operand(xPPC_CR, REG_CPU_ID), X86_ECX);		// cr[crfD] = c
+	if (sh)
+		gen_shl_32(x86_immediate_operand(sh), REG_T0_ID);
+	gen_and_32(x86_immediate_operand(~(0xf << sh)), X86_ECX);
+	gen_or_32(X86_ECX, REG_T0_ID);
+	gen_mov_32(REG_T0_ID, x86_memory_operand(xPPC_CR, REG_CPU_ID));
+	gen_mov_32(x86_memory_operand(xPPC_FPSCR, REG_CPU_ID), X86_ECX);	// fpscr[FPCC] = c
+	gen_shl_32(x86_immediate_operand(12), X86_EDX);
+	gen_and_32(x86_immediate_operand(~0xf000), X86_ECX);
+	gen_or_32(X86_ECX, X86_EDX);
+	gen_mov_32(X86_EDX, x86_memory_operand(xPPC_FPSCR, REG_CPU_ID));
+	return true;
+}
+
+// frsp
+bool powerpc_jit::gen_sse2_frsp(int mnemo, int frD, int frB)
+{
+	gen_cvtsd2ss(x86_memory_operand(xPPC_FPR(frB), REG_CPU_ID), REG_V0_ID);
+	gen_cvtss2sd(REG_V0_ID, REG_V0_ID);
+	gen_movsd(REG_V0_ID, x86_memory_operand(xPPC_FPR(frD), REG_CPU_ID));
+	return true;
+}
+
+// fctiwz
+bool powerpc_jit::gen_sse2_fctiwz(int mnemo, int frD, int frB)
+{
+	// NOTE: this matches the interpreter, the high word is the sign
+	// extension of in-range results and zero for saturated results
+	assert(REG_T0_ID != (int)X86_ECX && REG_T0_ID != (int)X86_EDX);
+	const uintptr fp_bounds = gen_sse2_fp_bounds();
+	gen_movsd(x86_memory_operand(xPPC_FPR(frB), REG_CPU_ID), REG_V0_ID);
+	gen_cvttsd2si_32(REG_V0_ID, REG_T0_ID);							// 0x80000000 if out of range
+	gen_mov_32(x86_immediate_operand(0x7fffffff), X86_ECX);
+	gen_xor_32(X86_EDX, X86_EDX);
+	gen_ucomisd(x86_memory_operand(fp_bounds, X86_NOREG), REG_V0_ID);
+	gen_cmov_32(X86_CC_AE, X86_ECX, REG_T0_ID);						// b >= 2^31
+	gen_mov_32(REG_T0_ID, X86_ECX);
+	gen_sar_32(x86_immediate_operand(31), X86_ECX);
+	gen_ucomisd(x86_memory_operand(fp_bounds + 8, X86_NOREG), REG_V0_ID);
+	gen_cmov_32(X86_CC_B, X86_EDX, X86_ECX);							// b < -2^31 or NaN
+	gen_mov_32(REG_T0_ID, x86_memory_operand(xPPC_FPR(frD) + 0, REG_CPU_ID));
+	gen_mov_32(X86_ECX, x86_memory_operand(xPPC_FPR(frD) + 4, REG_CPU_ID));
+	return true;
+}
+
 /*
  *	SSSE3 optimizations
  */
@@ -37,6 +37,8 @@ struct powerpc_jit
 	bool gen_vector_2(int mnemo, int vD, int vA, int vB);
 	bool gen_vector_3(int mnemo, int vD, int vA, int vB, int vC);
 	bool gen_vector_compare(int mnemo, int vD, int vA, int vB, bool Rc);
+	bool gen_fp_compare(int mnemo, int crfD, int frA, int frB);
+	bool gen_fp_convert(int mnemo, int frD, int frB);
 
 private:
 	// Mid-level code generator info
@@ -96,6 +98,15 @@ private:
 	bool gen_sse2_vspltb(int mnemo, int vD, int UIMM, int vB);
 	bool gen_sse2_vsplth(int mnemo, int vD, int UIMM, int vB);
 	bool gen_sse2_vspltw(int mnemo, int vD, int UIMM, int vB);
+	bool gen_sse2_vmrg(int mnemo, int vD, int vA, int vB);
+	bool gen_sse2_vpkuhum(int mnemo, int vD, int vA, int vB);
+	bool gen_sse2_vpkuwum(int mnemo, int vD, int vA, int vB);
+	bool gen_sse2_vmulesh(int mnemo, int vD, int vA, int vB);
+	bool gen_sse2_vmulosh(int mnemo, int vD, int vA, int vB);
+	uintptr gen_sse2_fp_bounds(void);
+	bool gen_sse2_fcmp(int mnemo, int crfD, int frA, int frB);
+	bool gen_sse2_frsp(int mnemo, int frD, int frB);
+	bool gen_sse2_fctiwz(int mnemo, int frD, int frB);
 	uintptr gen_ssse3_vswap_mask(void);
 	bool gen_ssse3_lvx(int mnemo, int vD, int rA, int rB);
 	bool gen_ssse3_stvx(int mnemo, int vS, int rA, int rB);
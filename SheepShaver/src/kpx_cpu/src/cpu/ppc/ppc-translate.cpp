@@ -25,6 +25,7 @@
 
 #if PPC_ENABLE_JIT
 #include "cpu/jit/dyngen-exec.h"
+#include "utils/utils-cpuinfo.hpp"
 #endif
 
 #ifdef SHEEPSHAVER
@@ -32,6 +33,7 @@
 #endif
 
 #include <stdio.h>
+#include <string>
 
 #define DEBUG 1
 #include "debug.h"
@@ -54,6 +56,19 @@ static inline bool is_read_only_memory(uintptr addr)
 	return false;
 }
 
+#if PPC_ENABLE_JIT && DYNGEN_DIRECT_BLOCK_CHAINING
+// Checksum of the code a block was translated from, FNV-1a on words
+static uint32 checksum_block_source(uint32 min_pc, uint32 max_pc)
+{
+	uint32 sum = 2166136261U;
+	for (uint32 pc = min_pc; pc <= max_pc; pc += 4) {
+		sum ^= vm_read_memory_4(pc);
+		sum *= 16777619U;
+	}
+	return sum;
+}
+#endif
+
 // Returns TRUE if we can directly generate a jump to the target block
 // XXX mixing front-end and back-end conditions is not a very good idea...
 static inline bool direct_chaining_possible(uint32 bpc, uint32 tpc)
@@ -137,11 +152,19 @@ powerpc_cpu::compile_block(uint32 entry_point)
 #if PPC_PROFILE_COMPILE_TIME
 	compile_count++;
 	clock_t start_time = clock();
+	const uint32 h = (entry_point >> 2) & ((1 << EVICTED_MAP_BITS) - 1);
+	if (evicted_map[h / 32] & (1 << (h % 32)))
+		recompile_count++;
 #endif
 
 	powerpc_jit & dg = codegen;
 	codegen_context_t cg_context(dg);
 	cg_context.entry_point = entry_point;
+
+#if DYNGEN_DIRECT_BLOCK_CHAINING
+	// ROM code goes to the pinned area so that it can be saved to disk
+	bool pinned = pin_rom_code && is_read_only_memory(entry_point) && dg.enter_pinned_area();
+#endif
   again:
 	block_info *bi = my_block_cache.new_blockinfo();
 	bi->init(entry_point);
@@ -150,6 +173,10 @@ powerpc_cpu::compile_block(uint32 entry_point)
 	// Direct block chaining support variables
 	bool use_direct_block_chaining = false;
 
+	// Set if compile1() translated an instruction, its code may depend
+	// on run-time state and is not saved to disk
+	bool use_compile1 = false;
+
 	int compile_status;
 	uint32 dpc = entry_point - 4;
 	uint32 min_pc, max_pc;
@@ -449,6 +476,68 @@ powerpc_cpu::compile_block(uint32 entry_point)
 			}
 			break;
 		}
+		case PPC_I(LHBRX):		// Load Half Word Byte-Reverse Indexed
+			op.mem.size = 2;
+			goto do_load_reverse;
+		case PPC_I(LWBRX):		// Load Word Byte-Reverse Indexed
+			op.mem.size = 4;
+			goto do_load_reverse;
+		{
+		  do_load_reverse:
+			// Extract RZ operand
+			const int rA = rA_field::extract(opcode);
+			if (rA == 0)
+				dg.gen_mov_32_T1_im(0);
+			else
+				dg.gen_load_T1_GPR(rA);
+
+			// Extract index operand
+			dg.gen_load_T2_GPR(rB_field::extract(opcode));
+
+			// Load big endian value and swap it back
+			if (op.mem.size == 2) {
+				dg.gen_load_u16_T0_T1_T2();
+				dg.gen_bswap_16_T0();
+			}
+			else {
+				dg.gen_load_u32_T0_T1_T2();
+				dg.gen_bswap_32_T0();
+			}
+
+			// Commit result
+			dg.gen_store_T0_GPR(rD_field::extract(opcode));
+			break;
+		}
+		case PPC_I(STHBRX):		// Store Half Word Byte-Reverse Indexed
+			op.mem.size = 2;
+			goto do_store_reverse;
+		case PPC_I(STWBRX):		// Store Word Byte-Reverse Indexed
+			op.mem.size = 4;
+			goto do_store_reverse;
+		{
+		  do_store_reverse:
+			// Extract RZ operand
+			const int rA = rA_field::extract(opcode);
+			if (rA == 0)
+				dg.gen_mov_32_T1_im(0);
+			else
+				dg.gen_load_T1_GPR(rA);
+
+			// Extract index operand
+			dg.gen_load_T2_GPR(rB_field::extract(opcode));
+
+			// Swap register so that the big endian store reverses it
+			dg.gen_load_T0_GPR(rS_field::extract(opcode));
+			if (op.mem.size == 2) {
+				dg.gen_bswap_16_T0();
+				dg.gen_store_16_T0_T1_T2();
+			}
+			else {
+				dg.gen_bswap_32_T0();
+				dg.gen_store_32_T0_T1_T2();
+			}
+			break;
+		}
 		case PPC_I(LMW):		// Load Multiple Word
 		case PPC_I(STMW):		// Store Multiple Word
 		{
@@ -1370,6 +1459,27 @@ powerpc_cpu::compile_block(uint32 entry_point)
 				dg.gen_record_cr1();
 			break;
 		}
+		case PPC_I(FCMPO):		// Floating Compare Ordered
+		case PPC_I(FCMPU):		// Floating Compare Unordered
+		{
+			const int crfD = crfD_field::extract(opcode);
+			const int frA = frA_field::extract(opcode);
+			const int frB = frB_field::extract(opcode);
+			if (!dg.gen_fp_compare(ii->mnemo, crfD, frA, frB))
+				goto do_generic;
+			break;
+		}
+		case PPC_I(FRSP):		// Floating Round to Single
+		case PPC_I(FCTIWZ):		// Floating Convert to Integer Word with Round to Zero
+		{
+			const int frD = frD_field::extract(opcode);
+			const int frB = frB_field::extract(opcode);
+			if (!dg.gen_fp_convert(ii->mnemo, frD, frB))
+				goto do_generic;
+			if (Rc_field::test(opcode))
+				dg.gen_record_cr1();
+			break;
+		}
 #endif
 		case PPC_I(LVEWX):
 		case PPC_I(LVX):
@@ -1419,6 +1529,16 @@ powerpc_cpu::compile_block(uint32 entry_point)
 		case PPC_I(VXOR):
 		case PPC_I(VREFP):
 		case PPC_I(VRSQRTEFP):
+		case PPC_I(VMRGHB):
+		case PPC_I(VMRGHH):
+		case PPC_I(VMRGHW):
+		case PPC_I(VMRGLB):
+		case PPC_I(VMRGLH):
+		case PPC_I(VMRGLW):
+		case PPC_I(VPKUHUM):
+		case PPC_I(VPKUWUM):
+		case PPC_I(VMULESH):
+		case PPC_I(VMULOSH):
 		{
 			const int vD = vD_field::extract(opcode);
 			const int vA = vA_field::extract(opcode);
@@ -1506,6 +1626,8 @@ powerpc_cpu::compile_block(uint32 entry_point)
 			cg_context.instr_info = ii;
 			cg_context.done_compile = done_compile;
 			compile_status = compile1(cg_context);
+			if (compile_status != COMPILE_FAILURE)
+				use_compile1 = true;
 			switch (compile_status) {
 			case COMPILE_FAILURE:
 			case COMPILE_EPILOGUE_OK:
@@ -1525,8 +1647,17 @@ powerpc_cpu::compile_block(uint32 entry_point)
 		}
 		}
 		if (dg.full_translation_cache()) {
-			// Invalidate cache and start again
-			invalidate_cache();
+			my_block_cache.delete_blockinfo(bi);
+#if DYNGEN_DIRECT_BLOCK_CHAINING
+			if (pinned) {
+				// Pinned area is full, translate into regular regions
+				dg.leave_pinned_area(true);
+				pinned = false;
+				goto again;
+			}
+#endif
+			// Recycle the oldest cache region and start again
+			evict_cache_region();
 			goto again;
 		}
 	}
@@ -1537,8 +1668,8 @@ powerpc_cpu::compile_block(uint32 entry_point)
 		// there are pending spcflags, i.e. get out of this block
 		if (!use_direct_block_chaining) {
 			// TODO: optimize this to a direct jump to pregenerated code?
-			dg.gen_mov_ad_A0_im((uintptr)bi);
-			dg.gen_jump_next_A0();
+			bi->exit_addr = dg.code_ptr();
+			gen_block_exit(bi);
 		}
 		dg.gen_exec_return();
 	}
@@ -1553,21 +1684,23 @@ powerpc_cpu::compile_block(uint32 entry_point)
 #if DYNGEN_DIRECT_BLOCK_CHAINING
 	// Generate backpatch trampolines
 	if (use_direct_block_chaining) {
-		typedef void *(*func_t)(dyngen_cpu_base);
-		func_t func = (func_t)nv_mem_fun(&powerpc_cpu::compile_chain_block).ptr();
 		for (int i = 0; i < block_info::MAX_TARGETS; i++) {
 			if (bi->li[i].jmp_pc != block_info::INVALID_PC) {
-				uint8 *p = dg.gen_align(16);
-				dg.gen_mov_ad_A0_im(((uintptr)bi) | i);
-				dg.gen_invoke_CPU_A0_ret_A0(func);
-				dg.gen_jmp_A0();
 				assert(dg.jmp_addr[i] != NULL);
 				bi->li[i].jmp_addr = dg.jmp_addr[i];
-				bi->li[i].jmp_resolve_addr = p;
-				dg_set_jmp_target_noflush(bi->li[i].jmp_addr, bi->li[i].jmp_resolve_addr);
+				dg.gen_align(16);
+				gen_chain_resolver(bi, i);
 			}
 		}
 	}
+
+	// BI is only referenced from the trampolines and the block exit,
+	// which are regenerated when the block is loaded back from disk
+	if (pinned) {
+		bi->persistent = !use_compile1 && is_read_only_memory(min_pc) && is_read_only_memory(max_pc);
+		if (bi->persistent)
+			bi->c1 = checksum_block_source(min_pc, max_pc);
+	}
 #endif
 
 	bi->size = dg.code_ptr() - bi->entry_point;
@@ -1575,6 +1708,10 @@ powerpc_cpu::compile_block(uint32 entry_point)
 		disasm_translation(entry_point, dpc - entry_point + 4, bi->entry_point, bi->size);
 
 	dg.gen_end();
+#if DYNGEN_DIRECT_BLOCK_CHAINING
+	if (pinned)
+		dg.leave_pinned_area();
+#endif
 	my_block_cache.add_to_cl_list(bi);
 	if (is_read_only_memory(bi->pc))
 		my_block_cache.add_to_dormant_list(bi);
@@ -1586,3 +1723,321 @@ powerpc_cpu::compile_block(uint32 entry_point)
 	return bi;
 }
 #endif
+
+#if PPC_ENABLE_JIT
+void powerpc_cpu::gen_block_exit(block_info *bi)
+{
+	powerpc_jit & dg = codegen;
+	dg.gen_mov_ad_A0_im((uintptr)bi);
+	dg.gen_jump_next_A0();
+}
+
+#if DYNGEN_DIRECT_BLOCK_CHAINING
+void powerpc_cpu::gen_chain_resolver(block_info *bi, int n)
+{
+	powerpc_jit & dg = codegen;
+	typedef void *(*func_t)(dyngen_cpu_base);
+	func_t func = (func_t)nv_mem_fun(&powerpc_cpu::compile_chain_block).ptr();
+	uint8 *p = dg.code_ptr();
+	dg.gen_mov_ad_A0_im(((uintptr)bi) | n);
+	dg.gen_invoke_CPU_A0_ret_A0(func);
+	dg.gen_jmp_A0();
+	bi->li[n].jmp_resolve_addr = p;
+	dg_set_jmp_target_noflush(bi->li[n].jmp_addr, bi->li[n].jmp_resolve_addr);
+}
+#endif
+#endif
+
+
+/**
+ *		On-disk translation cache
+ *
+ *		ROM code is translated into the pinned area of the translation
+ *		cache, which is saved as is and restored at the very same
+ *		address. Generated code calls host helpers directly and refers
+ *		to the data pool, so the file is only reused when the host
+ *		layout key matches. Each block is also checked against a
+ *		checksum of its PowerPC code. Block chains are not saved, and
+ *		the trampolines and exits that reference block_info structures
+ *		are regenerated on load.
+ **/
+
+#if PPC_ENABLE_JIT && DYNGEN_DIRECT_BLOCK_CHAINING
+// Pinned area is a quarter of the translation cache, plus data pool
+const uint32 PINNED_CODE_RATIO = 4;
+const uint32 PINNED_DATA_SIZE = 16 * 1024;
+
+static const char translation_cache_magic[8] = "KPXJIT1";
+
+struct translation_cache_header {
+	char	magic[8];
+	uint64	cache_addr;
+	uint64	key;
+	uint32	checksum;
+	uint32	block_count;
+	uint32	code_size;
+	uint32	data_size;
+};
+
+struct translation_cache_block {
+	uint32	pc;
+	uint32	end_pc;
+	uint32	min_pc;
+	uint32	max_pc;
+	uint32	checksum;
+	uint32	offset;
+	uint32	size;
+	uint32	exit_offset;
+	uint32	jmp_pc[powerpc_block_info::MAX_TARGETS];
+	uint32	jmp_offset[powerpc_block_info::MAX_TARGETS];
+	uint32	resolve_offset[powerpc_block_info::MAX_TARGETS];
+};
+
+static uint64 fnv1a_64(uint64 h, const void *data, uint32 size)
+{
+	const uint8 *p = (const uint8 *)data;
+	while (size-- > 0) {
+		h ^= *p++;
+		h *= UVAL64(0x100000001b3);
+	}
+	return h;
+}
+
+uint64 powerpc_cpu::translation_cache_key()
+{
+	powerpc_jit & dg = codegen;
+	uint64 key = UVAL64(0xcbf29ce484222325);
+	key = fnv1a_64(key, translation_cache_magic, sizeof(translation_cache_magic));
+
+	// Code of the dyngen synthetic opcodes
+	const uint64 ops_hash = powerpc_dyngen::ops_hash();
+	key = fnv1a_64(key, &ops_hash, sizeof(ops_hash));
+
+	// Host helpers and globals, translation cache and data pool
+	const uintptr layout[] = {
+		(uintptr)nv_mem_fun(&powerpc_cpu::compile_chain_block).ptr(),
+		(uintptr)&translation_cache_magic,
+		(uintptr)dg.cache_start(),
+		(uintptr)dg.pinned_code(),
+		(uintptr)dg.pinned_data(),
+		(uintptr)dg.exec_return_addr()
+	};
+	key = fnv1a_64(key, layout, sizeof(layout));
+
+	// Execution engine entry and trampolines emitted before user code
+	key = fnv1a_64(key, dg.cache_start(), dg.pinned_code() - dg.cache_start());
+
+	// Host features the code generator may have used
+	const uint32 features =
+		(cpuinfo_check_cmov() ? 0x01 : 0) |
+		(cpuinfo_check_mmx() ? 0x02 : 0) |
+		(cpuinfo_check_sse() ? 0x04 : 0) |
+		(cpuinfo_check_sse2() ? 0x08 : 0) |
+		(cpuinfo_check_sse3() ? 0x10 : 0) |
+		(cpuinfo_check_ssse3() ? 0x20 : 0) |
+		(cpuinfo_check_sse4_1() ? 0x40 : 0) |
+		(cpuinfo_check_sse4_2() ? 0x80 : 0) |
+		(cpuinfo_check_altivec() ? 0x100 : 0);
+	key = fnv1a_64(key, &features, sizeof(features));
+	return key;
+}
+
+static uint32 translation_cache_checksum(const std::vector<translation_cache_block> & blocks,
+										 const uint8 *code, uint32 code_size,
+										 const uint8 *data, uint32 data_size)
+{
+	uint64 sum = UVAL64(0xcbf29ce484222325);
+	if (!blocks.empty())
+		sum = fnv1a_64(sum, &blocks[0], blocks.size() * sizeof(blocks[0]));
+	sum = fnv1a_64(sum, code, code_size);
+	sum = fnv1a_64(sum, data, data_size);
+	return (uint32)(sum ^ (sum >> 32));
+}
+
+struct powerpc_cpu::translation_cache_writer
+{
+	uint8 * code;
+	std::vector<translation_cache_block> blocks;
+
+	translation_cache_writer(uint8 *code_)
+		: code(code_)
+		{ }
+
+	void operator()(block_info *bi)
+	{
+		if (!bi->persistent)
+			return;
+		translation_cache_block b;
+		memset(&b, 0, sizeof(b));
+		b.pc = bi->pc;
+		b.end_pc = bi->end_pc;
+		b.min_pc = bi->min_pc;
+		b.max_pc = bi->max_pc;
+		b.checksum = bi->c1;
+		b.offset = bi->entry_point - code;
+		b.size = bi->size;
+		b.exit_offset = bi->exit_addr ? bi->exit_addr - bi->entry_point : 0;
+		for (int i = 0; i < block_info::MAX_TARGETS; i++) {
+			b.jmp_pc[i] = bi->li[i].jmp_pc;
+			if (b.jmp_pc[i] != block_info::INVALID_PC) {
+				b.jmp_offset[i] = bi->li[i].jmp_addr - bi->entry_point;
+				b.resolve_offset[i] = bi->li[i].jmp_resolve_addr - bi->entry_point;
+			}
+		}
+		blocks.push_back(b);
+	}
+};
+
+bool powerpc_cpu::save_translation_cache(const char *path)
+{
+	powerpc_jit & dg = codegen;
+	if (!pin_rom_code || dg.data_pool_overflow())
+		return false;
+
+	translation_cache_writer writer(dg.pinned_code());
+	my_block_cache.for_each(writer);
+
+	translation_cache_header hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, translation_cache_magic, sizeof(hdr.magic));
+	hdr.cache_addr = (uintptr)dg.cache_start();
+	hdr.key = translation_cache_key();
+	hdr.block_count = writer.blocks.size();
+	hdr.code_size = dg.pinned_code_size();
+	hdr.data_size = dg.pinned_data_size();
+	hdr.checksum = translation_cache_checksum(writer.blocks,
+											  dg.pinned_code(), hdr.code_size,
+											  dg.pinned_data(), hdr.data_size);
+
+	// Write to a temporary file first, then atomically replace the cache
+	std::string tmp_path = std::string(path) + ".tmp";
+	FILE *f = fopen(tmp_path.c_str(), "wb");
+	if (f == NULL)
+		return false;
+	bool ok = fwrite(&hdr, sizeof(hdr), 1, f) == 1;
+	if (ok && hdr.block_count)
+		ok = fwrite(&writer.blocks[0], sizeof(translation_cache_block), hdr.block_count, f) == hdr.block_count;
+	if (ok && hdr.code_size)
+		ok = fwrite(dg.pinned_code(), hdr.code_size, 1, f) == 1;
+	if (ok && hdr.data_size)
+		ok = fwrite(dg.pinned_data(), hdr.data_size, 1, f) == 1;
+	if (fclose(f) != 0)
+		ok = false;
+	if (ok)
+		ok = rename(tmp_path.c_str(), path) == 0;
+	if (!ok)
+		remove(tmp_path.c_str());
+	return ok;
+}
+
+bool powerpc_cpu::load_translation_cache(const char *path)
+{
+	powerpc_jit & dg = codegen;
+	if (!use_jit)
+		return false;
+
+	if (pin_rom_code)
+		return false;
+
+	// Move the translation cache back to where the saved code expects
+	// it, then reserve the pinned area even if there is no valid file
+	translation_cache_header hdr;
+	FILE *f = fopen(path, "rb");
+	bool ok = f && fread(&hdr, sizeof(hdr), 1, f) == 1
+		&& memcmp(hdr.magic, translation_cache_magic, sizeof(hdr.magic)) == 0;
+	if (ok && hdr.cache_addr != (uintptr)dg.cache_start()) {
+		if (dg.move_translation_cache((uint8 *)(uintptr)hdr.cache_addr))
+			dg.initialize();
+	}
+	pin_rom_code = dg.init_pinned_area(dg.cache_bytes() / PINNED_CODE_RATIO, PINNED_DATA_SIZE);
+	if (!pin_rom_code) {
+		if (f)
+			fclose(f);
+		return false;
+	}
+	if (f == NULL)
+		return false;
+
+	std::vector<translation_cache_block> blocks;
+	std::vector<uint8> code, data;
+	ok = ok
+		&& hdr.key == translation_cache_key()
+		&& hdr.code_size <= dg.cache_bytes()
+		&& hdr.data_size <= PINNED_DATA_SIZE
+		&& hdr.block_count <= hdr.code_size / 16;
+	if (ok) {
+		blocks.resize(hdr.block_count);
+		code.resize(hdr.code_size + 1);
+		data.resize(hdr.data_size + 1);
+		if (hdr.block_count)
+			ok = fread(&blocks[0], sizeof(translation_cache_block), hdr.block_count, f) == hdr.block_count;
+		if (ok && hdr.code_size)
+			ok = fread(&code[0], hdr.code_size, 1, f) == 1;
+		if (ok && hdr.data_size)
+			ok = fread(&data[0], hdr.data_size, 1, f) == 1;
+		if (ok)
+			ok = hdr.checksum == translation_cache_checksum(blocks, &code[0], hdr.code_size, &data[0], hdr.data_size);
+	}
+	fclose(f);
+	if (ok)
+		ok = dg.restore_pinned_area(&code[0], hdr.code_size, &data[0], hdr.data_size);
+	if (!ok) {
+		fprintf(stderr, "powerpc_cpu: Ignoring stale translation cache %s\n", path);
+		return false;
+	}
+
+	// Register blocks whose PowerPC code did not change
+	uint8 *code_start = dg.pinned_code();
+	uint32 n_blocks = 0;
+	for (uint32 i = 0; i < hdr.block_count; i++) {
+		const translation_cache_block & b = blocks[i];
+		if (b.offset >= hdr.code_size || b.size > hdr.code_size - b.offset || b.exit_offset >= b.size)
+			continue;
+		if (b.min_pc > b.max_pc || !is_read_only_memory(b.min_pc) || !is_read_only_memory(b.max_pc))
+			continue;
+		bool valid_links = true;
+		for (int j = 0; j < block_info::MAX_TARGETS; j++) {
+			if (b.jmp_pc[j] != block_info::INVALID_PC &&
+				(b.jmp_offset[j] >= b.size || b.resolve_offset[j] >= b.size))
+				valid_links = false;
+		}
+		if (!valid_links || my_block_cache.find(b.pc) != NULL)
+			continue;
+		if (checksum_block_source(b.min_pc, b.max_pc) != b.checksum)
+			continue;
+
+		block_info *bi = my_block_cache.new_blockinfo();
+		bi->init(b.pc);
+		bi->entry_point = code_start + b.offset;
+		bi->end_pc = b.end_pc;
+		bi->min_pc = b.min_pc;
+		bi->max_pc = b.max_pc;
+		bi->size = b.size;
+		bi->c1 = b.checksum;
+		bi->persistent = true;
+		if (b.exit_offset) {
+			bi->exit_addr = bi->entry_point + b.exit_offset;
+			dg.enter_pinned_area(bi->exit_addr);
+			gen_block_exit(bi);
+			dg.leave_pinned_area();
+		}
+		for (int j = 0; j < block_info::MAX_TARGETS; j++) {
+			bi->li[j].jmp_pc = b.jmp_pc[j];
+			if (b.jmp_pc[j] != block_info::INVALID_PC) {
+				bi->li[j].jmp_addr = bi->entry_point + b.jmp_offset[j];
+				dg.enter_pinned_area(bi->entry_point + b.resolve_offset[j]);
+				gen_chain_resolver(bi, j);
+				dg.leave_pinned_area();
+			}
+		}
+		my_block_cache.add_to_cl_list(bi);
+		my_block_cache.add_to_dormant_list(bi);
+		n_blocks++;
+	}
+	flush_icache_range((unsigned long)code_start, (unsigned long)(code_start + hdr.code_size));
+#if PPC_PROFILE_COMPILE_TIME
+	cached_block_count += n_blocks;
+#endif
+	return true;
+}
+#endif
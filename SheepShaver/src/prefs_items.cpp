@@ -47,8 +47,10 @@ prefs_desc common_prefs_items[] = {
 	{"bootdriver", TYPE_INT32, false,   "boot driver number"},
 	{"ramsize", TYPE_INT32, false,      "size of Mac RAM in bytes"},
 	{"frameskip", TYPE_INT32, false,    "number of frames to skip in refreshed video modes"},
+	{"vosfthreads", TYPE_INT32, false,  "number of threads converting the frame buffer (0 = auto)"},
 	{"gfxaccel", TYPE_BOOLEAN, false,   "turn on QuickDraw acceleration"},
 	{"nocdrom", TYPE_BOOLEAN, false,    "don't install CD-ROM driver"},
+	{"diskasync", TYPE_BOOLEAN, false,  "complete asynchronous disk requests in a background thread"},
 	{"nonet", TYPE_BOOLEAN, false,      "don't use Ethernet"},
 	{"nosound", TYPE_BOOLEAN, false,    "don't enable sound output"},
 	{"nogui", TYPE_BOOLEAN, false,      "disable GUI"},
@@ -57,6 +59,8 @@ prefs_desc common_prefs_items[] = {
 	{"ignoreillegal", TYPE_BOOLEAN, false, "ignore illegal instructions"},
 	{"jit", TYPE_BOOLEAN, false,        "enable JIT compiler"},
 	{"jit68k", TYPE_BOOLEAN, false,     "enable 68k DR emulator"},
+	{"jitthreshold", TYPE_INT32, false, "run count before a block is JIT compiled"},
+	{"jitcache", TYPE_STRING, false,    "file to keep translated ROM code in across runs"},
 	{"keyboardtype", TYPE_INT32, false, "hardware keyboard type"},
 	{NULL, TYPE_END, false, NULL} // End of list
 };
@@ -74,8 +78,10 @@ void AddPrefsDefaults(void)
 	PrefsAddInt32("bootdrive", 0);
 	PrefsAddInt32("ramsize", 16 * 1024 * 1024);
 	PrefsAddInt32("frameskip", 8);
+	PrefsAddInt32("vosfthreads", 0);
 	PrefsAddBool("gfxaccel", true);
 	PrefsAddBool("nocdrom", false);
+	PrefsAddBool("diskasync", false);
 	PrefsAddBool("nonet", false);
 	PrefsAddBool("nosound", false);
 	PrefsAddBool("nogui", false);
@@ -89,6 +95,7 @@ void AddPrefsDefaults(void)
 #else
 	PrefsAddBool("jit", false);
 #endif
+	PrefsAddInt32("jitthreshold", 0);
 	PrefsAddBool("jit68k", false);
 
 	PrefsAddInt32("keyboardtype", 5);
@@ -24,11 +24,19 @@
 #include "main.h"
 #include "cpu_emulation.h"
 
+#include <map>
+#include <vector>
+
 #ifdef PRECISE_TIMING_POSIX
 #include <pthread.h>
 #include <semaphore.h>
 #endif
 
+#ifdef PRECISE_TIMING_TIMERFD
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
+
 #ifdef PRECISE_TIMING_MACH
 #include <mach/mach.h>
 #endif
@@ -36,6 +44,9 @@
 #define DEBUG 0
 #include "debug.h"
 
+using std::map;
+using std::vector;
+
 
 #define TM_QUEUE 0			// Enable TMQueue management (doesn't work)
 
@@ -49,14 +60,15 @@ enum {	// TMTask struct
 };
 
 
-// Array of additional info for each installed TMTask
+// Additional info for each installed TMTask
 struct TMDesc {
 	uint32 task;		// Mac address of associated TMTask
 	tm_time_t wakeup;	// Time this task is scheduled for execution
-	TMDesc *next;
+	int active_index;	// Position in tmActive, -1 if not scheduled
 };
 
-static TMDesc *tmDescList;
+static map<uint32, TMDesc *> tmDescs;	// Installed tasks, by TMTask address
+static vector<TMDesc *> tmActive;		// Scheduled tasks, binary min-heap ordered by wakeup time
 
 #if PRECISE_TIMING
 #ifdef PRECISE_TIMING_BEOS
@@ -73,7 +85,12 @@ static bool timer_thread_active = false;
 static volatile bool timer_thread_cancel = false;
 static tm_time_t wakeup_time_max = { 0x7fffffff, 999999999 };
 static tm_time_t wakeup_time = wakeup_time_max;
+#ifdef PRECISE_TIMING_TIMERFD
+static int timer_fd = -1;				// Expires at wakeup_time
+static volatile bool timer_fd_expired = false;	// Flag: timer_fd expired and is disarmed
+#else
 static pthread_mutex_t wakeup_time_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 static void *timer_func(void *arg);
 #endif
 #ifdef PRECISE_TIMING_MACH
@@ -88,18 +105,13 @@ static void *timer_func(void *arg);
 #endif
 
 
+/*
+ *  Free descriptor
+ */
+
 inline static void free_desc(TMDesc *desc)
 {
-	if (desc == tmDescList) {
-		tmDescList = desc->next;
-	} else {
-		for (TMDesc *d = tmDescList; d; d = d->next) {
-			if (d->next == desc) {
-				d->next = desc->next;
-				break;
-			}
-		}
-	}
+	tmDescs.erase(desc->task);
 	delete desc;
 }
 
@@ -109,14 +121,70 @@ inline static void free_desc(TMDesc *desc)
 
 inline static TMDesc *find_desc(uint32 tm)
 {
-	TMDesc *desc = tmDescList;
-	while (desc) {
-		if (desc->task == tm) {
-			return desc;
-		}
-		desc = desc->next;
+	map<uint32, TMDesc *>::const_iterator i = tmDescs.find(tm);
+	return i != tmDescs.end() ? i->second : NULL;
+}
+
+
+/*
+ *  Heap of scheduled tasks
+ */
+
+inline static void set_active(int i, TMDesc *desc)
+{
+	tmActive[i] = desc;
+	desc->active_index = i;
+}
+
+// Move descriptor at position i up or down to its place in the heap
+static void sift_active(int i)
+{
+	TMDesc *desc = tmActive[i];
+	const int n = tmActive.size();
+	while (i > 0) {
+		const int parent = (i - 1) / 2;
+		if (timer_cmp_time(tmActive[parent]->wakeup, desc->wakeup) <= 0)
+			break;
+		set_active(i, tmActive[parent]);
+		i = parent;
+	}
+	for (;;) {
+		int child = 2 * i + 1;
+		if (child >= n)
+			break;
+		if (child + 1 < n && timer_cmp_time(tmActive[child + 1]->wakeup, tmActive[child]->wakeup) < 0)
+			child++;
+		if (timer_cmp_time(desc->wakeup, tmActive[child]->wakeup) <= 0)
+			break;
+		set_active(i, tmActive[child]);
+		i = child;
+	}
+	set_active(i, desc);
+}
+
+// Schedule task, or reschedule it if its wakeup time changed
+static void activate_desc(TMDesc *desc)
+{
+	if (desc->active_index < 0) {
+		tmActive.push_back(desc);
+		desc->active_index = tmActive.size() - 1;
+	}
+	sift_active(desc->active_index);
+}
+
+// Unschedule task
+static void deactivate_desc(TMDesc *desc)
+{
+	const int i = desc->active_index;
+	if (i < 0)
+		return;
+	desc->active_index = -1;
+	TMDesc *last = tmActive.back();
+	tmActive.pop_back();
+	if (last != desc) {
+		set_active(i, last);
+		sift_active(i);
 	}
-	return NULL;
 }
 
 
@@ -158,6 +226,40 @@ static void dequeue_tm(uint32 tm)
  */
 
 #ifdef PRECISE_TIMING_POSIX
+#ifdef PRECISE_TIMING_TIMERFD
+// Initialize timer thread, it only waits for timer_fd to expire
+static bool timer_thread_init(void)
+{
+	timer_fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
+	if (timer_fd < 0)
+		return false;
+	if (pthread_create(&timer_thread, NULL, timer_func, NULL) != 0) {
+		close(timer_fd);
+		timer_fd = -1;
+		return false;
+	}
+	return true;
+}
+
+// Kill timer thread
+static void timer_thread_kill(void)
+{
+	if (!timer_thread_active)
+		return;
+
+	// Wake up thread right away
+	timer_thread_cancel = true;
+	struct itimerspec its;
+	its.it_interval.tv_sec = its.it_interval.tv_nsec = 0;
+	its.it_value.tv_sec = 0;
+	its.it_value.tv_nsec = 1;
+	timerfd_settime(timer_fd, 0, &its, NULL);
+	pthread_join(timer_thread, NULL);
+	close(timer_fd);
+	timer_fd = -1;
+	timer_thread_active = false;
+}
+#else
 const int SIGSUSPEND = SIGRTMIN + 6;
 const int SIGRESUME  = SIGRTMIN + 7;
 static struct sigaction sigsuspend_action;
@@ -254,6 +356,64 @@ static void timer_thread_resume(void)
 	pthread_mutex_unlock(&suspend_count_lock);
 }
 #endif
+#endif
+
+
+/*
+ *  Set wakeup time of the timer thread to that of the next scheduled task
+ */
+
+static void update_wakeup_time(void)
+{
+#if PRECISE_TIMING
+	const tm_time_t next = tmActive.empty() ? wakeup_time_max : tmActive[0]->wakeup;
+#ifdef PRECISE_TIMING_TIMERFD
+	// Re-arm timer, wakeup_time is the time it was armed for
+	if (timer_fd >= 0 && timer_cmp_time(next, wakeup_time) != 0) {
+		wakeup_time = next;
+		struct itimerspec its;
+		its.it_interval.tv_sec = its.it_interval.tv_nsec = 0;
+		if (tmActive.empty())
+			its.it_value.tv_sec = its.it_value.tv_nsec = 0;		// Disarm
+		else
+			its.it_value = next;
+		timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+	}
+#else
+#if PRECISE_TIMING_BEOS
+	while (acquire_sem(wakeup_time_sem) == B_INTERRUPTED) ;
+	suspend_thread(timer_thread);
+#endif
+#if PRECISE_TIMING_MACH
+	semaphore_wait(wakeup_time_sem);
+	thread_suspend(timer_thread);
+#endif
+#if PRECISE_TIMING_POSIX
+	timer_thread_suspend();
+	pthread_mutex_lock(&wakeup_time_lock);
+#endif
+	wakeup_time = next;
+#if PRECISE_TIMING_BEOS
+	release_sem(wakeup_time_sem);
+	thread_info info;
+	do {
+		resume_thread(timer_thread);			// This will unblock the thread
+		get_thread_info(timer_thread, &info);
+	} while (info.state == B_THREAD_SUSPENDED);	// Sometimes, resume_thread() doesn't work (BeOS bug?)
+#endif
+#if PRECISE_TIMING_MACH
+	semaphore_signal(wakeup_time_sem);
+	thread_abort(timer_thread);
+	thread_resume(timer_thread);
+#endif
+#if PRECISE_TIMING_POSIX
+	pthread_mutex_unlock(&wakeup_time_lock);
+	timer_thread_resume();
+	assert(suspend_count == 0);
+#endif
+#endif
+#endif
+}
 
 
 /*
@@ -320,13 +480,10 @@ void TimerExit(void)
 
 void TimerReset(void)
 {
-	TMDesc *desc = tmDescList;
-	while (desc) {
-		TMDesc *next = desc->next;
-		delete desc;
-		desc = next;
-	}
-	tmDescList = NULL;
+	for (map<uint32, TMDesc *>::iterator i = tmDescs.begin(); i != tmDescs.end(); ++i)
+		delete i->second;
+	tmDescs.clear();
+	tmActive.clear();
 }
 
 
@@ -343,8 +500,8 @@ int16 InsTime(uint32 tm, uint16 trap)
 	else {
 		TMDesc *desc = new TMDesc;
 		desc->task = tm;
-		desc->next = tmDescList;
-		tmDescList = desc;
+		desc->active_index = -1;
+		tmDescs[tm] = desc;
 	}
 	return 0;
 }
@@ -366,31 +523,11 @@ int16 RmvTime(uint32 tm)
 	}
 
 	// Task active?
-#if PRECISE_TIMING_BEOS
-	while (acquire_sem(wakeup_time_sem) == B_INTERRUPTED) ;
-	suspend_thread(timer_thread);
-#endif
-#ifdef PRECISE_TIMING_MACH
-	semaphore_wait(wakeup_time_sem);
-	thread_suspend(timer_thread);
-#endif
-#if PRECISE_TIMING_POSIX
-	timer_thread_suspend();
-	pthread_mutex_lock(&wakeup_time_lock);
-#endif
 	if (ReadMacInt16(tm + qType) & 0x8000) {
 
 		// Yes, make task inactive and remove it from the Time Manager queue
 		WriteMacInt16(tm + qType, ReadMacInt16(tm + qType) & 0x7fff);
 		dequeue_tm(tm);
-#if PRECISE_TIMING
-		// Look for next task to be called and set wakeup_time
-		wakeup_time = wakeup_time_max;
-		for (TMDesc *d = tmDescList; d; d = d->next)
-			if ((ReadMacInt16(d->task + qType) & 0x8000))
-				if (timer_cmp_time(d->wakeup, wakeup_time) < 0)
-					wakeup_time = d->wakeup;
-#endif
 
 		// Compute remaining time
 		tm_time_t remaining, current;
@@ -400,24 +537,12 @@ int16 RmvTime(uint32 tm)
 	} else
 		WriteMacInt32(tm + tmCount, 0);
 	D(bug(" tmCount %ld\n", ReadMacInt32(tm + tmCount)));
-#if PRECISE_TIMING_BEOS
-	release_sem(wakeup_time_sem);
-	thread_info info;
-	do {
-		resume_thread(timer_thread);			// This will unblock the thread
-		get_thread_info(timer_thread, &info);
-	} while (info.state == B_THREAD_SUSPENDED);	// Sometimes, resume_thread() doesn't work (BeOS bug?)
-#endif
-#ifdef PRECISE_TIMING_MACH
-	semaphore_signal(wakeup_time_sem);
-	thread_abort(timer_thread);
-	thread_resume(timer_thread);
-#endif
-#if PRECISE_TIMING_POSIX
-	pthread_mutex_unlock(&wakeup_time_lock);
-	timer_thread_resume();
-	assert(suspend_count == 0);
-#endif
+
+	// Look for next task to be called
+	if (desc->active_index >= 0) {
+		deactivate_desc(desc);
+		update_wakeup_time();
+	}
 
 	// Free descriptor
 	free_desc(desc);
@@ -483,46 +608,12 @@ int16 PrimeTime(uint32 tm, int32 time)
 	}
 
 	// Make task active and enqueue it in the Time Manager queue
-#if PRECISE_TIMING_BEOS
-	while (acquire_sem(wakeup_time_sem) == B_INTERRUPTED) ;
-	suspend_thread(timer_thread);
-#endif
-#ifdef PRECISE_TIMING_MACH
-	semaphore_wait(wakeup_time_sem);
-	thread_suspend(timer_thread);
-#endif
-#if PRECISE_TIMING_POSIX
-	timer_thread_suspend();
-	pthread_mutex_lock(&wakeup_time_lock);
-#endif
 	WriteMacInt16(tm + qType, ReadMacInt16(tm + qType) | 0x8000);
 	enqueue_tm(tm);
-#if PRECISE_TIMING
-	// Look for next task to be called and set wakeup_time
-	wakeup_time = wakeup_time_max;
-	for (TMDesc *d = tmDescList; d; d = d->next)
-		if ((ReadMacInt16(d->task + qType) & 0x8000))
-			if (timer_cmp_time(d->wakeup, wakeup_time) < 0)
-				wakeup_time = d->wakeup;
-#ifdef PRECISE_TIMING_BEOS
-	release_sem(wakeup_time_sem);
-	thread_info info;
-	do {
-		resume_thread(timer_thread);			// This will unblock the thread
-		get_thread_info(timer_thread, &info);
-	} while (info.state == B_THREAD_SUSPENDED);	// Sometimes, resume_thread() doesn't work (BeOS bug?)
-#endif
-#ifdef PRECISE_TIMING_MACH
-	semaphore_signal(wakeup_time_sem);
-	thread_abort(timer_thread);
-	thread_resume(timer_thread);
-#endif
-#ifdef PRECISE_TIMING_POSIX
-	pthread_mutex_unlock(&wakeup_time_lock);
-	timer_thread_resume();
-	assert(suspend_count == 0);
-#endif
-#endif
+
+	// Look for next task to be called
+	activate_desc(desc);
+	update_wakeup_time();
 	return 0;
 }
 
@@ -577,7 +668,23 @@ static void *timer_func(void *arg)
 }
 #endif
 
-#ifdef PRECISE_TIMING_POSIX
+#ifdef PRECISE_TIMING_TIMERFD
+static void *timer_func(void *arg)
+{
+	while (!timer_thread_cancel) {
+		// Wait until the time timer_fd was armed for
+		uint64 expirations;
+		if (read(timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations) || timer_thread_cancel)
+			continue;
+
+		// Timer expired, trigger interrupt
+		timer_fd_expired = true;
+		SetInterruptFlag(INTFLAG_TIMER);
+		TriggerInterrupt();
+	}
+	return NULL;
+}
+#elif defined(PRECISE_TIMING_POSIX)
 static void *timer_func(void *arg)
 {
 	while (!timer_thread_cancel) {
@@ -609,16 +716,24 @@ void TimerInterrupt(void)
 {
 //	D(bug("TimerIRQ\n"));
 
-	// Look for active TMTasks that have expired
+	// Take active TMTasks that have expired off the schedule. Tasks primed
+	// again by their timer function will only be called on the next interrupt
 	tm_time_t now;
 	timer_current_time(now);
-	TMDesc *desc = tmDescList;
-	while (desc) {
-		TMDesc *next = desc->next;
-		uint32 tm = desc->task;
-		if ((ReadMacInt16(tm + qType) & 0x8000) && timer_cmp_time(desc->wakeup, now) <= 0) {
+	vector<uint32> expired;
+	while (!tmActive.empty() && timer_cmp_time(tmActive[0]->wakeup, now) <= 0) {
+		expired.push_back(tmActive[0]->task);
+		deactivate_desc(tmActive[0]);
+	}
+
+	for (vector<uint32>::const_iterator i = expired.begin(); i != expired.end(); ++i) {
+		uint32 tm = *i;
 
-			// Found one, mark as inactive and remove it from the Time Manager queue
+		// Skip tasks that were removed or primed again by an earlier timer function
+		TMDesc *desc = find_desc(tm);
+		if (desc && desc->active_index < 0 && (ReadMacInt16(tm + qType) & 0x8000)) {
+
+			// Mark as inactive and remove it from the Time Manager queue
 			WriteMacInt16(tm + qType, ReadMacInt16(tm + qType) & 0x7fff);
 			dequeue_tm(tm);
 
@@ -633,45 +748,16 @@ void TimerInterrupt(void)
 				D(bug(" returned from TimeTask\n"));
 			}
 		}
-		desc = next;
 	}
 
-#if PRECISE_TIMING
-	// Look for next task to be called and set wakeup_time
-#if PRECISE_TIMING_BEOS
-	while (acquire_sem(wakeup_time_sem) == B_INTERRUPTED) ;
-	suspend_thread(timer_thread);
-#endif
-#if PRECISE_TIMING_MACH
-	semaphore_wait(wakeup_time_sem);
-	thread_suspend(timer_thread);
-#endif
-#if PRECISE_TIMING_POSIX
-	timer_thread_suspend();
-	pthread_mutex_lock(&wakeup_time_lock);
-#endif
-	wakeup_time = wakeup_time_max;
-	for (TMDesc *d = tmDescList; d; d = d->next)
-		if ((ReadMacInt16(d->task + qType) & 0x8000))
-			if (timer_cmp_time(d->wakeup, wakeup_time) < 0)
-				wakeup_time = d->wakeup;
-#if PRECISE_TIMING_BEOS
-	release_sem(wakeup_time_sem);
-	thread_info info;
-	do {
-		resume_thread(timer_thread);			// This will unblock the thread
-		get_thread_info(timer_thread, &info);
-	} while (info.state == B_THREAD_SUSPENDED);	// Sometimes, resume_thread() doesn't work (BeOS bug?)
-#endif
-#if PRECISE_TIMING_MACH
-	semaphore_signal(wakeup_time_sem);
-	thread_abort(timer_thread);
-	thread_resume(timer_thread);
-#endif
-#if PRECISE_TIMING_POSIX
-	pthread_mutex_unlock(&wakeup_time_lock);
-	timer_thread_resume();
-	assert(suspend_count == 0);
-#endif
+	// Look for next task to be called
+#ifdef PRECISE_TIMING_TIMERFD
+	// The timer was disarmed when it expired, even if no task was found
+	// due (e.g. the realtime clock was stepped back), so always re-arm it
+	if (timer_fd_expired) {
+		timer_fd_expired = false;
+		wakeup_time = wakeup_time_max;
+	}
 #endif
+	update_wakeup_time();
 }